@@ -0,0 +1,99 @@
+#include "Admission.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+AdmissionControl::AdmissionControl(std::size_t theMaxActive,
+                                   std::chrono::milliseconds theQueueTimeout)
+    : itsMaxActive(theMaxActive), itsQueueTimeout(theQueueTimeout)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Wait for a free processing slot
+ */
+// ----------------------------------------------------------------------
+
+AdmissionControl::Slot AdmissionControl::acquire()
+{
+  std::unique_lock<std::mutex> lock(itsMutex);
+
+  if (itsMaxActive > 0 &&
+      !itsCondition.wait_for(lock, itsQueueTimeout, [this] { return itsActive < itsMaxActive; }))
+    throw AdmissionError("Too many concurrent requests, try again later", true);
+
+  ++itsActive;
+  return Slot(this);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Release a processing slot
+ */
+// ----------------------------------------------------------------------
+
+void AdmissionControl::release()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    --itsActive;
+  }
+  itsCondition.notify_one();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Number of requests being processed
+ */
+// ----------------------------------------------------------------------
+
+std::size_t AdmissionControl::active() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsActive;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Release the slot
+ */
+// ----------------------------------------------------------------------
+
+AdmissionControl::Slot::~Slot()
+{
+  if (itsControl != nullptr)
+    itsControl->release();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated cost of a request
+ *
+ * The work is roughly proportional to the number of values to be
+ * sampled and contoured for each layer.
+ */
+// ----------------------------------------------------------------------
+
+double request_cost(std::size_t theSteps,
+                    std::size_t theLevels,
+                    std::size_t theTimes,
+                    std::size_t theLayers)
+{
+  return static_cast<double>(theSteps) * static_cast<double>(theLevels) *
+         static_cast<double>(theTimes) * static_cast<double>(theLayers);
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
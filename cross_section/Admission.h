@@ -0,0 +1,89 @@
+// ======================================================================
+/*!
+ * \brief Admission control for expensive requests
+ *
+ * Requests are rejected before any data is processed if their
+ * estimated cost exceeds the limit of the customer, and the number
+ * of requests being processed concurrently is capped. Requests
+ * exceeding the cap wait in a queue for a bounded time for a free
+ * slot and are then rejected.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// Thrown when a request is not admitted. Overloads are temporary and
+// the client may retry later, too expensive requests are not.
+
+class AdmissionError : public std::runtime_error
+{
+ public:
+  AdmissionError(const std::string& theReason, bool theOverload)
+      : std::runtime_error(theReason), itsOverload(theOverload)
+  {
+  }
+
+  bool overload() const { return itsOverload; }
+
+ private:
+  bool itsOverload;
+};
+
+class AdmissionControl
+{
+ public:
+  AdmissionControl(std::size_t theMaxActive, std::chrono::milliseconds theQueueTimeout);
+
+  // A slot for processing a request, released upon destruction
+  class Slot
+  {
+   public:
+    explicit Slot(AdmissionControl* theControl) : itsControl(theControl) {}
+    ~Slot();
+    Slot(const Slot& other) = delete;
+    Slot& operator=(const Slot& other) = delete;
+    Slot(Slot&& other) noexcept : itsControl(other.itsControl) { other.itsControl = nullptr; }
+    Slot& operator=(Slot&& other) = delete;
+
+   private:
+    AdmissionControl* itsControl;
+  };
+
+  // Wait for a free slot, throws AdmissionError if none is available in time
+  Slot acquire();
+
+  std::size_t active() const;
+
+ private:
+  void release();
+
+  const std::size_t itsMaxActive;  // zero for no limit
+  const std::chrono::milliseconds itsQueueTimeout;
+
+  mutable std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  std::size_t itsActive = 0;
+};
+
+// Estimated cost of a request
+double request_cost(std::size_t theSteps,
+                    std::size_t theLevels,
+                    std::size_t theTimes,
+                    std::size_t theLayers);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,253 @@
+#include "ArrowLayer.h"
+#include "Config.h"
+#include "Deadline.h"
+#include "State.h"
+#include <boost/timer/timer.hpp>
+#include <ctpp2/CDT.hpp>
+#include <grid-files/common/GeneralDefinitions.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <cmath>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Select every Nth index or indices at least the given spacing apart
+ */
+// ----------------------------------------------------------------------
+
+template <typename Coordinate>
+std::vector<uint> thin(uint theCount,
+                       unsigned int theStride,
+                       const std::optional<double>& theSpacing,
+                       Coordinate theCoordinate)
+{
+  std::vector<uint> ret;
+  if (!theSpacing)
+  {
+    for (uint i = 0; i < theCount; i += theStride)
+      ret.push_back(i);
+    return ret;
+  }
+
+  for (uint i = 0; i < theCount; i++)
+    if (ret.empty() || std::abs(theCoordinate(i) - theCoordinate(ret.back())) >= *theSpacing)
+      ret.push_back(i);
+  return ret;
+}
+
+// Round for output
+std::string format(double theValue, double theResolution)
+{
+  return Fmi::to_string(std::round(theValue / theResolution) * theResolution);
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+ArrowLayer::ArrowLayer(std::string theType)
+    : type(std::move(theType)), name("Wind"), interpolation("linear")
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Initialize from JSON
+ */
+// ----------------------------------------------------------------------
+
+void ArrowLayer::init(const Json::Value& theJson, const Config& theConfig)
+{
+  try
+  {
+    if (!theJson.isObject())
+      throw Fmi::Exception(BCP, "Arrow-layer JSON is not a JSON object");
+
+    // Iterate through all the members
+
+    const auto members = theJson.getMemberNames();
+    for (const auto& member : members)
+    {
+      const Json::Value& json = theJson[member];
+
+      if (Layer::init(member, json, theConfig))
+        ;
+      else if (member == "u")
+        u = json.asString();
+      else if (member == "v")
+        v = json.asString();
+      else if (member == "speed")
+        speed = json.asString();
+      else if (member == "direction")
+        direction = json.asString();
+      else if (member == "name")
+        name = json.asString();
+      else if (member == "zparameter")
+        zparameter = json.asString();
+      else if (member == "interpolation")
+        interpolation = json.asString();
+      else if (member == "multiplier")
+        multiplier = json.asDouble();
+      else if (member == "offset")
+        offset = json.asDouble();
+      else if (member == "xstride")
+        xstride = json.asUInt();
+      else if (member == "ystride")
+        ystride = json.asUInt();
+      else if (member == "dx")
+        dx = json.asDouble();
+      else if (member == "dy")
+        dy = json.asDouble();
+      else
+        throw Fmi::Exception(BCP, "Arrow-layer does not have a setting named '" + member + "'");
+    }
+
+    if (xstride == 0 || ystride == 0)
+      throw Fmi::Exception(BCP, "Arrow-layer strides must be positive");
+    if ((dx && *dx <= 0) || (dy && *dy <= 0))
+      throw Fmi::Exception(BCP, "Arrow-layer spacings must be positive");
+
+    if (speed || direction)
+    {
+      if (!speed || !direction || u || v)
+        throw Fmi::Exception(BCP, "Arrow-layer needs either u and v or speed and direction");
+    }
+    else
+    {
+      if (!u)
+        u = "WindUMS";
+      if (!v)
+        v = "WindVMS";
+    }
+
+    // The grids are fetched like the data of contour layers and are shared with them
+
+    itsFirst = std::make_shared<ContourGroup>(
+        speed ? *speed : *u, zparameter, interpolation, std::nullopt, std::nullopt);
+    itsSecond = std::make_shared<ContourGroup>(
+        direction ? *direction : *v, zparameter, interpolation, std::nullopt, std::nullopt);
+    itsFirst->requireGrid();
+    itsSecond->requireGrid();
+    if (direction)
+      itsSecond->requireDirection();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate the layer details into the template hash
+ *
+ * The symbols are output as one array of [distance, z, speed, direction]
+ * records per layer. Points where either component is missing are
+ * skipped.
+ */
+// ----------------------------------------------------------------------
+
+void ArrowLayer::generate(CTPP::CDT& theGlobals, State& theState)
+{
+  try
+  {
+    std::unique_ptr<boost::timer::auto_cpu_timer> timer;
+    if (theState.query().timer)
+    {
+      std::string report = "ArrowLayer::generate finished in %t sec CPU, %w sec real\n";
+      timer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
+    }
+
+    if (!itsFirst || !itsSecond)
+      throw Fmi::Exception(BCP, "Arrow-layer is not initialized");
+
+    auto first = itsFirst->verticalGrid(theState);
+    auto second = itsSecond->verticalGrid(theState);
+    if (!first || !second)
+      throw Fmi::Exception(BCP, "Arrow-layer requires gridded data and linear interpolation");
+
+    if (first->width != second->width || first->height != second->height)
+      throw Fmi::Exception(BCP, "Wind components have different vertical grids");
+
+    const uint width = first->width;
+    const auto& coordinates = first->coordinates;
+
+    const auto columns = thin(
+        width, xstride, dx, [&](uint theColumn) { return coordinates[theColumn].x(); });
+
+    const auto scale = (multiplier ? *multiplier : 1.0);
+    const auto shift = (offset ? *offset : 0.0);
+    const double todeg = 180.0 / 3.14159265358979323846;
+
+    std::string symbols = "[";
+    for (const auto col : columns)
+    {
+      const auto rows = thin(first->height,
+                             ystride,
+                             dy,
+                             [&](uint theRow) { return coordinates[theRow * width + col].y(); });
+      for (const auto row : rows)
+      {
+        const auto pos = row * width + col;
+        const float a = first->values[pos];
+        const float b = second->values[pos];
+        if (a == ParamValueMissing || b == ParamValueMissing)
+          continue;
+
+        double spd = a;
+        double dir = b;
+        if (!speed)
+        {
+          // The direction the wind blows from
+          spd = std::sqrt(a * a + b * b);
+          dir = std::fmod(std::atan2(-a, -b) * todeg + 360.0, 360.0);
+        }
+
+        if (symbols.size() > 1)
+          symbols += ',';
+        symbols += '[';
+        symbols += format(coordinates[pos].x(), 0.001);
+        symbols += ',';
+        symbols += format(coordinates[pos].y(), 0.001);
+        symbols += ',';
+        symbols += format(scale * spd + shift, 0.1);
+        symbols += ',';
+        symbols += format(dir, 0.1);
+        symbols += ']';
+      }
+    }
+    symbols += ']';
+
+    CTPP::CDT hash(CTPP::CDT::HASH_VAL);
+    theState.addAttributes(theGlobals, hash, attributes);
+    hash["symbols"] = symbols;
+    theState.addRecord(theGlobals, theState.timeKey(), type, name, hash);
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
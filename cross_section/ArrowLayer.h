@@ -0,0 +1,69 @@
+// ======================================================================
+/*!
+ * \brief Wind arrow and barb layer
+ *
+ * Samples the wind from the vertical grids at thinned columns and
+ * levels, and outputs one compact record per symbol instead of paths:
+ * the distance, vertical coordinate, speed and direction the wind
+ * blows from. The grids are shared with other layers using the same
+ * data for the same timestep.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "ContourGroup.h"
+#include "Layer.h"
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class Config;
+class State;
+
+class ArrowLayer : public Layer
+{
+ public:
+  // The type is arrows or barbs
+  explicit ArrowLayer(std::string theType);
+
+  void init(const Json::Value& theJson, const Config& theConfig) override;
+
+  void generate(CTPP::CDT& theGlobals, State& theState) override;
+
+  std::string type;
+
+  // Either the U and V components or the speed and direction
+  std::optional<std::string> u;
+  std::optional<std::string> v;
+  std::optional<std::string> speed;
+  std::optional<std::string> direction;
+
+  std::string name;  // parameter name in the output
+  std::optional<std::string> zparameter;
+  std::string interpolation;
+
+  // Conversion of the speed, for example to knots
+  std::optional<double> multiplier;
+  std::optional<double> offset;
+
+  // Thinning either by columns and levels or by minimum spacing
+  unsigned int xstride = 1;
+  unsigned int ystride = 1;
+  std::optional<double> dx;  // distance along the route
+  std::optional<double> dy;  // vertical coordinate
+
+ private:
+  std::shared_ptr<ContourGroup> itsFirst;   // u or speed
+  std::shared_ptr<ContourGroup> itsSecond;  // v or direction
+};  // class ArrowLayer
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
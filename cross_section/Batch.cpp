@@ -0,0 +1,187 @@
+#include "Batch.h"
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Parse a route of a batch request
+ */
+// ----------------------------------------------------------------------
+
+Waypoints parse_route(const std::string& theRoute)
+{
+  try
+  {
+    std::vector<std::string> points;
+    boost::algorithm::split(points, theRoute, boost::algorithm::is_any_of(";"));
+
+    Waypoints ret;
+    for (const auto& point : points)
+    {
+      std::vector<std::string> lonlat;
+      boost::algorithm::split(lonlat, point, boost::algorithm::is_any_of(","));
+      if (lonlat.size() != 2)
+        throw Fmi::Exception(BCP, "Route points must be of the form lon,lat")
+            .addParameter("Route", theRoute);
+
+      Waypoint waypoint{Fmi::stod(lonlat[0]), Fmi::stod(lonlat[1])};
+      if (waypoint.longitude < -180 || waypoint.longitude > 360 || waypoint.latitude < -90 ||
+          waypoint.latitude > 90)
+        throw Fmi::Exception(BCP, "Route coordinates out of range")
+            .addParameter("Route", theRoute);
+      ret.push_back(waypoint);
+    }
+
+    if (ret.size() < 2)
+      throw Fmi::Exception(BCP, "At least two locations are required for a cross-section")
+          .addParameter("Route", theRoute);
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run tasks in parallel
+ *
+ * The calling thread picks the next task until all have been run, and
+ * up to the given number of threads of the shared pool help when they
+ * are free. Since the caller always makes progress by itself, nested
+ * calls from within the pool cannot deadlock even if all threads of
+ * the pool are busy. Helpers which start only after the caller has
+ * finished do nothing. After an error the remaining tasks are skipped.
+ */
+// ----------------------------------------------------------------------
+
+void run_parallel(ThreadPool& thePool,
+                  std::size_t theCount,
+                  std::size_t theThreads,
+                  const std::function<void(std::size_t)>& theTask)
+{
+  // State shared with the helpers, which may outlive this call
+
+  struct Shared
+  {
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::size_t active = 0;  // helpers running tasks
+    bool closed = false;     // no more helpers may start
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+  };
+
+  auto shared = std::make_shared<Shared>();
+
+  auto worker = [theCount, &theTask](Shared& theShared)
+  {
+    for (std::size_t i = theShared.next++; i < theCount && !theShared.failed;
+         i = theShared.next++)
+    {
+      try
+      {
+        theTask(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(theShared.mutex);
+        if (!theShared.error)
+          theShared.error = std::current_exception();
+        theShared.failed = true;
+      }
+    }
+  };
+
+  try
+  {
+    const auto n = std::min(theThreads, theCount);
+    for (std::size_t i = 1; i < n; i++)
+    {
+      thePool.submit(
+          [shared, worker]()
+          {
+            {
+              std::lock_guard<std::mutex> lock(shared->mutex);
+              if (shared->closed)
+                return;
+              ++shared->active;
+            }
+            worker(*shared);
+            {
+              std::lock_guard<std::mutex> lock(shared->mutex);
+              --shared->active;
+            }
+            shared->finished.notify_all();
+          });
+    }
+
+    // The calling thread works too, and then waits for the helpers which started
+
+    worker(*shared);
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->closed = true;
+    shared->finished.wait(lock, [&shared] { return shared->active == 0; });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+
+  // Errors of the tasks are passed on unchanged so that the caller can
+  // handle admission and deadline errors
+
+  if (shared->error)
+    std::rethrow_exception(shared->error);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Combine the outputs of the routes
+ *
+ * The outputs are JSON documents, and are listed in the order of the
+ * routes in the request.
+ */
+// ----------------------------------------------------------------------
+
+std::string combine_outputs(const std::vector<std::string>& theOutputs)
+{
+  try
+  {
+    std::string ret = "{\"routes\":[";
+    for (std::size_t i = 0; i < theOutputs.size(); i++)
+    {
+      if (i > 0)
+        ret += ',';
+      ret += theOutputs[i];
+    }
+    ret += "]}";
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,42 @@
+// ======================================================================
+/*!
+ * \brief Utilities for batch requests with several routes
+ *
+ * A batch request lists its routes in repeated route parameters, given
+ * either in the query string or in a form encoded POST body. The
+ * product, template, times and data are shared by all routes, the
+ * routes are rendered in parallel and the outputs are combined into a
+ * single JSON document.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Geodesy.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// Parse a route of the form lon,lat;lon,lat;...
+Waypoints parse_route(const std::string& theRoute);
+
+// Run the tasks 0...count-1 in at most the given number of threads, the calling
+// thread included. The first error is rethrown once all threads have finished.
+void run_parallel(ThreadPool& thePool,
+                  std::size_t theCount,
+                  std::size_t theThreads,
+                  const std::function<void(std::size_t)>& theTask);
+
+// Combine the outputs of the routes into a single JSON document
+std::string combine_outputs(const std::vector<std::string>& theOutputs);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
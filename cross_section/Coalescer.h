@@ -0,0 +1,143 @@
+// ======================================================================
+/*!
+ * \brief Single-flight execution of identical concurrent requests
+ *
+ * When new data arrives many clients tend to request the same product
+ * at the same time. The first request with a given key computes the
+ * result, and identical requests arriving while it is in flight wait
+ * for it and share the result instead of repeating the work. Errors
+ * in the data are propagated to all waiting requests, but failures
+ * specific to the leading request itself (its deadline, its admission)
+ * are not: one of the waiting requests then reruns the computation as
+ * the new leader. Once the computation has finished the key is
+ * forgotten, the results are not cached.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// Thrown when an identical request does not finish in time
+class CoalesceTimeout : public std::runtime_error
+{
+ public:
+  explicit CoalesceTimeout(const std::string& theReason) : std::runtime_error(theReason) {}
+};
+
+template <typename Value>
+class Coalescer
+{
+ public:
+  // Run the function unless an identical call is already in flight. The predicate
+  // tells whether a failure of the function belongs to the calling request only.
+  template <typename Function, typename Predicate>
+  Value run(const std::string& theKey,
+            Function&& theFunction,
+            std::chrono::milliseconds theTimeout,
+            Predicate&& theOwnFailure)
+  {
+    const auto expiry = std::chrono::steady_clock::now() + theTimeout;
+
+    while (true)
+    {
+      std::promise<Result> promise;
+      std::shared_future<Result> future;
+      bool leader = false;
+
+      {
+        std::lock_guard<std::mutex> lock(itsMutex);
+        auto it = itsCalls.find(theKey);
+        if (it != itsCalls.end())
+          future = it->second;
+        else
+        {
+          future = promise.get_future().share();
+          itsCalls.emplace(theKey, future);
+          leader = true;
+        }
+      }
+
+      if (!leader)
+      {
+        if (future.wait_until(expiry) != std::future_status::ready)
+          throw CoalesceTimeout("Timed out waiting for an identical request to finish in " +
+                                std::to_string(theTimeout.count()) + " ms");
+
+        const Result& result = future.get();
+        if (result)
+          return *result;
+
+        // The leader gave up for reasons of its own, try to take over
+        continue;
+      }
+
+      try
+      {
+        Value value = theFunction();
+        forget(theKey);
+        promise.set_value(value);
+        return value;
+      }
+      catch (...)
+      {
+        auto error = std::current_exception();
+        forget(theKey);
+        if (theOwnFailure(error))
+          promise.set_value(std::nullopt);
+        else
+          promise.set_exception(error);
+        throw;
+      }
+    }
+  }
+
+  // Run the function treating all failures as shared ones
+  template <typename Function>
+  Value run(const std::string& theKey,
+            Function&& theFunction,
+            std::chrono::milliseconds theTimeout)
+  {
+    return run(theKey,
+               std::forward<Function>(theFunction),
+               theTimeout,
+               [](const std::exception_ptr&) { return false; });
+  }
+
+  // Number of computations in flight
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    return itsCalls.size();
+  }
+
+ private:
+  // An empty result means the leader abandoned the computation
+  using Result = std::optional<Value>;
+
+  void forget(const std::string& theKey)
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsCalls.erase(theKey);
+  }
+
+  mutable std::mutex itsMutex;
+  std::map<std::string, std::shared_future<Result>> itsCalls;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
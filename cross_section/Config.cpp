@@ -5,8 +5,10 @@
 // ======================================================================
 
 #include "Config.h"
+#include <algorithm>
 #include <filesystem>
 #include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
 #include <spine/ConfigTools.h>
 #include <stdexcept>
 
@@ -18,6 +20,90 @@ namespace Plugin
 {
 namespace CrossSection
 {
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Read a prewarm job as request parameters
+ */
+// ----------------------------------------------------------------------
+
+Config::PrewarmJob read_prewarm_job(const libconfig::Setting& theSetting)
+{
+  if (!theSetting.isGroup())
+    throw Fmi::Exception(BCP, "prewarm.jobs must be a list of groups");
+
+  Config::PrewarmJob job;
+  for (int i = 0; i < theSetting.getLength(); i++)
+  {
+    const auto& setting = theSetting[i];
+    switch (setting.getType())
+    {
+      case libconfig::Setting::TypeString:
+        job[setting.getName()] = static_cast<const char*>(setting);
+        break;
+      case libconfig::Setting::TypeInt:
+        job[setting.getName()] = std::to_string(static_cast<int>(setting));
+        break;
+      case libconfig::Setting::TypeInt64:
+        job[setting.getName()] = std::to_string(static_cast<long long>(setting));
+        break;
+      case libconfig::Setting::TypeFloat:
+        job[setting.getName()] = Fmi::to_string(static_cast<double>(setting));
+        break;
+      case libconfig::Setting::TypeBoolean:
+        job[setting.getName()] = (static_cast<bool>(setting) ? "1" : "0");
+        break;
+      default:
+        throw Fmi::Exception(BCP, "Invalid prewarm job setting")
+            .addParameter("Setting", setting.getName());
+    }
+  }
+
+  if (job.find("product") == job.end() || job.find("producer") == job.end())
+    throw Fmi::Exception(BCP, "Prewarm jobs must define at least the product and the producer");
+
+  return job;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Read the route snapping policy of a customer
+ */
+// ----------------------------------------------------------------------
+
+SnapPolicy read_snap_policy(const libconfig::Setting& theSetting)
+{
+  if (!theSetting.isGroup())
+    throw Fmi::Exception(BCP, "snap.customers must contain groups");
+
+  SnapPolicy policy;
+  theSetting.lookupValue("resolution", policy.resolution);
+  if (policy.resolution < 0)
+    throw Fmi::Exception(BCP, "snap.customers resolution cannot be negative")
+        .addParameter("Customer", theSetting.getName());
+
+  if (theSetting.exists("steps"))
+  {
+    const auto& steps = theSetting["steps"];
+    if (!steps.isArray())
+      throw Fmi::Exception(BCP, "snap.customers steps must be an array of integers")
+          .addParameter("Customer", theSetting.getName());
+    for (int i = 0; i < steps.getLength(); i++)
+    {
+      int value = steps[i];
+      if (value <= 0)
+        throw Fmi::Exception(BCP, "snap.customers steps must be positive")
+            .addParameter("Customer", theSetting.getName());
+      policy.steps.push_back(static_cast<std::size_t>(value));
+    }
+    std::sort(policy.steps.begin(), policy.steps.end());
+  }
+
+  return policy;
+}
+}  // namespace
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Constructor
@@ -53,6 +139,118 @@ Config::Config(const string& configfile)
       itsConfig.lookupValue("templatedir", itsTemplateDirectory);
       itsConfig.lookupValue("customer", itsDefaultCustomer);
       itsConfig.lookupValue("timezone", itsDefaultTimeZone);
+
+      itsConfig.lookupValue("coalesce.enabled", itsCoalesce);
+      itsConfig.lookupValue("coalesce.timeout", itsCoalesceTimeout);
+      if (itsCoalesceTimeout <= 0)
+        throw Fmi::Exception(BCP, "coalesce.timeout must be positive");
+
+      itsConfig.lookupValue("admission.max_cost", itsMaxCost);
+      itsConfig.lookupValue("admission.max_active", itsMaxActiveRequests);
+      itsConfig.lookupValue("admission.queue_timeout", itsQueueTimeout);
+      itsConfig.lookupValue("admission.retry_after", itsRetryAfter);
+      itsConfig.lookupValue("admission.default_levels", itsDefaultLevels);
+
+      if (itsConfig.exists("admission.customers"))
+      {
+        const auto& customers = itsConfig.lookup("admission.customers");
+        for (int i = 0; i < customers.getLength(); i++)
+        {
+          long long cost = 0;
+          if (!customers[i].lookupValue("max_cost", cost))
+            throw Fmi::Exception(BCP, "admission.customers settings must define max_cost");
+          itsCustomerMaxCost[customers[i].getName()] = cost;
+        }
+      }
+
+      if (itsMaxActiveRequests < 0 || itsQueueTimeout < 0 || itsRetryAfter < 0 ||
+          itsDefaultLevels <= 0)
+        throw Fmi::Exception(BCP, "Invalid admission control settings");
+
+      itsConfig.lookupValue("sampling.enabled", itsQuerydataSampling);
+      itsConfig.lookupValue("sampling.plan_cache_size", itsSamplingPlanCacheSize);
+      if (itsSamplingPlanCacheSize < 0)
+        throw Fmi::Exception(BCP, "sampling.plan_cache_size cannot be negative");
+      itsConfig.lookupValue("sampling.column_resolution", itsColumnResolution);
+      itsConfig.lookupValue("sampling.column_cache_size", itsColumnCacheSize);
+      if (itsColumnResolution < 0 || itsColumnCacheSize < 0)
+        throw Fmi::Exception(BCP, "Invalid sampling column cache settings");
+
+      itsConfig.lookupValue("auto_steps.oversampling", itsAutoStepsOversampling);
+      itsConfig.lookupValue("auto_steps.max", itsAutoStepsMax);
+      if (itsAutoStepsOversampling <= 0 || itsAutoStepsMax < 2)
+        throw Fmi::Exception(BCP, "Invalid auto_steps settings");
+
+      itsConfig.lookupValue("batch.max_routes", itsBatchMaxRoutes);
+      itsConfig.lookupValue("batch.threads", itsBatchThreads);
+      if (itsBatchMaxRoutes < 1 || itsBatchThreads < 1)
+        throw Fmi::Exception(BCP, "batch.max_routes and batch.threads must be positive");
+
+      itsConfig.lookupValue("ensemble.threads", itsEnsembleThreads);
+      if (itsEnsembleThreads < 1)
+        throw Fmi::Exception(BCP, "ensemble.threads must be positive");
+
+      itsConfig.lookupValue("pool.threads", itsPoolThreads);
+      if (itsPoolThreads < 1)
+        throw Fmi::Exception(BCP, "pool.threads must be positive");
+
+      if (itsConfig.exists("snap.customers"))
+      {
+        const auto& customers = itsConfig.lookup("snap.customers");
+        for (int i = 0; i < customers.getLength(); i++)
+          itsSnapPolicies[customers[i].getName()] = read_snap_policy(customers[i]);
+      }
+
+      itsConfig.lookupValue("timeout", itsTimeout);
+      itsConfig.lookupValue("max_timeout", itsMaxTimeout);
+      if (itsTimeout < 0 || itsMaxTimeout < 0)
+        throw Fmi::Exception(BCP, "Request timeouts cannot be negative");
+
+      itsConfig.lookupValue("cache.memory_size", itsMemoryCacheSize);
+      if (itsMemoryCacheSize < 0)
+        throw Fmi::Exception(BCP, "cache.memory_size cannot be negative");
+
+      itsConfig.lookupValue("cache.locations", itsLocationCacheSize);
+      if (itsLocationCacheSize < 0)
+        throw Fmi::Exception(BCP, "cache.locations cannot be negative");
+
+      itsConfig.lookupValue("cache.directory", itsDiskCacheDirectory);
+      itsConfig.lookupValue("cache.disk_size", itsDiskCacheSize);
+      if (itsDiskCacheSize <= 0)
+        throw Fmi::Exception(BCP, "cache.disk_size must be positive");
+
+      itsConfig.lookupValue("cache.soft_ttl", itsSoftTTL);
+      itsConfig.lookupValue("cache.hard_ttl", itsHardTTL);
+      if (itsSoftTTL < 0 || itsHardTTL < itsSoftTTL)
+        throw Fmi::Exception(BCP, "cache.hard_ttl must be at least cache.soft_ttl");
+
+      itsConfig.lookupValue("expires", itsExpires);
+      if (itsExpires < 0)
+        throw Fmi::Exception(BCP, "expires cannot be negative");
+
+      if (itsConfig.exists("update_interval"))
+      {
+        const auto& intervals = itsConfig.lookup("update_interval");
+        for (int i = 0; i < intervals.getLength(); i++)
+        {
+          int interval = intervals[i];
+          if (interval <= 0)
+            throw Fmi::Exception(BCP, "Producer update intervals must be positive")
+                .addParameter("Producer", intervals[i].getName());
+          itsUpdateIntervals[intervals[i].getName()] = interval;
+        }
+      }
+
+      if (itsConfig.exists("prewarm.jobs"))
+      {
+        const auto& jobs = itsConfig.lookup("prewarm.jobs");
+        for (int i = 0; i < jobs.getLength(); i++)
+          itsPrewarmJobs.push_back(read_prewarm_job(jobs[i]));
+      }
+      itsConfig.lookupValue("prewarm.threads", itsPrewarmThreads);
+      itsConfig.lookupValue("prewarm.interval", itsPrewarmInterval);
+      if (itsPrewarmThreads <= 0 || itsPrewarmInterval <= 0)
+        throw Fmi::Exception(BCP, "prewarm.threads and prewarm.interval must be positive");
     }
   }
   catch (...)
@@ -91,6 +289,139 @@ const std::string& Config::rootDirectory() const
 {
   return itsRootDirectory;
 }
+bool Config::coalesce() const
+{
+  return itsCoalesce;
+}
+int Config::coalesceTimeout() const
+{
+  return itsCoalesceTimeout;
+}
+long long Config::maxCost(const std::string& theCustomer) const
+{
+  auto it = itsCustomerMaxCost.find(theCustomer);
+  if (it != itsCustomerMaxCost.end())
+    return it->second;
+  return itsMaxCost;
+}
+bool Config::querydataSampling() const
+{
+  return itsQuerydataSampling;
+}
+std::size_t Config::samplingPlanCacheSize() const
+{
+  return static_cast<std::size_t>(itsSamplingPlanCacheSize);
+}
+double Config::columnResolution() const
+{
+  return itsColumnResolution;
+}
+std::size_t Config::columnCacheSize() const
+{
+  return static_cast<std::size_t>(itsColumnCacheSize);
+}
+std::size_t Config::batchMaxRoutes() const
+{
+  return static_cast<std::size_t>(itsBatchMaxRoutes);
+}
+std::size_t Config::batchThreads() const
+{
+  return static_cast<std::size_t>(itsBatchThreads);
+}
+std::size_t Config::ensembleThreads() const
+{
+  return static_cast<std::size_t>(itsEnsembleThreads);
+}
+std::size_t Config::poolThreads() const
+{
+  return static_cast<std::size_t>(itsPoolThreads);
+}
+double Config::autoStepsOversampling() const
+{
+  return itsAutoStepsOversampling;
+}
+std::size_t Config::autoStepsMax() const
+{
+  return static_cast<std::size_t>(itsAutoStepsMax);
+}
+const SnapPolicy* Config::snapPolicy(const std::string& theCustomer) const
+{
+  auto it = itsSnapPolicies.find(theCustomer);
+  if (it != itsSnapPolicies.end())
+    return &it->second;
+  return nullptr;
+}
+int Config::maxActiveRequests() const
+{
+  return itsMaxActiveRequests;
+}
+int Config::queueTimeout() const
+{
+  return itsQueueTimeout;
+}
+int Config::retryAfter() const
+{
+  return itsRetryAfter;
+}
+int Config::defaultLevels() const
+{
+  return itsDefaultLevels;
+}
+int Config::timeout() const
+{
+  return itsTimeout;
+}
+int Config::maxTimeout() const
+{
+  return itsMaxTimeout;
+}
+std::size_t Config::memoryCacheSize() const
+{
+  return static_cast<std::size_t>(itsMemoryCacheSize) * 1024 * 1024;
+}
+std::size_t Config::locationCacheSize() const
+{
+  return static_cast<std::size_t>(itsLocationCacheSize);
+}
+const std::string& Config::diskCacheDirectory() const
+{
+  return itsDiskCacheDirectory;
+}
+std::size_t Config::diskCacheSize() const
+{
+  return static_cast<std::size_t>(itsDiskCacheSize) * 1024 * 1024;
+}
+int Config::softTTL() const
+{
+  return itsSoftTTL;
+}
+int Config::hardTTL() const
+{
+  return itsHardTTL;
+}
+int Config::expires() const
+{
+  return itsExpires;
+}
+std::optional<int> Config::updateInterval(const std::string& theProducer) const
+{
+  auto it = itsUpdateIntervals.find(theProducer);
+  if (it == itsUpdateIntervals.end())
+    return {};
+  return it->second;
+}
+const std::vector<Config::PrewarmJob>& Config::prewarmJobs() const
+{
+  return itsPrewarmJobs;
+}
+int Config::prewarmThreads() const
+{
+  return itsPrewarmThreads;
+}
+int Config::prewarmInterval() const
+{
+  return itsPrewarmInterval;
+}
 
 }  // namespace CrossSection
 }  // namespace Plugin
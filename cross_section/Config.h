@@ -6,9 +6,13 @@
 
 #pragma once
 
+#include "Snapping.h"
 #include <libconfig.h++>
+#include <map>
+#include <optional>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -35,6 +39,70 @@ class Config
   const std::string& templateDirectory() const;
   const std::string& rootDirectory() const;
 
+  // Coalescing of identical concurrent requests
+  bool coalesce() const;
+  int coalesceTimeout() const;
+
+  // Admission control
+  long long maxCost(const std::string& theCustomer) const;
+  int maxActiveRequests() const;
+  int queueTimeout() const;
+  int retryAfter() const;
+  int defaultLevels() const;
+
+  // Limits for steps=auto
+  double autoStepsOversampling() const;
+  std::size_t autoStepsMax() const;
+
+  // Sample all querydata in the plugin instead of the contour engine
+  bool querydataSampling() const;
+  // Maximum number of cached sampling plans
+  std::size_t samplingPlanCacheSize() const;
+  // Quantization of sample points in degrees, zero disables the column cache
+  double columnResolution() const;
+  std::size_t columnCacheSize() const;
+
+  // Batch requests with several routes
+  std::size_t batchMaxRoutes() const;
+  std::size_t batchThreads() const;
+
+  // Threads fetching the members of an ensemble
+  std::size_t ensembleThreads() const;
+
+  // Size of the thread pool shared by batches and ensembles
+  std::size_t poolThreads() const;
+
+  // Route snapping policy of the customer, or nullptr if none
+  const SnapPolicy* snapPolicy(const std::string& theCustomer) const;
+
+  // Request deadlines in milliseconds, zero for none
+  int timeout() const;
+  int maxTimeout() const;
+
+  // Response cache size in bytes
+  std::size_t memoryCacheSize() const;
+
+  // Maximum number of cached route endpoints, zero disables the cache
+  std::size_t locationCacheSize() const;
+
+  // Persistent cache, disabled if the directory is empty
+  const std::string& diskCacheDirectory() const;
+  std::size_t diskCacheSize() const;
+
+  // Default response times to live in seconds
+  int softTTL() const;
+  int hardTTL() const;
+
+  // HTTP cache lifetimes in seconds
+  int expires() const;
+  std::optional<int> updateInterval(const std::string& theProducer) const;
+
+  // Jobs rendered into the cache when new data arrives
+  using PrewarmJob = std::map<std::string, std::string>;
+  const std::vector<PrewarmJob>& prewarmJobs() const;
+  int prewarmThreads() const;
+  int prewarmInterval() const;
+
  private:
   libconfig::Config itsConfig;
   std::string itsDefaultUrl;
@@ -45,6 +113,48 @@ class Config
   std::string itsTemplateDirectory;
   std::string itsRootDirectory;
 
+  bool itsCoalesce = true;
+  int itsCoalesceTimeout = 30000;  // milliseconds
+
+  long long itsMaxCost = 0;  // zero for no limit
+  std::map<std::string, long long> itsCustomerMaxCost;
+
+  std::map<std::string, SnapPolicy> itsSnapPolicies;  // customer to policy
+
+  bool itsQuerydataSampling = false;
+  int itsSamplingPlanCacheSize = 1000;
+  double itsColumnResolution = 0;
+  int itsColumnCacheSize = 100000;
+
+  int itsBatchMaxRoutes = 50;
+  int itsBatchThreads = 4;
+  int itsEnsembleThreads = 8;
+  int itsPoolThreads = 16;
+
+  double itsAutoStepsOversampling = 1;
+  int itsAutoStepsMax = 1000;
+  int itsMaxActiveRequests = 0;  // zero for no limit
+  int itsQueueTimeout = 5000;    // milliseconds
+  int itsRetryAfter = 10;        // seconds
+  int itsDefaultLevels = 50;     // for estimating costs when the data is not known
+
+  int itsTimeout = 0;     // milliseconds
+  int itsMaxTimeout = 0;  // milliseconds
+
+  int itsMemoryCacheSize = 100;  // megabytes
+  int itsLocationCacheSize = 1000;
+  std::string itsDiskCacheDirectory;
+  int itsDiskCacheSize = 1000;  // megabytes
+  int itsSoftTTL = 60;          // seconds
+  int itsHardTTL = 3600;        // seconds
+
+  int itsExpires = 60;                             // seconds
+  std::map<std::string, int> itsUpdateIntervals;  // seconds
+
+  std::vector<PrewarmJob> itsPrewarmJobs;
+  int itsPrewarmThreads = 1;
+  int itsPrewarmInterval = 60;  // seconds
+
 };  // class Config
 
 }  // namespace CrossSection
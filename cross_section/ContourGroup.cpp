@@ -0,0 +1,1184 @@
+#include "ContourGroup.h"
+#include "Batch.h"
+#include "Config.h"
+#include "Deadline.h"
+#include "Geodesy.h"
+#include "Sampling.h"
+#include "State.h"
+#include "Topology.h"
+#include <grid-files/common/ImagePaint.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <newbase/NFmiMetTime.h>
+#include <timeseries/ParameterFactory.h>
+#include <trax/InterpolationType.h>
+#include <algorithm>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// Resolution used for matching the vertices of adjacent isobands
+const double edge_resolution = 1e-4;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Convert contours from WKB to geometries
+ */
+// ----------------------------------------------------------------------
+
+std::vector<OGRGeometryPtr> to_geometries(const T::ByteData_vec& theContours)
+{
+  std::vector<OGRGeometryPtr> geoms;
+  for (const auto& wkb : theContours)
+  {
+    const auto* cwkb = reinterpret_cast<const unsigned char*>(wkb.data());
+    OGRGeometry* geom = nullptr;
+    OGRGeometryFactory::createFromWkb(cwkb, nullptr, &geom, wkb.size());
+    geoms.push_back(OGRGeometryPtr(geom));
+  }
+  return geoms;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find the grid parameter mappings for a parameter details record
+ */
+// ----------------------------------------------------------------------
+
+void get_parameter_mappings(const SmartMet::Engine::Grid::Engine& theGridEngine,
+                            const Engine::Grid::ParameterDetails& theRec,
+                            const std::string& theProducer,
+                            QueryServer::ParameterMapping_vec& theMappings)
+{
+  const auto& rec = theRec;
+
+  if (rec.mLevelId > " " || rec.mLevel > " ")
+  {
+    if (rec.mGeometryId > " ")
+      theGridEngine.getParameterMappings(theProducer,
+                                         rec.mOriginalParameter,
+                                         std::stoi(rec.mGeometryId),
+                                         std::stoi(rec.mLevelId),
+                                         std::stoi(rec.mLevel),
+                                         false,
+                                         theMappings);
+    else
+      theGridEngine.getParameterMappings(theProducer,
+                                         rec.mOriginalParameter,
+                                         std::stoi(rec.mLevelId),
+                                         std::stoi(rec.mLevel),
+                                         false,
+                                         theMappings);
+
+    if (theMappings.empty() && rec.mLevel < " ")
+    {
+      if (rec.mGeometryId > " ")
+        theGridEngine.getParameterMappings(theProducer,
+                                           rec.mOriginalParameter,
+                                           std::stoi(rec.mGeometryId),
+                                           std::stoi(rec.mLevelId),
+                                           -1,
+                                           false,
+                                           theMappings);
+      else
+        theGridEngine.getParameterMappings(
+            theProducer, rec.mOriginalParameter, std::stoi(rec.mLevelId), -1, false, theMappings);
+    }
+  }
+  else
+  {
+    if (rec.mGeometryId > " ")
+      theGridEngine.getParameterMappings(
+          theProducer, rec.mOriginalParameter, std::stoi(rec.mGeometryId), true, theMappings);
+    else
+      theGridEngine.getParameterMappings(theProducer, rec.mOriginalParameter, true, theMappings);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Direction of the route at each point of a vertical grid
+ *
+ * The distances of the columns are scaled to the length of the route,
+ * since grid engine distances need not be in kilometers.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<float> column_azimuths(const VerticalGrid& theGrid, const Waypoints& theWaypoints)
+{
+  if (theGrid.width == 0)
+    return {};
+
+  const double x0 = theGrid.coordinates[0].x();
+  const double x1 = theGrid.coordinates[theGrid.width - 1].x();
+  const double scale = (x1 > x0 ? route_length(theWaypoints) / (x1 - x0) : 0.0);
+
+  std::vector<double> distances(theGrid.width);
+  for (uint col = 0; col < theGrid.width; col++)
+    distances[col] = scale * (theGrid.coordinates[col].x() - x0);
+
+  const auto azimuths = route_azimuths(theWaypoints, distances);
+
+  std::vector<float> ret(theGrid.values.size());
+  for (uint row = 0; row < theGrid.height; row++)
+    for (uint col = 0; col < theGrid.width; col++)
+      ret[row * theGrid.width + col] = static_cast<float>(azimuths[col]);
+  return ret;
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+ContourGroup::ContourGroup(std::string theParameter,
+                           std::optional<std::string> theZParameter,
+                           std::string theInterpolation,
+                           std::optional<double> theMultiplier,
+                           std::optional<double> theOffset,
+                           std::optional<Ensemble> theEnsemble)
+    : itsParameter(std::move(theParameter)),
+      itsZParameter(std::move(theZParameter)),
+      itsInterpolation(std::move(theInterpolation)),
+      itsMultiplier(theMultiplier),
+      itsOffset(theOffset),
+      itsEnsemble(std::move(theEnsemble))
+{
+  try
+  {
+    if (!Expression::isExpression(itsParameter))
+      return;
+
+    if (itsEnsemble)
+      throw Fmi::Exception(BCP, "Expressions cannot be combined with ensemble statistics");
+
+    // The inputs are fetched like ordinary parameters, so they are shared
+    // with other layers and expressions using them
+
+    itsExpression = std::make_shared<Expression>(itsParameter);
+    for (const auto& name : itsExpression->parameters())
+    {
+      auto input = std::make_shared<ContourGroup>(
+          name, itsZParameter, itsInterpolation, std::nullopt, std::nullopt);
+      input->itsGridRequired = true;
+      itsInputs.push_back(input);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add isobands to be contoured
+ */
+// ----------------------------------------------------------------------
+
+void ContourGroup::addIsobands(const std::vector<Isoband>& theIsobands)
+{
+  for (const auto& isoband : theIsobands)
+    addLimits(Limits(isoband.lolimit, isoband.hilimit));
+  updateEdges();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add isolines to be contoured
+ */
+// ----------------------------------------------------------------------
+
+void ContourGroup::addIsolines(const std::vector<Isoline>& theIsolines)
+{
+  for (const auto& isoline : theIsolines)
+    addIsovalue(isoline.value);
+  updateEdges();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add isoband limits unless already present
+ */
+// ----------------------------------------------------------------------
+
+void ContourGroup::addLimits(const Limits& theLimits)
+{
+  if (std::find(itsLimits.begin(), itsLimits.end(), theLimits) == itsLimits.end())
+    itsLimits.push_back(theLimits);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add an isoline value unless already present
+ */
+// ----------------------------------------------------------------------
+
+void ContourGroup::addIsovalue(double theValue)
+{
+  if (std::find(itsIsovalues.begin(), itsIsovalues.end(), theValue) == itsIsovalues.end())
+    itsIsovalues.push_back(theValue);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find the isobands whose edges the isolines are
+ *
+ * An isoline value which is the upper limit of one isoband and the
+ * lower limit of another is the edge between those isobands, and
+ * can be extracted from them without contouring the data again.
+ */
+// ----------------------------------------------------------------------
+
+void ContourGroup::updateEdges()
+{
+  itsIsolineEdges.clear();
+  for (auto value : itsIsovalues)
+  {
+    std::size_t below = itsLimits.size();
+    std::size_t above = itsLimits.size();
+    for (std::size_t i = 0; i < itsLimits.size(); i++)
+    {
+      if (itsLimits[i].second && *itsLimits[i].second == value)
+        below = i;
+      if (itsLimits[i].first && *itsLimits[i].first == value)
+        above = i;
+    }
+    if (below == itsLimits.size() || above == itsLimits.size())
+      itsIsolineEdges.emplace_back(std::nullopt);
+    else
+      itsIsolineEdges.emplace_back(Edge(below, above));
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the groups contour the same data the same way
+ */
+// ----------------------------------------------------------------------
+
+bool ContourGroup::sameSlice(const ContourGroup& theOther) const
+{
+  return (itsParameter == theOther.itsParameter && itsZParameter == theOther.itsZParameter &&
+          itsInterpolation == theOther.itsInterpolation &&
+          itsMultiplier == theOther.itsMultiplier && itsOffset == theOther.itsOffset &&
+          itsEnsemble == theOther.itsEnsemble && itsDirection == theOther.itsDirection);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Take over the contours of another group
+ *
+ * This succeeds if the groups contour the same data slice. The group
+ * then contours the union of the limits and values of both, and the
+ * layers of the other group can use this group instead.
+ */
+// ----------------------------------------------------------------------
+
+bool ContourGroup::merge(const ContourGroup& theOther)
+{
+  try
+  {
+    if (&theOther == this || !sameSlice(theOther))
+      return false;
+
+    for (const auto& limits : theOther.itsLimits)
+      addLimits(limits);
+    for (auto value : theOther.itsIsovalues)
+      addIsovalue(value);
+    updateEdges();
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Position of the isoband in the generated isobands
+ */
+// ----------------------------------------------------------------------
+
+std::size_t ContourGroup::isobandIndex(const Isoband& theIsoband) const
+{
+  const Limits limits(theIsoband.lolimit, theIsoband.hilimit);
+  auto it = std::find(itsLimits.begin(), itsLimits.end(), limits);
+  return static_cast<std::size_t>(it - itsLimits.begin());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Position of the isoline in the generated isolines
+ */
+// ----------------------------------------------------------------------
+
+std::size_t ContourGroup::isolineIndex(const Isoline& theIsoline) const
+{
+  auto it = std::find(itsIsovalues.begin(), itsIsovalues.end(), theIsoline.value);
+  return static_cast<std::size_t>(it - itsIsovalues.begin());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Isobands for the current timestep
+ */
+// ----------------------------------------------------------------------
+
+const std::vector<OGRGeometryPtr>& ContourGroup::isobands(State& theState) const
+{
+  try
+  {
+    auto& contours = theState.contours(this);
+    if (!contours.isobands)
+    {
+      theState.checkDeadline();
+      contours.isobands = generateIsobands(theState);
+    }
+    return *contours.isobands;
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Isolines for the current timestep
+ *
+ * Isolines along isoband edges are extracted from the isobands, the
+ * rest are contoured with a single call. If the isobands cannot be used
+ * all the isolines are contoured.
+ */
+// ----------------------------------------------------------------------
+
+const std::vector<OGRGeometryPtr>& ContourGroup::isolines(State& theState) const
+{
+  try
+  {
+    auto& contours = theState.contours(this);
+    if (contours.isolines)
+      return *contours.isolines;
+
+    std::vector<Edge> edges;
+    for (const auto& edge : itsIsolineEdges)
+      if (edge)
+        edges.push_back(*edge);
+
+    std::vector<OGRGeometryPtr> derived;
+    if (!edges.empty())
+      derived = deriveIsolines(isobands(theState), edges);
+
+    // If the isobands cannot be used the edge values are contoured directly too
+
+    const bool use_edges = (derived.size() == edges.size());
+
+    std::vector<double> values;
+    for (std::size_t i = 0; i < itsIsovalues.size(); i++)
+      if (!itsIsolineEdges[i] || !use_edges)
+        values.push_back(itsIsovalues[i]);
+
+    std::vector<OGRGeometryPtr> generated;
+    if (!values.empty())
+    {
+      theState.checkDeadline();
+      generated = generateIsolines(theState, values);
+    }
+
+    // The grid engine returns nothing if there is nothing to contour
+
+    const bool use_generated = (generated.size() == values.size());
+
+    std::vector<OGRGeometryPtr> ret;
+    if ((use_edges && !derived.empty()) || (use_generated && !generated.empty()))
+    {
+      auto d = derived.begin();
+      auto g = generated.begin();
+      for (const auto& edge : itsIsolineEdges)
+      {
+        if (edge && use_edges)
+          ret.push_back(*d++);
+        else if (use_generated)
+          ret.push_back(*g++);
+        else
+          ret.emplace_back();
+      }
+    }
+
+    contours.isolines = ret;
+    return *contours.isolines;
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract the isolines from the edges between adjacent isobands
+ *
+ * Returns nothing if the isobands do not match the limits of the group.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<OGRGeometryPtr> ContourGroup::deriveIsolines(
+    const std::vector<OGRGeometryPtr>& theIsobands, const std::vector<Edge>& theEdges) const
+{
+  try
+  {
+    // The grid engine returns nothing if there is nothing to contour
+    if (theIsobands.size() != itsLimits.size())
+      return {};
+
+    return isoband_edges(theIsobands, theEdges, edge_resolution);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate the isobands
+ */
+// ----------------------------------------------------------------------
+
+std::vector<OGRGeometryPtr> ContourGroup::generateIsobands(State& theState) const
+{
+  try
+  {
+    auto grid = verticalGrid(theState);
+    if (grid)
+    {
+      // The contourer may modify its inputs, hence copies of the cached grid
+      auto gridData = grid->values;
+      auto coordinates = grid->coordinates;
+
+      std::vector<float> contourLowValues;
+      std::vector<float> contourHighValues;
+      for (const auto& limits : itsLimits)
+      {
+        contourLowValues.push_back(limits.first ? *limits.first : -1000000000);
+        contourHighValues.push_back(limits.second ? *limits.second : 1000000000);
+      }
+
+      size_t smooth_size = 0;
+      size_t smooth_degree = 1;
+      T::ByteData_vec contours;
+
+      getIsobands(gridData,
+                  &coordinates,
+                  grid->width,
+                  grid->height,
+                  contourLowValues,
+                  contourHighValues,
+                  T::AreaInterpolationMethod::Linear,
+                  smooth_size,
+                  smooth_degree,
+                  contours);
+
+      return to_geometries(contours);
+    }
+
+    auto param = SmartMet::TimeSeries::ParameterFactory::instance().parse(itsParameter);
+
+    std::vector<SmartMet::Engine::Contour::Range> limits;
+    limits.reserve(itsLimits.size());
+    for (const auto& lim : itsLimits)
+      limits.emplace_back(lim.first, lim.second);
+    SmartMet::Engine::Contour::Options options(param, theState.time().utc_time(), limits);
+
+    return qEngineContours(theState, options);
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate the isolines
+ */
+// ----------------------------------------------------------------------
+
+std::vector<OGRGeometryPtr> ContourGroup::generateIsolines(
+    State& theState, const std::vector<double>& theValues) const
+{
+  try
+  {
+    auto grid = verticalGrid(theState);
+    if (grid)
+    {
+      // The contourer may modify its inputs, hence copies of the cached grid
+      auto gridData = grid->values;
+      auto coordinates = grid->coordinates;
+
+      std::vector<float> contourValues(theValues.begin(), theValues.end());
+
+      size_t smooth_size = 0;
+      size_t smooth_degree = 1;
+      T::ByteData_vec contours;
+
+      getIsolines(gridData,
+                  &coordinates,
+                  grid->width,
+                  grid->height,
+                  contourValues,
+                  T::AreaInterpolationMethod::Linear,
+                  smooth_size,
+                  smooth_degree,
+                  contours);
+
+      return to_geometries(contours);
+    }
+
+    auto param = SmartMet::TimeSeries::ParameterFactory::instance().parse(itsParameter);
+
+    SmartMet::Engine::Contour::Options options(param, theState.time().utc_time(), theValues);
+
+    return qEngineContours(theState, options);
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Contour querydata with the contour engine
+ */
+// ----------------------------------------------------------------------
+
+std::vector<OGRGeometryPtr> ContourGroup::qEngineContours(
+    State& theState, SmartMet::Engine::Contour::Options& theOptions) const
+{
+  try
+  {
+    // Establish the data
+    auto q = theState.producer();
+
+    if (itsMultiplier || itsOffset)
+      theOptions.transformation(itsMultiplier ? *itsMultiplier : 1.0, itsOffset ? *itsOffset : 0.0);
+
+    if (itsInterpolation == "linear")
+      theOptions.interpolation = Trax::InterpolationType::Linear;
+    else if (itsInterpolation == "nearest" || itsInterpolation == "discrete" ||
+             itsInterpolation == "midpoint")
+      theOptions.interpolation = Trax::InterpolationType::Midpoint;
+    else
+      throw Fmi::Exception(BCP, "Unknown contour interpolation method '" + itsInterpolation + "'");
+
+    // The contour engine samples only single segment routes
+
+    const auto& route = theState.query().waypoints;
+    if (route.size() != 2)
+      throw Fmi::Exception(
+          BCP, "Polyline cross-sections require gridded data and linear interpolation");
+    if (!theState.query().waypoint_times.empty())
+      throw Fmi::Exception(
+          BCP, "Trajectory cross-sections require gridded data and linear interpolation");
+
+    const auto& contourer = theState.getContourEngine();
+    auto qInfo = q->info();
+
+    if (!itsZParameter)
+      return contourer.crossection(*qInfo,
+                                   theOptions,
+                                   route.front().longitude,
+                                   route.front().latitude,
+                                   route.back().longitude,
+                                   route.back().latitude,
+                                   theState.query().steps);
+
+    // Establish z-parameter
+
+    auto zparam = SmartMet::TimeSeries::ParameterFactory::instance().parse(*itsZParameter);
+
+    return contourer.crossection(*qInfo,
+                                 zparam,
+                                 theOptions,
+                                 route.front().longitude,
+                                 route.front().latitude,
+                                 route.back().longitude,
+                                 route.back().latitude,
+                                 theState.query().steps);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The vertical grid to be contoured by the plugin
+ *
+ * Grid engine data is always contoured by the plugin. Querydata is
+ * sampled by the plugin when a sampling plan is available, otherwise
+ * the contour engine samples and contours it. An empty pointer is
+ * returned in the latter case.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr ContourGroup::verticalGrid(State& theState) const
+{
+  try
+  {
+    if (itsExpression)
+      return expressionGrid(theState);
+    if (theState.query().source && *theState.query().source == "grid")
+      return gridEngineData(theState);
+    if (itsEnsemble)
+      throw Fmi::Exception(BCP, "Ensemble layers require grid data");
+    return querydataGrid(theState);
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample querydata along the route
+ *
+ * Routes along grid rows or columns are always sampled by the plugin,
+ * the values are then extracted from the native grid points without
+ * interpolation. Polylines and trajectories are always sampled by the
+ * plugin, other routes only if enabled in the configuration. The grid
+ * is cached for the current timestep like grid engine data, and its
+ * columns in the plugin if the sample points are quantized.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr ContourGroup::querydataGrid(State& theState) const
+{
+  try
+  {
+    if (itsInterpolation != "linear")
+      return {};
+
+    const std::string cachekey = "querydata;" + itsParameter + ";" +
+                                 (itsZParameter ? *itsZParameter : "") + ";" +
+                                 (itsMultiplier ? Fmi::to_string(*itsMultiplier) : "") + ";" +
+                                 (itsOffset ? Fmi::to_string(*itsOffset) : "") +
+                                 (itsDirection ? ";direction" : "");
+    auto cached = theState.verticalGrid(cachekey);
+    if (cached)
+      return cached;
+
+    auto plan = theState.samplingPlan(itsGridRequired);
+    if (!plan)
+      return {};
+
+    auto param = SmartMet::TimeSeries::ParameterFactory::instance().parse(itsParameter);
+    std::optional<unsigned long> zparam;
+    if (itsZParameter)
+      zparam = SmartMet::TimeSeries::ParameterFactory::instance().parse(*itsZParameter).number();
+
+    theState.checkDeadline();
+
+    // Columns are shared with other requests only while the data is unchanged
+
+    auto* columns = theState.getColumnCache();
+    const auto& generation = theState.generation().id;
+    if (generation.empty())
+      columns = nullptr;
+    const auto columnkey = theState.query().producer + ";" + generation + ";" + cachekey;
+
+    // Along a trajectory each column has its own time
+
+    auto info = theState.producer()->info();
+    const auto& query = theState.query();
+    if (!query.waypoint_times.empty())
+    {
+      const auto& validtimes = *theState.producer()->validTimes();
+      const std::vector<Fmi::DateTime> datatimes(validtimes.begin(), validtimes.end());
+      const auto columntimes = trajectory_times(*plan, query.waypoints, query.waypoint_times);
+      auto grid = sample_trajectory_grid(*info,
+                                         *plan,
+                                         param.number(),
+                                         zparam,
+                                         datatimes,
+                                         columntimes,
+                                         itsMultiplier ? *itsMultiplier : 1.0,
+                                         itsOffset ? *itsOffset : 0.0,
+                                         columns,
+                                         columnkey,
+                                         itsDirection);
+      if (grid)
+        theState.verticalGrid(cachekey, grid);
+      return grid;
+    }
+
+    auto grid = sample_vertical_grid(*info,
+                                     *plan,
+                                     param.number(),
+                                     zparam,
+                                     NFmiMetTime(theState.time().utc_time()),
+                                     itsMultiplier ? *itsMultiplier : 1.0,
+                                     itsOffset ? *itsOffset : 0.0,
+                                     columns,
+                                     columnkey + ";" +
+                                         Fmi::to_iso_string(theState.time().utc_time()),
+                                     itsDirection);
+    if (grid)
+      theState.verticalGrid(cachekey, grid);
+    return grid;
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Evaluate a derived parameter
+ *
+ * The grids of the inputs are fetched or taken from the request cache,
+ * and the expression is evaluated over them in one pass. The vertical
+ * coordinates are those of the first input. Querydata inputs are always
+ * sampled by the plugin, since the contour engine cannot evaluate
+ * expressions. Expressions may refer to the direction of the route,
+ * for example to decompose winds into components along and across it.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr ContourGroup::expressionGrid(State& theState) const
+{
+  try
+  {
+    const std::string cachekey = "expression;" + itsParameter + ";" +
+                                 (itsZParameter ? *itsZParameter : "") + ";" +
+                                 (itsMultiplier ? Fmi::to_string(*itsMultiplier) : "") + ";" +
+                                 (itsOffset ? Fmi::to_string(*itsOffset) : "");
+    auto cached = theState.verticalGrid(cachekey);
+    if (cached)
+      return cached;
+
+    std::vector<VerticalGridPtr> grids;
+    std::vector<const std::vector<float>*> inputs;
+    for (std::size_t i = 0; i < itsInputs.size(); i++)
+    {
+      auto grid = itsInputs[i]->verticalGrid(theState);
+      if (!grid)
+        throw Fmi::Exception(BCP, "Expression input not available")
+            .addParameter("Parameter", itsExpression->parameters()[i]);
+      if (!grids.empty() &&
+          (grid->width != grids.front()->width || grid->height != grids.front()->height))
+        throw Fmi::Exception(BCP, "Expression inputs have different vertical grids")
+            .addParameter("Expression", itsParameter);
+      grids.push_back(grid);
+      inputs.push_back(&grid->values);
+    }
+
+    const auto& first = *grids.front();
+    std::vector<float> z(first.coordinates.size());
+    for (std::size_t i = 0; i < z.size(); i++)
+      z[i] = static_cast<float>(first.coordinates[i].y());
+
+    auto grid = std::make_shared<VerticalGrid>();
+    grid->width = first.width;
+    grid->height = first.height;
+    grid->coordinates = first.coordinates;
+    // The direction of the route is computed per column and broadcast to the levels
+
+    std::vector<float> azimuth;
+    if (itsExpression->usesAzimuth())
+      azimuth = column_azimuths(first, theState.query().waypoints);
+
+    grid->values = itsExpression->evaluate(inputs, z, azimuth);
+
+    if (itsMultiplier || itsOffset)
+    {
+      const auto multiplier = static_cast<float>(itsMultiplier ? *itsMultiplier : 1.0);
+      const auto offset = static_cast<float>(itsOffset ? *itsOffset : 0.0);
+      for (auto& value : grid->values)
+        if (value != ParamValueMissing)
+          value = multiplier * value + offset;
+    }
+
+    theState.verticalGrid(cachekey, grid);
+    return grid;
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The vertical grid of grid engine data
+ *
+ * The grid is cached for the current timestep so that isobands and
+ * isolines of the same parameter need only one fetch. The members of
+ * an ensemble are fetched in parallel, and the statistic computed
+ * from them is cached instead of the members.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr ContourGroup::gridEngineData(State& theState) const
+{
+  try
+  {
+    if (!itsZParameter)
+      throw Fmi::Exception(BCP, "Z-Parameter not set for grid layer");
+
+    std::string cachekey = itsParameter + ";" + *itsZParameter;
+    if (itsEnsemble)
+      cachekey += ";" + itsEnsemble->key();
+    if (itsDirection)
+      cachekey += ";direction";
+
+    auto cached = theState.verticalGrid(cachekey);
+    if (cached)
+      return cached;
+
+    const auto& generation = theState.generation().id;
+
+    VerticalGridPtr grid;
+    if (!itsEnsemble)
+      grid = gridEngineGrid(theState, generation, -1, -1);
+    else
+    {
+      const auto& members = itsEnsemble->members;
+      std::vector<VerticalGridPtr> grids(members.size());
+      run_parallel(theState.getThreadPool(),
+                   members.size(),
+                   theState.getConfig().ensembleThreads(),
+                   [&](std::size_t theIndex)
+                   {
+                     grids[theIndex] = gridEngineGrid(
+                         theState, generation, itsEnsemble->forecastType, members[theIndex]);
+                   });
+      grid = ensemble_statistic(grids, *itsEnsemble);
+      if (!grid)
+        throw Fmi::Exception(BCP, "Ensemble members not available")
+            .addParameter("Parameter", itsParameter);
+    }
+
+    theState.verticalGrid(cachekey, grid);
+    return grid;
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Fetch the vertical grid from the grid engine
+ *
+ * The grid is cached in the disk cache if enabled so that it survives
+ * restarts, provided the data did not change while it was fetched.
+ * The state is only read, hence the members of an ensemble can be
+ * fetched in parallel.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr ContourGroup::gridEngineGrid(const State& theState,
+                                             const std::string& theGeneration,
+                                             int theForecastType,
+                                             int theForecastNumber) const
+{
+  try
+  {
+    std::string cachekey = itsParameter + ";" + *itsZParameter;
+    if (theForecastType != -1 || theForecastNumber != -1)
+      cachekey += ";" + Fmi::to_string(theForecastType) + ":" + Fmi::to_string(theForecastNumber);
+    if (itsDirection)
+      cachekey += ";direction";
+
+    // Try the persistent cache, which is valid only for the current data
+
+    auto* diskcache = theState.getDiskCache();
+    const auto& generation = theGeneration;
+    std::string diskkey;
+    if (diskcache != nullptr && !generation.empty())
+    {
+      const auto& q = theState.query();
+      diskkey = "verticalgrid;" + q.producer + ";" + *q.zproducer + ";" + cachekey + ";" +
+                route_string(q.waypoints) + ";" + Fmi::to_string(q.steps) + ";" +
+                Fmi::to_iso_string(theState.time().utc_time());
+
+      auto entry = diskcache->find(diskkey, generation);
+      if (entry)
+      {
+        auto grid = deserialize_vertical_grid(entry->data);
+        if (grid)
+          return grid;
+      }
+    }
+
+    const auto& gridEngine = theState.getGridEngine();
+    if (!gridEngine.isEnabled())
+      throw Fmi::Exception(BCP, "The grid-engine is disabled!");
+
+    std::string pName = itsParameter;
+    bool raw = false;
+    auto pos = pName.find(".raw");
+    if (pos != std::string::npos)
+    {
+      raw = true;
+      pName.erase(pos, 4);
+    }
+
+    std::string key = theState.query().producer + ";" + pName;
+
+    Engine::Grid::ParameterDetails_vec parameterDetails;
+    gridEngine.getParameterDetails(theState.query().producer, pName, parameterDetails);
+
+    if (parameterDetails.size() != 1 || parameterDetails[0].mProducerName != key)
+    {
+      for (auto& rec : parameterDetails)
+      {
+        QueryServer::ParameterMapping_vec mappings;
+        get_parameter_mappings(gridEngine, rec, rec.mProducerName, mappings);
+
+        if (!mappings.empty())
+        {
+          Engine::Grid::MappingDetails details;
+          details.mMapping = mappings[0];
+          rec.mMappings.push_back(details);
+        }
+      }
+
+      if (parameterDetails.empty() || parameterDetails[0].mMappings.empty())
+      {
+        Fmi::Exception exception(BCP, "Parameter mappings not found");
+        exception.addParameter("Parameter", itsParameter);
+        exception.addParameter("Producer", theState.query().producer);
+        throw exception;
+      }
+    }
+
+    std::string zkey = *theState.query().zproducer + ";" + *itsZParameter;
+
+    Engine::Grid::ParameterDetails_vec zParameterDetails;
+    gridEngine.getParameterDetails(*theState.query().zproducer, *itsZParameter, zParameterDetails);
+
+    if (zParameterDetails.size() != 1 || zParameterDetails[0].mProducerName != zkey)
+    {
+      for (auto& rec : zParameterDetails)
+      {
+        std::string pn = rec.mProducerName;
+        if (pn == zkey)
+          pn = rec.mOriginalProducer;
+
+        QueryServer::ParameterMapping_vec mappings;
+        get_parameter_mappings(gridEngine, rec, pn, mappings);
+
+        if (!mappings.empty())
+        {
+          Engine::Grid::MappingDetails details;
+          details.mMapping = mappings[0];
+          rec.mMappings.push_back(details);
+        }
+      }
+
+      if (zParameterDetails.empty() || zParameterDetails[0].mMappings.empty())
+      {
+        Fmi::Exception exception(BCP, "Z-Parameter mappings not found");
+        exception.addParameter("Z-Parameter", *itsZParameter);
+        exception.addParameter("Producer", *theState.query().zproducer);
+        throw exception;
+      }
+    }
+
+    std::string valueProducerName = parameterDetails[0].mOriginalProducer;
+    std::string valueParameter = parameterDetails[0].mOriginalParameter;
+    int geometryId = -1;
+    short areaInterpolationMethod = T::AreaInterpolationMethod::Linear;
+    short timeInterpolationMethod = T::TimeInterpolationMethod::Linear;
+    std::string heightProducerName = zParameterDetails[0].mOriginalProducer;
+    std::string heightParameter = zParameterDetails[0].mOriginalParameter;
+
+    if (!parameterDetails[0].mMappings.empty())
+    {
+      const auto& mapping = parameterDetails[0].mMappings[0].mMapping;
+      valueProducerName = mapping.mProducerName;
+      valueParameter = mapping.mParameterName;
+      geometryId = mapping.mGeometryId;
+      if (raw)
+        areaInterpolationMethod = T::AreaInterpolationMethod::Linear;
+      else
+        areaInterpolationMethod = mapping.mAreaInterpolationMethod;
+
+      timeInterpolationMethod = mapping.mTimeInterpolationMethod;
+    }
+
+    // The grid engine cannot interpolate directions along the circle, the
+    // nearest values are used instead of averaging across north
+
+    if (itsDirection)
+    {
+      areaInterpolationMethod = T::AreaInterpolationMethod::Nearest;
+      timeInterpolationMethod = T::TimeInterpolationMethod::Nearest;
+    }
+
+    if (!zParameterDetails[0].mMappings.empty())
+    {
+      heightProducerName = zParameterDetails[0].mMappings[0].mMapping.mProducerName;
+      heightParameter = zParameterDetails[0].mMappings[0].mMapping.mParameterName;
+    }
+
+    theState.checkDeadline();
+
+    std::string utcTime = Fmi::to_iso_string(theState.time().utc_time());
+
+    auto grid = std::make_shared<VerticalGrid>();
+
+    // Polylines are sampled segment by segment and the segments are joined
+    // into a single grid so that the contours continue across the joints.
+
+    const auto& route = theState.query().waypoints;
+    const auto steps = segment_steps(route, theState.query().steps);
+
+    for (std::size_t s = 0; s < steps.size(); s++)
+    {
+      if (steps[s] == 0)
+        continue;
+
+      VerticalGrid segment;
+      gridEngine.getVerticalGrid(route[s].longitude,
+                                 route[s].latitude,
+                                 route[s + 1].longitude,
+                                 route[s + 1].latitude,
+                                 steps[s],
+                                 utcTime,
+                                 valueProducerName,
+                                 valueParameter,
+                                 heightProducerName,
+                                 heightParameter,
+                                 geometryId,
+                                 theForecastType,
+                                 theForecastNumber,
+                                 areaInterpolationMethod,
+                                 timeInterpolationMethod,
+                                 segment.coordinates,
+                                 segment.values,
+                                 segment.width,
+                                 segment.height);
+
+      if (grid->width == 0)
+      {
+        *grid = std::move(segment);
+        continue;
+      }
+
+      if (segment.width < 2)
+        continue;
+
+      if (segment.height != grid->height)
+        throw Fmi::Exception(BCP, "Route segments have a different number of levels");
+
+      // Skip the joint already in the grid and continue the distances from it
+
+      const double offset = grid->coordinates[grid->width - 1].x() - segment.coordinates[0].x();
+      const uint width = grid->width + segment.width - 1;
+
+      std::vector<float> values;
+      std::vector<T::Coordinate> coordinates;
+      values.reserve(width * grid->height);
+      coordinates.reserve(width * grid->height);
+
+      for (uint row = 0; row < grid->height; row++)
+      {
+        for (uint col = 0; col < grid->width; col++)
+        {
+          values.push_back(grid->values[row * grid->width + col]);
+          coordinates.push_back(grid->coordinates[row * grid->width + col]);
+        }
+        for (uint col = 1; col < segment.width; col++)
+        {
+          const auto& c = segment.coordinates[row * segment.width + col];
+          values.push_back(segment.values[row * segment.width + col]);
+          coordinates.emplace_back(c.x() + offset, c.y());
+        }
+      }
+
+      grid->values = std::move(values);
+      grid->coordinates = std::move(coordinates);
+      grid->width = width;
+    }
+
+    // The grid engine samples its latest data, do not store the grid if the
+    // data was replaced after the generation was determined
+
+    if (!diskkey.empty() && theState.latestGeneration().id == generation)
+    {
+      try
+      {
+        diskcache->insert(diskkey, generation, serialize_vertical_grid(*grid));
+      }
+      catch (...)
+      {
+        Fmi::Exception::Trace(BCP, "Failed to store the vertical grid in the disk cache")
+            .printError();
+      }
+    }
+
+    return grid;
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,124 @@
+// ======================================================================
+/*!
+ * \brief Contours of one data slice shared by several layers
+ *
+ * Layers which contour the same parameter with the same settings
+ * share a group so that the data is contoured only once per
+ * timestep. The group contours the union of the isoband limits and
+ * isoline values of its layers, and each layer picks its own
+ * contours from the results. Isolines whose values coincide with
+ * isoband limits are extracted from the isoband edges instead of
+ * contouring the data a second time.
+ *
+ * The group itself is part of the product definition and hence
+ * shared by all requests, the generated contours are cached in
+ * the request State.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Ensemble.h"
+#include "Expression.h"
+#include "Isoband.h"
+#include "Isoline.h"
+#include "VerticalGrid.h"
+#include <engines/contour/Engine.h>
+#include <engines/grid/Engine.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class State;
+
+class ContourGroup
+{
+ public:
+  ContourGroup(std::string theParameter,
+               std::optional<std::string> theZParameter,
+               std::string theInterpolation,
+               std::optional<double> theMultiplier,
+               std::optional<double> theOffset,
+               std::optional<Ensemble> theEnsemble = std::nullopt);
+
+  void addIsobands(const std::vector<Isoband>& theIsobands);
+  void addIsolines(const std::vector<Isoline>& theIsolines);
+
+  // Take over the contours of another group if it contours the same data
+  bool merge(const ContourGroup& theOther);
+
+  // Positions of the contours of a layer in the generated contours
+  std::size_t isobandIndex(const Isoband& theIsoband) const;
+  std::size_t isolineIndex(const Isoline& theIsoline) const;
+
+  // Generated contours for the current timestep
+  const std::vector<OGRGeometryPtr>& isobands(State& theState) const;
+  const std::vector<OGRGeometryPtr>& isolines(State& theState) const;
+
+  // Always sample querydata in the plugin, for layers which need the values
+  void requireGrid() { itsGridRequired = true; }
+
+  // Interpolate the values as directions in degrees, which wrap around at north
+  void requireDirection() { itsDirection = true; }
+
+  // The vertical grid for the current timestep, shared with other layers using
+  // the same data. Empty if the contour engine samples the data.
+  VerticalGridPtr verticalGrid(State& theState) const;
+
+ private:
+  using Limits = std::pair<std::optional<double>, std::optional<double>>;
+  using Edge = std::pair<std::size_t, std::size_t>;
+
+  bool sameSlice(const ContourGroup& theOther) const;
+  void addLimits(const Limits& theLimits);
+  void addIsovalue(double theValue);
+  void updateEdges();
+
+  std::vector<OGRGeometryPtr> generateIsobands(State& theState) const;
+  std::vector<OGRGeometryPtr> generateIsolines(State& theState,
+                                               const std::vector<double>& theValues) const;
+  std::vector<OGRGeometryPtr> deriveIsolines(const std::vector<OGRGeometryPtr>& theIsobands,
+                                             const std::vector<Edge>& theEdges) const;
+
+  std::vector<OGRGeometryPtr> qEngineContours(State& theState,
+                                              SmartMet::Engine::Contour::Options& theOptions) const;
+  VerticalGridPtr querydataGrid(State& theState) const;
+  VerticalGridPtr expressionGrid(State& theState) const;
+  VerticalGridPtr gridEngineData(State& theState) const;
+  VerticalGridPtr gridEngineGrid(const State& theState,
+                                 const std::string& theGeneration,
+                                 int theForecastType,
+                                 int theForecastNumber) const;
+
+  std::string itsParameter;
+  std::optional<std::string> itsZParameter;
+  std::string itsInterpolation;
+  std::optional<double> itsMultiplier;
+  std::optional<double> itsOffset;
+  std::optional<Ensemble> itsEnsemble;
+
+  // Derived parameters are evaluated from the grids of their inputs
+  std::shared_ptr<const Expression> itsExpression;
+  std::vector<std::shared_ptr<const ContourGroup>> itsInputs;
+  bool itsGridRequired = false;  // always sampled by the plugin, e.g. expression inputs
+  bool itsDirection = false;     // directions interpolated along the circle
+
+  // Union of the isoband limits and isoline values of all the layers
+  std::vector<Limits> itsLimits;
+  std::vector<double> itsIsovalues;
+
+  // For each isoline the pair of isobands whose edge it is, if any
+  std::vector<std::optional<Edge>> itsIsolineEdges;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,30 @@
+// ======================================================================
+/*!
+ * \brief Identification of the data a response is based on
+ *
+ * A new model run or a replaced data file changes the generation,
+ * which invalidates any responses generated from the old data.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <macgyver/DateTime.h>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+struct DataGeneration
+{
+  std::string id;  // empty if the generation cannot be determined
+  Fmi::DateTime originTime = Fmi::DateTime::NOT_A_DATE_TIME;
+  Fmi::DateTime modificationTime = Fmi::DateTime::NOT_A_DATE_TIME;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,34 @@
+// ======================================================================
+/*!
+ * \brief Request deadlines
+ *
+ * Requests may be given a deadline after which they are abandoned.
+ * The deadline is checked between timesteps, layers and engine calls
+ * so that overdue requests free their worker as soon as possible.
+ *
+ * The functions on the rendering path pass DeadlineExceeded through
+ * unchanged instead of wrapping it into a trace, so that the plugin
+ * can answer overdue requests with 504 by the type of the error.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class DeadlineExceeded : public std::runtime_error
+{
+ public:
+  explicit DeadlineExceeded(const std::string& theReason) : std::runtime_error(theReason) {}
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
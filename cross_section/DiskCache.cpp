@@ -0,0 +1,382 @@
+#include "DiskCache.h"
+#include "KeyHash.h"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+const char magic[] = "CSDC1\n";
+const std::size_t magic_size = sizeof(magic) - 1;
+
+void write_string(std::ostream& theOutput, const std::string& theString)
+{
+  const auto n = static_cast<std::uint64_t>(theString.size());
+  theOutput.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  theOutput.write(theString.data(), static_cast<std::streamsize>(theString.size()));
+}
+
+// Read a length prefixed string from a memory mapped file, returns false on overflow
+
+bool read_string(const char*& thePtr, const char* theEnd, std::string& theString)
+{
+  std::uint64_t n = 0;
+  if (theEnd - thePtr < static_cast<std::ptrdiff_t>(sizeof(n)))
+    return false;
+  std::memcpy(&n, thePtr, sizeof(n));
+  thePtr += sizeof(n);
+  if (static_cast<std::uint64_t>(theEnd - thePtr) < n)
+    return false;
+  theString.assign(thePtr, n);
+  thePtr += n;
+  return true;
+}
+
+// Cache files are named by the 16 hexadecimal digit hash of their key
+
+const std::size_t hash_size = 16;
+const std::string cache_suffix = ".bin";
+const std::string temporary_suffix = ".tmp";
+
+bool is_cache_file(const std::string& theName)
+{
+  return (theName.size() == hash_size + cache_suffix.size() &&
+          theName.compare(hash_size, std::string::npos, cache_suffix) == 0 &&
+          std::all_of(theName.begin(),
+                      theName.begin() + hash_size,
+                      [](unsigned char ch) { return std::isxdigit(ch) != 0; }));
+}
+
+// Temporary files are named <hash>.bin.<counter>.tmp
+
+bool is_temporary_file(const std::string& theName)
+{
+  const auto prefix = hash_size + cache_suffix.size();
+  if (theName.size() < prefix + 1 + 1 + temporary_suffix.size())
+    return false;
+  if (!is_cache_file(theName.substr(0, prefix)) || theName[prefix] != '.')
+    return false;
+
+  const auto end = theName.size() - temporary_suffix.size();
+  if (theName.compare(end, std::string::npos, temporary_suffix) != 0)
+    return false;
+
+  return std::all_of(theName.begin() + static_cast<std::ptrdiff_t>(prefix) + 1,
+                     theName.begin() + static_cast<std::ptrdiff_t>(end),
+                     [](unsigned char ch) { return std::isdigit(ch) != 0; });
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor scans the existing cache files
+ *
+ * Only files named like cache files are managed, anything else in the
+ * directory is left alone.
+ */
+// ----------------------------------------------------------------------
+
+DiskCache::DiskCache(std::filesystem::path theDirectory, std::size_t theMaxSize)
+    : itsDirectory(std::move(theDirectory)), itsMaxSize(theMaxSize)
+{
+  try
+  {
+    std::filesystem::create_directories(itsDirectory);
+
+    for (const auto& entry : std::filesystem::directory_iterator(itsDirectory))
+    {
+      if (!entry.is_regular_file())
+        continue;
+
+      const auto name = entry.path().filename().string();
+
+      // Remove leftovers of interrupted writes
+      if (is_temporary_file(name))
+      {
+        std::filesystem::remove(entry.path());
+        continue;
+      }
+
+      if (!is_cache_file(name))
+        continue;
+
+      FileInfo info;
+      info.size = entry.file_size();
+      info.used = entry.last_write_time();
+      itsFiles[entry.path()] = info;
+      itsSize += info.size;
+    }
+
+    evict();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Failed to initialize the disk cache")
+        .addParameter("Directory", itsDirectory.string());
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The file of a key
+ */
+// ----------------------------------------------------------------------
+
+std::filesystem::path DiskCache::filename(const std::string& theKey) const
+{
+  return itsDirectory / (key_hash(theKey) + cache_suffix);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find a valid entry
+ *
+ * Entries made from other data generations are not returned, but are
+ * left to be replaced by the next insert or to be evicted, since the
+ * file may already be replaced by a newer one. Corrupted files are
+ * removed unless they have been replaced meanwhile.
+ */
+// ----------------------------------------------------------------------
+
+std::optional<DiskCache::Entry> DiskCache::find(const std::string& theKey,
+                                                const std::string& theGeneration)
+{
+  try
+  {
+    const auto path = filename(theKey);
+
+    std::size_t version = 0;
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      auto it = itsFiles.find(path);
+      if (it == itsFiles.end())
+        return {};
+      version = it->second.version;
+    }
+
+    // The mapping stays valid even if the file is replaced or evicted meanwhile
+
+    boost::iostreams::mapped_file_source file;
+    try
+    {
+      file.open(path.string());
+    }
+    catch (...)
+    {
+      remove(path, version);
+      return {};
+    }
+
+    const char* ptr = file.data();
+    const char* end = ptr + file.size();
+
+    std::string key;
+    std::string generation;
+    Entry entry;
+    std::int64_t created = 0;
+
+    bool ok = (file.size() > magic_size && std::memcmp(ptr, magic, magic_size) == 0);
+    if (ok)
+    {
+      ptr += magic_size;
+      ok = (read_string(ptr, end, key) && read_string(ptr, end, generation) &&
+            end - ptr >= static_cast<std::ptrdiff_t>(sizeof(created)));
+    }
+    if (ok)
+    {
+      std::memcpy(&created, ptr, sizeof(created));
+      ptr += sizeof(created);
+      ok = read_string(ptr, end, entry.data);
+    }
+
+    // Hash collisions are possible in theory, hence the key is verified too
+
+    if (!ok || key != theKey)
+    {
+      remove(path, version);
+      return {};
+    }
+
+    if (generation != theGeneration)
+      return {};
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      auto it = itsFiles.find(path);
+      if (it != itsFiles.end())
+        it->second.used = std::filesystem::file_time_type::clock::now();
+    }
+
+    entry.created = static_cast<std::time_t>(created);
+    return entry;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Store an entry
+ *
+ * The file is written under a temporary name and renamed so that
+ * readers never see partially written files.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::insert(const std::string& theKey,
+                       const std::string& theGeneration,
+                       const std::string& theData)
+{
+  try
+  {
+    const auto path = filename(theKey);
+
+    std::filesystem::path tmppath;
+    std::size_t version = 0;
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      version = ++itsCounter;
+      tmppath = path;
+      tmppath += "." + std::to_string(version) + temporary_suffix;
+    }
+
+    {
+      std::ofstream out(tmppath, std::ios::out | std::ios::binary | std::ios::trunc);
+      if (!out)
+        throw Fmi::Exception(BCP, "Failed to open disk cache file for writing")
+            .addParameter("Path", tmppath.string());
+
+      const auto created = static_cast<std::int64_t>(std::time(nullptr));
+
+      out.write(magic, magic_size);
+      write_string(out, theKey);
+      write_string(out, theGeneration);
+      out.write(reinterpret_cast<const char*>(&created), sizeof(created));
+      write_string(out, theData);
+
+      if (!out)
+      {
+        out.close();
+        std::filesystem::remove(tmppath);
+        throw Fmi::Exception(BCP, "Failed to write disk cache file")
+            .addParameter("Path", tmppath.string());
+      }
+    }
+
+    const auto size = static_cast<std::size_t>(std::filesystem::file_size(tmppath));
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    std::filesystem::rename(tmppath, path);
+
+    auto& info = itsFiles[path];
+    itsSize -= info.size;
+    info.size = size;
+    info.used = std::filesystem::file_time_type::clock::now();
+    info.version = version;
+    itsSize += size;
+
+    evict();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove an invalid file
+ *
+ * The file is removed only if it has not been replaced by a concurrent
+ * insert since it was read.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::remove(const std::filesystem::path& thePath, std::size_t theVersion)
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  auto it = itsFiles.find(thePath);
+  if (it == itsFiles.end() || it->second.version != theVersion)
+    return;
+
+  std::error_code ec;
+  std::filesystem::remove(thePath, ec);
+  itsSize -= it->second.size;
+  itsFiles.erase(it);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove least recently used files until the cache fits its limit
+ *
+ * The files are sorted once by their last use, and removed until the
+ * size drops below 90% of the limit so that the cost of sorting is
+ * shared by several subsequent inserts. The lock must be held by the
+ * caller.
+ */
+// ----------------------------------------------------------------------
+
+void DiskCache::evict()
+{
+  if (itsSize <= itsMaxSize)
+    return;
+
+  using Iterator = decltype(itsFiles)::iterator;
+  std::vector<Iterator> files;
+  files.reserve(itsFiles.size());
+  for (auto it = itsFiles.begin(); it != itsFiles.end(); ++it)
+    files.push_back(it);
+
+  std::sort(files.begin(),
+            files.end(),
+            [](const Iterator& lhs, const Iterator& rhs)
+            { return lhs->second.used < rhs->second.used; });
+
+  const auto target = itsMaxSize / 10 * 9;
+
+  for (auto& oldest : files)
+  {
+    if (itsSize <= target)
+      break;
+
+    std::error_code ec;
+    std::filesystem::remove(oldest->first, ec);
+    if (ec)
+      std::cerr << "Warning: Failed to remove disk cache file " << oldest->first << ": "
+                << ec.message() << '\n';
+
+    itsSize -= oldest->second.size;
+    itsFiles.erase(oldest);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Total size of the cache files
+ */
+// ----------------------------------------------------------------------
+
+std::size_t DiskCache::size() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsSize;
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
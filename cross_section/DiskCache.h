@@ -0,0 +1,73 @@
+// ======================================================================
+/*!
+ * \brief Persistent second tier cache on local disk
+ *
+ * Entries are stored in files named by the hash of their key under the
+ * configured directory, and read back with memory mapping. Each file
+ * records the full key and the generation of the data the entry was
+ * made from. An entry is valid only if both match, so a restarted
+ * server comes back warm but never serves data older than what the
+ * engines currently have. The least recently used files are removed
+ * once the total size exceeds the limit.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class DiskCache
+{
+ public:
+  DiskCache(std::filesystem::path theDirectory, std::size_t theMaxSize);
+
+  struct Entry
+  {
+    std::string data;
+    std::time_t created = 0;
+  };
+
+  std::optional<Entry> find(const std::string& theKey, const std::string& theGeneration);
+
+  void insert(const std::string& theKey,
+              const std::string& theGeneration,
+              const std::string& theData);
+
+  // Total size of the cache files in bytes
+  std::size_t size() const;
+
+ private:
+  struct FileInfo
+  {
+    std::size_t size = 0;
+    std::filesystem::file_time_type used;
+    std::size_t version = 0;  // identifies the insert which wrote the file
+  };
+
+  std::filesystem::path filename(const std::string& theKey) const;
+  void remove(const std::filesystem::path& thePath, std::size_t theVersion);
+  void evict();
+
+  const std::filesystem::path itsDirectory;
+  const std::size_t itsMaxSize;
+
+  mutable std::mutex itsMutex;
+  std::map<std::filesystem::path, FileInfo> itsFiles;
+  std::size_t itsSize = 0;
+  std::size_t itsCounter = 0;  // for unique temporary file names
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,260 @@
+#include "Ensemble.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Percentile of sorted values with linear interpolation
+ */
+// ----------------------------------------------------------------------
+
+float percentile_of(const std::vector<float>& theValues, double thePercentile)
+{
+  const double pos = thePercentile / 100.0 * static_cast<double>(theValues.size() - 1);
+  const auto i = static_cast<std::size_t>(pos);
+  if (i + 1 >= theValues.size())
+    return theValues.back();
+  const auto f = static_cast<float>(pos - static_cast<double>(i));
+  return (1 - f) * theValues[i] + f * theValues[i + 1];
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Initialize from JSON
+ *
+ * The members are given either as a list of member numbers or as
+ * their count, in which case members 1...N are used.
+ */
+// ----------------------------------------------------------------------
+
+void Ensemble::init(const Json::Value& theJson)
+{
+  try
+  {
+    if (!theJson.isObject())
+      throw Fmi::Exception(BCP, "Ensemble JSON is not a JSON object");
+
+    const auto names = theJson.getMemberNames();
+    for (const auto& name : names)
+    {
+      const Json::Value& json = theJson[name];
+
+      if (name == "statistic")
+        statistic = json.asString();
+      else if (name == "percentile")
+        percentile = json.asDouble();
+      else if (name == "threshold")
+        threshold = json.asDouble();
+      else if (name == "below")
+        below = json.asBool();
+      else if (name == "forecast_type")
+        forecastType = json.asInt();
+      else if (name == "members")
+      {
+        members.clear();
+        if (json.isArray())
+        {
+          for (const auto& member : json)
+            members.push_back(member.asInt());
+        }
+        else
+        {
+          for (int i = 1; i <= json.asInt(); i++)
+            members.push_back(i);
+        }
+      }
+      else
+        throw Fmi::Exception(BCP, "Ensemble does not have a setting named '" + name + "'");
+    }
+
+    if (statistic != "mean" && statistic != "spread" && statistic != "min" && statistic != "max" &&
+        statistic != "median" && statistic != "percentile" && statistic != "probability")
+      throw Fmi::Exception(BCP, "Unknown ensemble statistic '" + statistic + "'");
+
+    if (percentile < 0 || percentile > 100)
+      throw Fmi::Exception(BCP, "Ensemble percentile must be in the range 0-100");
+
+    if (members.empty())
+      throw Fmi::Exception(BCP, "Ensemble members not set");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cache key of the derived field
+ */
+// ----------------------------------------------------------------------
+
+std::string Ensemble::key() const
+{
+  try
+  {
+    std::string ret = statistic;
+    if (statistic == "percentile")
+      ret += ':' + Fmi::to_string(percentile);
+    else if (statistic == "probability")
+      ret += (below ? ":<" : ":>") + Fmi::to_string(threshold);
+    ret += ';' + Fmi::to_string(forecastType) + ':';
+    for (std::size_t i = 0; i < members.size(); i++)
+    {
+      if (i > 0)
+        ret += ',';
+      ret += Fmi::to_string(members[i]);
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the settings produce the same field
+ */
+// ----------------------------------------------------------------------
+
+bool Ensemble::operator==(const Ensemble& theOther) const
+{
+  return (statistic == theOther.statistic && percentile == theOther.percentile &&
+          threshold == theOther.threshold && below == theOther.below &&
+          forecastType == theOther.forecastType && members == theOther.members);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compute the statistic over the members
+ *
+ * The moments, extremes and exceedance counts are accumulated member
+ * by member in one pass over the grids. Percentiles need the values
+ * of all members at each point, and are computed point by point.
+ * Probabilities are in percent.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr ensemble_statistic(const std::vector<VerticalGridPtr>& theMembers,
+                                   const Ensemble& theEnsemble)
+{
+  try
+  {
+    std::vector<const VerticalGrid*> members;
+    for (const auto& member : theMembers)
+      if (member && member->width > 0 && member->height > 0)
+        members.push_back(member.get());
+
+    if (members.empty())
+      return {};
+
+    const auto& first = *members.front();
+    const std::size_t n = first.values.size();
+    for (const auto* member : members)
+    {
+      if (member->width != first.width || member->height != first.height)
+        throw Fmi::Exception(BCP, "Ensemble members have different vertical grids");
+    }
+
+    auto grid = std::make_shared<VerticalGrid>();
+    grid->width = first.width;
+    grid->height = first.height;
+    grid->values.resize(n, ParamValueMissing);
+    grid->coordinates = first.coordinates;
+
+    // Accumulate over the members
+
+    std::vector<float> count(n, 0);
+    std::vector<double> sum(n, 0);
+    std::vector<double> sum2(n, 0);
+    std::vector<float> hits(n, 0);
+    std::vector<float> minimum(n, std::numeric_limits<float>::max());
+    std::vector<float> maximum(n, std::numeric_limits<float>::lowest());
+    std::vector<double> heights(n, 0);
+
+    for (const auto* member : members)
+    {
+      const auto* values = member->values.data();
+      for (std::size_t i = 0; i < n; i++)
+      {
+        const float value = values[i];
+        const bool ok = (value != ParamValueMissing);
+        const double v = (ok ? value : 0.0);
+        count[i] += (ok ? 1.0F : 0.0F);
+        sum[i] += v;
+        sum2[i] += v * v;
+        minimum[i] = (ok ? std::min(minimum[i], value) : minimum[i]);
+        maximum[i] = (ok ? std::max(maximum[i], value) : maximum[i]);
+        const bool hit = (theEnsemble.below ? value < theEnsemble.threshold
+                                            : value > theEnsemble.threshold);
+        hits[i] += (ok && hit ? 1.0F : 0.0F);
+      }
+      for (std::size_t i = 0; i < n; i++)
+        heights[i] += member->coordinates[i].y();
+    }
+
+    const auto& statistic = theEnsemble.statistic;
+    const bool percentiles = (statistic == "median" || statistic == "percentile");
+    const double percentile = (statistic == "median" ? 50.0 : theEnsemble.percentile);
+
+    std::vector<float> stack;
+    stack.reserve(members.size());
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+      grid->coordinates[i] = T::Coordinate(first.coordinates[i].x(),
+                                           heights[i] / static_cast<double>(members.size()));
+      if (count[i] == 0)
+        continue;
+
+      if (statistic == "mean")
+        grid->values[i] = static_cast<float>(sum[i] / count[i]);
+      else if (statistic == "spread")
+      {
+        const double mean = sum[i] / count[i];
+        grid->values[i] =
+            static_cast<float>(std::sqrt(std::max(0.0, sum2[i] / count[i] - mean * mean)));
+      }
+      else if (statistic == "min")
+        grid->values[i] = minimum[i];
+      else if (statistic == "max")
+        grid->values[i] = maximum[i];
+      else if (statistic == "probability")
+        grid->values[i] = 100 * hits[i] / count[i];
+      else if (percentiles)
+      {
+        stack.clear();
+        for (const auto* member : members)
+          if (member->values[i] != ParamValueMissing)
+            stack.push_back(member->values[i]);
+        std::sort(stack.begin(), stack.end());
+        grid->values[i] = percentile_of(stack, percentile);
+      }
+    }
+
+    return grid;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
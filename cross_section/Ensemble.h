@@ -0,0 +1,50 @@
+// ======================================================================
+/*!
+ * \brief Statistics of ensemble members
+ *
+ * An ensemble layer fetches the vertical grids of all listed members
+ * of an ensemble forecast for the current time and contours a
+ * statistic computed over the member stack instead of a single
+ * member: the mean, spread, minimum, maximum, a percentile or the
+ * probability of exceeding a threshold.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "VerticalGrid.h"
+#include <json/json.h>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+struct Ensemble
+{
+  void init(const Json::Value& theJson);
+
+  // Identifies the derived field in cache keys
+  std::string key() const;
+
+  bool operator==(const Ensemble& theOther) const;
+
+  std::string statistic = "mean";  // mean|spread|min|max|median|percentile|probability
+  double percentile = 50;           // for percentile
+  double threshold = 0;             // for probability
+  bool below = false;               // probability of values below the threshold
+  int forecastType = 3;             // perturbed members
+  std::vector<int> members;
+};
+
+// Compute the statistic over the member grids. Missing values of members are
+// ignored, and the vertical coordinates are averaged over the members.
+VerticalGridPtr ensemble_statistic(const std::vector<VerticalGridPtr>& theMembers,
+                                   const Ensemble& theEnsemble);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,457 @@
+#include "Expression.h"
+#include <grid-files/common/GeneralDefinitions.h>
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <map>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+const float deg2rad = static_cast<float>(M_PI / 180.0);
+const float rad2deg = static_cast<float>(180.0 / M_PI);
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Recursive descent parser producing a stack program
+ */
+// ----------------------------------------------------------------------
+
+class Expression::Parser
+{
+ public:
+  Parser(const std::string& theText, Expression& theExpression)
+      : itsText(theText), itsExpression(theExpression)
+  {
+  }
+
+  void parse()
+  {
+    expression();
+    skipSpace();
+    if (itsPos != itsText.size())
+      error("Unexpected character");
+  }
+
+ private:
+  [[noreturn]] void error(const std::string& theMessage) const
+  {
+    throw Fmi::Exception(BCP, theMessage)
+        .addParameter("Expression", itsText)
+        .addParameter("Position", std::to_string(itsPos));
+  }
+
+  void skipSpace()
+  {
+    while (itsPos < itsText.size() && std::isspace(static_cast<unsigned char>(itsText[itsPos])))
+      ++itsPos;
+  }
+
+  bool accept(char theChar)
+  {
+    skipSpace();
+    if (itsPos < itsText.size() && itsText[itsPos] == theChar)
+    {
+      ++itsPos;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char theChar)
+  {
+    if (!accept(theChar))
+      error(std::string("Expected '") + theChar + "'");
+  }
+
+  void emit(Op theOp) { itsExpression.itsProgram.push_back(Instruction{theOp}); }
+
+  // expression := term (('+'|'-') term)*
+  void expression()
+  {
+    term();
+    while (true)
+    {
+      if (accept('+'))
+      {
+        term();
+        emit(Op::Add);
+      }
+      else if (accept('-'))
+      {
+        term();
+        emit(Op::Subtract);
+      }
+      else
+        break;
+    }
+  }
+
+  // term := unary (('*'|'/') unary)*
+  void term()
+  {
+    unary();
+    while (true)
+    {
+      if (accept('*'))
+      {
+        unary();
+        emit(Op::Multiply);
+      }
+      else if (accept('/'))
+      {
+        unary();
+        emit(Op::Divide);
+      }
+      else
+        break;
+    }
+  }
+
+  // unary := ('-'|'+') unary | power
+  void unary()
+  {
+    if (accept('-'))
+    {
+      unary();
+      emit(Op::Negate);
+    }
+    else if (accept('+'))
+      unary();
+    else
+      power();
+  }
+
+  // power := primary ('^' unary)?, right associative
+  void power()
+  {
+    primary();
+    if (accept('^'))
+    {
+      unary();
+      emit(Op::Power);
+    }
+  }
+
+  // primary := number | name | function '(' arguments ')' | '(' expression ')' | '{' name '}'
+  void primary()
+  {
+    skipSpace();
+    if (itsPos >= itsText.size())
+      error("Unexpected end of expression");
+
+    const char ch = itsText[itsPos];
+
+    if (accept('('))
+    {
+      expression();
+      expect(')');
+      return;
+    }
+
+    if (accept('{'))
+    {
+      const auto end = itsText.find('}', itsPos);
+      if (end == std::string::npos || end == itsPos)
+        error("Invalid parameter name in braces");
+      parameter(itsText.substr(itsPos, end - itsPos));
+      itsPos = end + 1;
+      return;
+    }
+
+    if (std::isdigit(static_cast<unsigned char>(ch)) || ch == '.')
+    {
+      std::size_t length = 0;
+      double value = 0;
+      try
+      {
+        value = std::stod(itsText.substr(itsPos), &length);
+      }
+      catch (...)
+      {
+        error("Invalid number");
+      }
+      itsPos += length;
+      Instruction instruction{Op::Number};
+      instruction.number = static_cast<float>(value);
+      itsExpression.itsProgram.push_back(instruction);
+      return;
+    }
+
+    if (std::isalpha(static_cast<unsigned char>(ch)) || ch == '_')
+    {
+      const auto start = itsPos;
+      while (itsPos < itsText.size() &&
+             (std::isalnum(static_cast<unsigned char>(itsText[itsPos])) ||
+              itsText[itsPos] == '_' || itsText[itsPos] == '.'))
+        ++itsPos;
+      const auto name = itsText.substr(start, itsPos - start);
+
+      if (accept('('))
+        function(name);
+      else if (name == "z")
+        emit(Op::Z);
+      else if (name == "azimuth")
+        emit(Op::Azimuth);
+      else
+        parameter(name);
+      return;
+    }
+
+    error("Unexpected character");
+  }
+
+  void function(const std::string& theName)
+  {
+    static const std::map<std::string, std::pair<Op, int>> functions{
+        {"abs", {Op::Abs, 1}},
+        {"sqrt", {Op::Sqrt, 1}},
+        {"exp", {Op::Exp, 1}},
+        {"log", {Op::Log, 1}},
+        {"log10", {Op::Log10, 1}},
+        {"sin", {Op::Sin, 1}},
+        {"cos", {Op::Cos, 1}},
+        {"tan", {Op::Tan, 1}},
+        {"atan", {Op::Atan, 1}},
+        {"atan2", {Op::Atan2, 2}},
+        {"pow", {Op::Power, 2}},
+        {"min", {Op::Min, 2}},
+        {"max", {Op::Max, 2}}};
+
+    auto it = functions.find(theName);
+    if (it == functions.end())
+      error("Unknown function '" + theName + "'");
+
+    for (int i = 0; i < it->second.second; i++)
+    {
+      if (i > 0)
+        expect(',');
+      expression();
+    }
+    expect(')');
+    emit(it->second.first);
+  }
+
+  void parameter(const std::string& theName)
+  {
+    auto& parameters = itsExpression.itsParameters;
+    auto it = std::find(parameters.begin(), parameters.end(), theName);
+    Instruction instruction{Op::Parameter};
+    instruction.index = static_cast<std::size_t>(it - parameters.begin());
+    if (it == parameters.end())
+      parameters.push_back(theName);
+    itsExpression.itsProgram.push_back(instruction);
+  }
+
+  const std::string& itsText;
+  Expression& itsExpression;
+  std::size_t itsPos = 0;
+};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compile an expression
+ *
+ * The leading '=' marking the parameter setting as an expression is
+ * optional.
+ */
+// ----------------------------------------------------------------------
+
+Expression::Expression(const std::string& theText)
+{
+  try
+  {
+    const std::string text = (isExpression(theText) ? theText.substr(1) : theText);
+    Parser parser(text, *this);
+    parser.parse();
+
+    if (itsParameters.empty())
+      throw Fmi::Exception(BCP, "Expression does not refer to any parameters")
+          .addParameter("Expression", theText);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether a parameter setting is an expression
+ */
+// ----------------------------------------------------------------------
+
+bool Expression::isExpression(const std::string& theParameter)
+{
+  return (!theParameter.empty() && theParameter[0] == '=');
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the expression depends on the direction of the route
+ */
+// ----------------------------------------------------------------------
+
+bool Expression::usesAzimuth() const
+{
+  return std::any_of(itsProgram.begin(),
+                     itsProgram.end(),
+                     [](const Instruction& theInstruction)
+                     { return theInstruction.op == Op::Azimuth; });
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Evaluate the expression at all points
+ *
+ * Each instruction processes all points before the next one, so the
+ * loops are simple and vectorizable. Points where an input is missing
+ * or the result is not finite are marked missing.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<float> Expression::evaluate(const std::vector<const std::vector<float>*>& theInputs,
+                                        const std::vector<float>& theZ,
+                                        const std::vector<float>& theAzimuth) const
+{
+  try
+  {
+    if (theInputs.size() != itsParameters.size())
+      throw Fmi::Exception(BCP, "Expression got a wrong number of inputs");
+
+    const std::size_t n = theZ.size();
+    for (const auto* input : theInputs)
+      if (input == nullptr || input->size() != n)
+        throw Fmi::Exception(BCP, "Expression inputs have different sizes");
+
+    if (usesAzimuth() && theAzimuth.size() != n)
+      throw Fmi::Exception(BCP, "Route azimuths not available for the expression");
+
+    std::vector<std::vector<float>> stack;
+
+    auto unary = [&](auto theFunction)
+    {
+      auto& a = stack.back();
+      for (std::size_t i = 0; i < n; i++)
+        a[i] = theFunction(a[i]);
+    };
+
+    auto binary = [&](auto theFunction)
+    {
+      auto b = std::move(stack.back());
+      stack.pop_back();
+      auto& a = stack.back();
+      for (std::size_t i = 0; i < n; i++)
+        a[i] = theFunction(a[i], b[i]);
+    };
+
+    for (const auto& instruction : itsProgram)
+    {
+      switch (instruction.op)
+      {
+        case Op::Number:
+          stack.emplace_back(n, instruction.number);
+          break;
+        case Op::Parameter:
+          stack.push_back(*theInputs[instruction.index]);
+          break;
+        case Op::Z:
+          stack.push_back(theZ);
+          break;
+        case Op::Azimuth:
+          stack.push_back(theAzimuth);
+          break;
+        case Op::Negate:
+          unary([](float a) { return -a; });
+          break;
+        case Op::Add:
+          binary([](float a, float b) { return a + b; });
+          break;
+        case Op::Subtract:
+          binary([](float a, float b) { return a - b; });
+          break;
+        case Op::Multiply:
+          binary([](float a, float b) { return a * b; });
+          break;
+        case Op::Divide:
+          binary([](float a, float b) { return a / b; });
+          break;
+        case Op::Power:
+          binary([](float a, float b) { return std::pow(a, b); });
+          break;
+        case Op::Abs:
+          unary([](float a) { return std::abs(a); });
+          break;
+        case Op::Sqrt:
+          unary([](float a) { return std::sqrt(a); });
+          break;
+        case Op::Exp:
+          unary([](float a) { return std::exp(a); });
+          break;
+        case Op::Log:
+          unary([](float a) { return std::log(a); });
+          break;
+        case Op::Log10:
+          unary([](float a) { return std::log10(a); });
+          break;
+        case Op::Sin:
+          unary([](float a) { return std::sin(deg2rad * a); });
+          break;
+        case Op::Cos:
+          unary([](float a) { return std::cos(deg2rad * a); });
+          break;
+        case Op::Tan:
+          unary([](float a) { return std::tan(deg2rad * a); });
+          break;
+        case Op::Atan:
+          unary([](float a) { return rad2deg * std::atan(a); });
+          break;
+        case Op::Atan2:
+          binary([](float a, float b) { return rad2deg * std::atan2(a, b); });
+          break;
+        case Op::Min:
+          binary([](float a, float b) { return std::min(a, b); });
+          break;
+        case Op::Max:
+          binary([](float a, float b) { return std::max(a, b); });
+          break;
+      }
+    }
+
+    if (stack.size() != 1)
+      throw Fmi::Exception(BCP, "Invalid expression program");
+
+    auto result = std::move(stack.back());
+
+    // Missing inputs propagate to the result
+
+    for (std::size_t i = 0; i < n; i++)
+      if (!std::isfinite(result[i]))
+        result[i] = ParamValueMissing;
+
+    for (const auto* input : theInputs)
+    {
+      const auto& values = *input;
+      for (std::size_t i = 0; i < n; i++)
+        if (values[i] == ParamValueMissing)
+          result[i] = ParamValueMissing;
+    }
+
+    return result;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
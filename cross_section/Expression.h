@@ -0,0 +1,98 @@
+// ======================================================================
+/*!
+ * \brief Arithmetic expressions of parameters
+ *
+ * Layers may contour fields derived from stored parameters, for
+ * example "=sqrt(WindUMS^2 + WindVMS^2)". The expression is compiled
+ * once when the product is read into a program which is then run over
+ * whole vertical grids at a time.
+ *
+ * Syntax:
+ *
+ *  - numbers, parameter names and z, the vertical coordinate
+ *  - azimuth, the direction of the route at each point in degrees
+ *    clockwise from north
+ *  - names with other characters than letters, digits, '_' and '.'
+ *    are written in braces, for example {T-K}
+ *  - operators + - * / ^ and parentheses
+ *  - functions abs, sqrt, exp, log, log10, sin, cos, tan, atan,
+ *    atan2, pow, min and max, angles in degrees
+ */
+// ======================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class Expression
+{
+ public:
+  // Compile the expression, throws on syntax errors
+  explicit Expression(const std::string& theText);
+
+  // True if the parameter setting of a layer is an expression
+  static bool isExpression(const std::string& theParameter);
+
+  // The parameters in the order expected by evaluate
+  const std::vector<std::string>& parameters() const { return itsParameters; }
+
+  // True if the expression depends on the direction of the route
+  bool usesAzimuth() const;
+
+  // Evaluate at all points. The result is missing where any input is. The
+  // azimuths are needed only if the expression uses them.
+  std::vector<float> evaluate(const std::vector<const std::vector<float>*>& theInputs,
+                              const std::vector<float>& theZ,
+                              const std::vector<float>& theAzimuth = {}) const;
+
+ private:
+  enum class Op
+  {
+    Number,
+    Parameter,
+    Z,
+    Azimuth,
+    Negate,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Abs,
+    Sqrt,
+    Exp,
+    Log,
+    Log10,
+    Sin,
+    Cos,
+    Tan,
+    Atan,
+    Atan2,
+    Min,
+    Max
+  };
+
+  struct Instruction
+  {
+    Op op;
+    float number = 0;
+    std::size_t index = 0;
+  };
+
+  class Parser;
+
+  std::vector<Instruction> itsProgram;
+  std::vector<std::string> itsParameters;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
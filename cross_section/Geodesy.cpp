@@ -0,0 +1,321 @@
+#include "Geodesy.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+double torad(double theValue)
+{
+  return theValue * 3.14159265358979323846 / 180.0;
+}
+
+// Initial bearing from point 1 towards point 2 in radians
+double bearing(double theLon1, double theLat1, double theLon2, double theLat2)
+{
+  const double la1 = torad(theLat1);
+  const double la2 = torad(theLat2);
+  const double dlon = torad(theLon2 - theLon1);
+  return atan2(sin(dlon) * cos(la2), cos(la1) * sin(la2) - sin(la1) * cos(la2) * cos(dlon));
+}
+
+const double earth_radius = 6371.220;  // kilometers
+}  // namespace
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Distance between two points along earth surface
+ *
+ * \param theLon1 Longitude of point 1
+ * \param theLat1 Latitude of point 1
+ * \param theLon2 Longitude of point 2
+ * \param theLat2 Latitude of point 2
+ * \return The distance in kilometers
+ *
+ *  Haversine Formula (from R.W. Sinnott, "Virtues of the Haversine",
+ *  Sky and Telescope, vol. 68, no. 2, 1984, p. 159)
+ *  will give mathematically and computationally exact results. The
+ *  intermediate result c is the great circle distance in radians. The
+ *  great circle distance d will be in the same units as R.
+ *
+ *  When the two points are antipodal (on opposite sides of the Earth),
+ *  the Haversine Formula is ill-conditioned, but the error, perhaps
+ *  as large as 2 km (1 mi), is in the context of a distance near
+ *  20,000 km (12,000 mi). Further, there is a possibility that roundoff
+ *  errors might cause the value of sqrt(a) to exceed 1.0, which would
+ *  cause the inverse sine to crash without the bulletproofing provided by
+ *  the min() function.
+ *
+ * The code was taken from NFmiLocation::Distance
+ */
+// ----------------------------------------------------------------------
+
+double geodistance(double theLon1, double theLat1, double theLon2, double theLat2)
+{
+  double lo1 = torad(theLon1);
+  double la1 = torad(theLat1);
+
+  double lo2 = torad(theLon2);
+  double la2 = torad(theLat2);
+
+  double dlon = lo2 - lo1;
+  double dlat = la2 - la1;
+  double sindlat = sin(dlat / 2);
+  double sindlon = sin(dlon / 2);
+
+  double a = sindlat * sindlat + cos(la1) * cos(la2) * sindlon * sindlon;
+  double help1 = sqrt(a);
+  double c = 2. * asin(std::min(1., help1));
+
+  return earth_radius * c;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Point at a fraction of the great circle route between two points
+ *
+ * \return The longitude and latitude of the point
+ */
+// ----------------------------------------------------------------------
+
+std::pair<double, double> intermediate_point(
+    double theLon1, double theLat1, double theLon2, double theLat2, double theFraction)
+{
+  const double d = geodistance(theLon1, theLat1, theLon2, theLat2) / earth_radius;
+  if (d == 0)
+    return {theLon1, theLat1};
+
+  const double lo1 = torad(theLon1);
+  const double la1 = torad(theLat1);
+  const double lo2 = torad(theLon2);
+  const double la2 = torad(theLat2);
+
+  const double a = sin((1 - theFraction) * d) / sin(d);
+  const double b = sin(theFraction * d) / sin(d);
+  const double x = a * cos(la1) * cos(lo1) + b * cos(la2) * cos(lo2);
+  const double y = a * cos(la1) * sin(lo1) + b * cos(la2) * sin(lo2);
+  const double z = a * sin(la1) + b * sin(la2);
+
+  const double todeg = 180.0 / 3.14159265358979323846;
+  return {atan2(y, x) * todeg, atan2(z, sqrt(x * x + y * y)) * todeg};
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Distance of a point from the great circle through two points
+ *
+ * \return The absolute cross track distance in kilometers
+ */
+// ----------------------------------------------------------------------
+
+double crosstrack_distance(double theLon1,
+                           double theLat1,
+                           double theLon2,
+                           double theLat2,
+                           double theLon,
+                           double theLat)
+{
+  const double d13 = geodistance(theLon1, theLat1, theLon, theLat) / earth_radius;
+  const double b13 = bearing(theLon1, theLat1, theLon, theLat);
+  const double b12 = bearing(theLon1, theLat1, theLon2, theLat2);
+  return std::abs(asin(std::max(-1., std::min(1., sin(d13) * sin(b13 - b12))))) * earth_radius;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Length of a polyline route
+ *
+ * \return The sum of the great circle distances of the segments in kilometers
+ */
+// ----------------------------------------------------------------------
+
+double route_length(const Waypoints& theWaypoints)
+{
+  double length = 0;
+  for (std::size_t i = 1; i < theWaypoints.size(); i++)
+    length += geodistance(theWaypoints[i - 1].longitude,
+                          theWaypoints[i - 1].latitude,
+                          theWaypoints[i].longitude,
+                          theWaypoints[i].latitude);
+  return length;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Direction of a route at distances from its start
+ *
+ * The direction is the great circle azimuth towards the end of the
+ * segment containing the point, and at the end of a segment the
+ * direction of arrival. Distances beyond the ends of the route are
+ * clamped to them.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<double> route_azimuths(const Waypoints& theWaypoints,
+                                   const std::vector<double>& theDistances)
+{
+  try
+  {
+    if (theWaypoints.size() < 2)
+      throw Fmi::Exception(BCP, "At least two locations are required for route azimuths");
+
+    const double todeg = 180.0 / 3.14159265358979323846;
+
+    std::vector<double> ret;
+    ret.reserve(theDistances.size());
+
+    std::size_t segment = 1;
+    double start = 0;  // distance to the start of the current segment
+
+    for (const double distance : theDistances)
+    {
+      // The distances are normally increasing, hence the segment is searched forward.
+      // Empty segments have no direction and are skipped.
+      if (distance < start)
+      {
+        segment = 1;
+        start = 0;
+      }
+
+      double length = 0;
+      while (true)
+      {
+        const auto& p1 = theWaypoints[segment - 1];
+        const auto& p2 = theWaypoints[segment];
+        length = geodistance(p1.longitude, p1.latitude, p2.longitude, p2.latitude);
+        if ((length > 0 && distance <= start + length) || segment + 1 == theWaypoints.size())
+          break;
+        start += length;
+        ++segment;
+      }
+
+      const auto& p1 = theWaypoints[segment - 1];
+      const auto& p2 = theWaypoints[segment];
+      const double fraction = (length > 0 ? std::min(1.0, (distance - start) / length) : 0.0);
+
+      double azimuth = 0;
+      if (fraction < 1)
+      {
+        const auto p = intermediate_point(
+            p1.longitude, p1.latitude, p2.longitude, p2.latitude, std::max(0.0, fraction));
+        azimuth = bearing(p.first, p.second, p2.longitude, p2.latitude) * todeg;
+      }
+      else
+        azimuth = bearing(p2.longitude, p2.latitude, p1.longitude, p1.latitude) * todeg + 180.0;
+
+      azimuth = std::fmod(azimuth + 720.0, 360.0);
+      ret.push_back(azimuth);
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Distribute the steps of a route to its segments
+ *
+ * Each segment of nonzero length gets at least one step, hence the
+ * total may differ slightly from the requested number of steps. A
+ * route with a single segment gets exactly the requested steps.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<std::size_t> segment_steps(const Waypoints& theWaypoints, std::size_t theSteps)
+{
+  try
+  {
+    std::vector<std::size_t> steps;
+    if (theWaypoints.size() < 2)
+      return steps;
+
+    const double length = route_length(theWaypoints);
+    for (std::size_t i = 1; i < theWaypoints.size(); i++)
+    {
+      const double segment = geodistance(theWaypoints[i - 1].longitude,
+                                         theWaypoints[i - 1].latitude,
+                                         theWaypoints[i].longitude,
+                                         theWaypoints[i].latitude);
+      if (segment <= 0)
+        steps.push_back(0);
+      else if (theWaypoints.size() == 2)
+        steps.push_back(theSteps);
+      else
+        steps.push_back(std::max<std::size_t>(
+            1, static_cast<std::size_t>(std::lround(theSteps * segment / length))));
+    }
+    return steps;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Canonical text form of a route
+ */
+// ----------------------------------------------------------------------
+
+std::string route_string(const Waypoints& theWaypoints)
+{
+  std::string ret;
+  for (const auto& point : theWaypoints)
+  {
+    if (!ret.empty())
+      ret += ';';
+    ret += Fmi::to_string(point.longitude);
+    ret += ',';
+    ret += Fmi::to_string(point.latitude);
+  }
+  return ret;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Number of steps matching the resolution of the data
+ *
+ * \param theDistance Length of the route in kilometers
+ * \param theSpacing Grid spacing of the data in kilometers
+ * \param theOversampling Samples per grid interval
+ * \param theMaxSteps Upper limit for the result
+ * \return The number of steps, at least two
+ */
+// ----------------------------------------------------------------------
+
+std::size_t auto_steps(double theDistance,
+                       double theSpacing,
+                       double theOversampling,
+                       std::size_t theMaxSteps)
+{
+  try
+  {
+    if (theSpacing <= 0 || theOversampling <= 0)
+      throw Fmi::Exception(BCP, "Grid spacing and oversampling must be positive");
+
+    const double steps = std::ceil(theOversampling * theDistance / theSpacing);
+    if (!(steps < static_cast<double>(theMaxSteps)))
+      return std::max<std::size_t>(theMaxSteps, 2);
+    return std::max<std::size_t>(static_cast<std::size_t>(steps), 2);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,65 @@
+// ======================================================================
+/*!
+ * \brief Geodetic utilities for cross-section routes
+ */
+// ======================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+struct Waypoint
+{
+  double longitude = 0;
+  double latitude = 0;
+};
+
+// The route of a cross-section, at least two points
+using Waypoints = std::vector<Waypoint>;
+
+// Great circle distance between two points in kilometers
+double geodistance(double theLon1, double theLat1, double theLon2, double theLat2);
+
+// Point at a fraction of the great circle route between two points
+std::pair<double, double> intermediate_point(
+    double theLon1, double theLat1, double theLon2, double theLat2, double theFraction);
+
+// Distance of a point from the great circle through two points in kilometers
+double crosstrack_distance(double theLon1,
+                           double theLat1,
+                           double theLon2,
+                           double theLat2,
+                           double theLon,
+                           double theLat);
+
+// Length of a polyline route in kilometers
+double route_length(const Waypoints& theWaypoints);
+
+// Direction of a route at the given distances from its start, degrees clockwise from north
+std::vector<double> route_azimuths(const Waypoints& theWaypoints,
+                                   const std::vector<double>& theDistances);
+
+// Steps of each segment of a route in proportion to its length, zero for empty segments
+std::vector<std::size_t> segment_steps(const Waypoints& theWaypoints, std::size_t theSteps);
+
+// Canonical text form of a route for cache keys
+std::string route_string(const Waypoints& theWaypoints);
+
+// Number of steps matching the grid spacing of the data
+std::size_t auto_steps(double theDistance,
+                       double theSpacing,
+                       double theOversampling,
+                       std::size_t theMaxSteps);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -6,8 +6,10 @@
 
 #pragma once
 
+#include "ContourGroup.h"
 #include "Isoband.h"
 #include "Layer.h"
+#include <memory>
 #include <vector>
 
 namespace SmartMet
@@ -37,9 +39,13 @@ class IsobandLayer : public Layer
   std::optional<double> multiplier;
   std::optional<double> offset;
 
+  // Contour a statistic of ensemble members instead of a single field
+  std::optional<Ensemble> ensemble;
+
+  // Possibly shared with other layers contouring the same data
+  std::shared_ptr<ContourGroup> contours;
+
  private:
-  void generate_qEngine(CTPP::CDT& theGlobals, State& theState);
-  void generate_gridEngine(CTPP::CDT& theGlobals, State& theState);
 };  // class IsobandLayer
 
 }  // namespace CrossSection
@@ -1,19 +1,13 @@
 #include "IsolineLayer.h"
 #include "Config.h"
+#include "Deadline.h"
 #include "Isoline.h"
 #include "Layer.h"
 #include "State.h"
 #include <boost/move/unique_ptr.hpp>
 #include <boost/timer/timer.hpp>
 #include <ctpp2/CDT.hpp>
-#include <engines/contour/Engine.h>
-#include <gis/Box.h>
-#include <gis/OGR.h>
-#include <grid-files/common/ImagePaint.h>
-#include <macgyver/StringConversion.h>
-#include <macgyver/TimeFormatter.h>
-#include <macgyver/TimeParser.h>
-#include <timeseries/ParameterFactory.h>
+#include <macgyver/Exception.h>
 #include <algorithm>
 
 namespace SmartMet
@@ -62,6 +56,11 @@ void IsolineLayer::init(const Json::Value& theJson, const Config& theConfig)
         multiplier = json.asDouble();
       else if (name == "offset")
         offset = json.asDouble();
+      else if (name == "ensemble")
+      {
+        ensemble = Ensemble();
+        ensemble->init(json);
+      }
       else if (name == "isolines")
       {
         if (!json.isArray())
@@ -77,6 +76,13 @@ void IsolineLayer::init(const Json::Value& theJson, const Config& theConfig)
       else
         throw Fmi::Exception(BCP, "Isoline-layer does not have a setting named '" + name + "'");
     }
+
+    if (parameter)
+    {
+      contours = std::make_shared<ContourGroup>(
+          *parameter, zparameter, interpolation, multiplier, offset, ensemble);
+      contours->addIsolines(isolines);
+    }
   }
   catch (...)
   {
@@ -94,25 +100,6 @@ void IsolineLayer::generate(CTPP::CDT& theGlobals, State& theState)
 {
   try
   {
-    if (theState.query().source && theState.query().source && *theState.query().source == "grid")
-      generate_gridEngine(theGlobals, theState);
-    else
-      generate_qEngine(theGlobals, theState);
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-void IsolineLayer::generate_gridEngine(CTPP::CDT& theGlobals, State& theState)
-{
-  try
-  {
-    const auto& gridEngine = theState.getGridEngine();
-    if (!gridEngine.isEnabled())
-      throw Fmi::Exception(BCP, "The grid-engine is disabled!");
-
     std::unique_ptr<boost::timer::auto_cpu_timer> timer;
     if (theState.query().timer)
     {
@@ -120,454 +107,41 @@ void IsolineLayer::generate_gridEngine(CTPP::CDT& theGlobals, State& theState)
       timer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
     }
 
-    if (parameter == std::nullopt)
-      throw Fmi::Exception(BCP, "Parameter not set for isoband-layer");
-
-    if (zparameter == std::nullopt)
-      throw Fmi::Exception(BCP, "Z-Parameter not set for isoband-layer");
-
-    std::string pName = *parameter;
-    bool raw = false;
-    auto pos = pName.find(".raw");
-    if (pos != std::string::npos)
-    {
-      raw = true;
-      pName.erase(pos, 4);
-    }
-
-    std::string key = theState.query().producer + ";" + pName;
-
-    Engine::Grid::ParameterDetails_vec parameterDetails;
-    gridEngine.getParameterDetails(theState.query().producer, pName, parameterDetails);
-    // gridEngine.mapParameterDetails(parameterDetails);
-
-    if (parameterDetails.size() != 1 || parameterDetails[0].mProducerName != key)
-    {
-      for (auto& rec : parameterDetails)
-      {
-        QueryServer::ParameterMapping_vec mappings;
-        std::string pn = rec.mProducerName;
-        // if (pn == key)
-        pn = rec.mOriginalProducer;
-
-        if (rec.mLevelId > " " || rec.mLevel > " ")
-        {
-          if (rec.mGeometryId > " ")
-            gridEngine.getParameterMappings(rec.mProducerName,
-                                            rec.mOriginalParameter,
-                                            std::stoi(rec.mGeometryId),
-                                            std::stoi(rec.mLevelId),
-                                            std::stoi(rec.mLevel),
-                                            false,
-                                            mappings);
-          else
-            gridEngine.getParameterMappings(rec.mProducerName,
-                                            rec.mOriginalParameter,
-                                            std::stoi(rec.mLevelId),
-                                            std::stoi(rec.mLevel),
-                                            false,
-                                            mappings);
-
-          if (mappings.empty() && rec.mLevel < " ")
-          {
-            if (rec.mGeometryId > " ")
-              gridEngine.getParameterMappings(rec.mProducerName,
-                                              rec.mOriginalParameter,
-                                              std::stoi(rec.mGeometryId),
-                                              std::stoi(rec.mLevelId),
-                                              -1,
-                                              false,
-                                              mappings);
-            else
-              gridEngine.getParameterMappings(rec.mProducerName,
-                                              rec.mOriginalParameter,
-                                              std::stoi(rec.mLevelId),
-                                              -1,
-                                              false,
-                                              mappings);
-            // getParameterMappings(producerInfo.mName, parameterKey, producerGeometryId,
-            // T::ParamLevelIdTypeValue::ANY, paramLevelId, -1, false, mappings);
-          }
-        }
-        else
-        {
-          if (rec.mGeometryId > " ")
-            gridEngine.getParameterMappings(rec.mProducerName,
-                                            rec.mOriginalParameter,
-                                            std::stoi(rec.mGeometryId),
-                                            true,
-                                            mappings);
-          else
-            gridEngine.getParameterMappings(
-                rec.mProducerName, rec.mOriginalParameter, true, mappings);
-
-          // getParameterMappings(producerInfo.mName, parameterKey, producerGeometryId, true,
-          // mappings);
-        }
-        if (!mappings.empty())
-        {
-          Engine::Grid::MappingDetails details;
-          details.mMapping = mappings[0];
-          rec.mMappings.push_back(details);
-        }
-        // rec.print(std::cout,0,0);
-      }
-
-      if (parameterDetails.empty() || parameterDetails[0].mMappings.empty())
-      {
-        Fmi::Exception exception(BCP, "Parameter mappings not found");
-        if (parameter)
-          exception.addParameter("Parameter", *parameter);
-        exception.addParameter("Producer", theState.query().producer);
-        throw exception;
-      }
-    }
-
-    std::string zkey = *theState.query().zproducer + ";" + *zparameter;
-
-    Engine::Grid::ParameterDetails_vec zParameterDetails;
-    gridEngine.getParameterDetails(*theState.query().zproducer, *zparameter, zParameterDetails);
-    // gridEngine.mapParameterDetails(zParameterDetails);
-
-    if (zParameterDetails.size() != 1 || zParameterDetails[0].mProducerName != zkey)
-    {
-      for (auto& rec : zParameterDetails)
-      {
-        std::string pn = rec.mProducerName;
-        if (pn == zkey)
-          pn = rec.mOriginalProducer;
-
-        QueryServer::ParameterMapping_vec mappings;
-        if (rec.mLevelId > " " || rec.mLevel > " ")
-        {
-          if (rec.mGeometryId > " ")
-            gridEngine.getParameterMappings(pn,
-                                            rec.mOriginalParameter,
-                                            std::stoi(rec.mGeometryId),
-                                            std::stoi(rec.mLevelId),
-                                            std::stoi(rec.mLevel),
-                                            false,
-                                            mappings);
-          else
-            gridEngine.getParameterMappings(pn,
-                                            rec.mOriginalParameter,
-                                            std::stoi(rec.mLevelId),
-                                            std::stoi(rec.mLevel),
-                                            false,
-                                            mappings);
-
-          if (mappings.empty() && rec.mLevel < " ")
-          {
-            if (rec.mGeometryId > " ")
-              gridEngine.getParameterMappings(pn,
-                                              rec.mOriginalParameter,
-                                              std::stoi(rec.mGeometryId),
-                                              std::stoi(rec.mLevelId),
-                                              -1,
-                                              false,
-                                              mappings);
-            else
-              gridEngine.getParameterMappings(
-                  pn, rec.mOriginalParameter, std::stoi(rec.mLevelId), -1, false, mappings);
-            // getParameterMappings(producerInfo.mName, parameterKey, producerGeometryId,
-            // T::ParamLevelIdTypeValue::ANY, paramLevelId, -1, false, mappings);
-          }
-        }
-        else
-        {
-          if (rec.mGeometryId > " ")
-            gridEngine.getParameterMappings(
-                pn, rec.mOriginalParameter, std::stoi(rec.mGeometryId), true, mappings);
-          else
-            gridEngine.getParameterMappings(pn, rec.mOriginalParameter, true, mappings);
-          // getParameterMappings(producerInfo.mName, parameterKey, producerGeometryId, true,
-          // mappings);
-        }
-
-        if (!mappings.empty())
-        {
-          Engine::Grid::MappingDetails details;
-          details.mMapping = mappings[0];
-          rec.mMappings.push_back(details);
-        }
-
-        // rec.print(std::cout,0,0);
-      }
-
-      if (zParameterDetails.empty() || zParameterDetails[0].mMappings.empty())
-      {
-        Fmi::Exception exception(BCP, "Z-Parameter mappings not found");
-        if (zparameter)
-          exception.addParameter("Z-Parameter", *zparameter);
-        if (theState.query().zproducer)
-          exception.addParameter("Producer", *theState.query().zproducer);
-        throw exception;
-      }
-    }
-
-    double lon1 = theState.query().longitude1;
-    double lat1 = theState.query().latitude1;
-    double lon2 = theState.query().longitude2;
-    double lat2 = theState.query().latitude2;
-    int steps = theState.query().steps;
-
-    std::string valueProducerName = parameterDetails[0].mOriginalProducer;
-    std::string valueParameter = parameterDetails[0].mOriginalParameter;
-    int geometryId = -1;
-    short areaInterpolationMethod = T::AreaInterpolationMethod::Linear;
-    short timeInterpolationMethod = T::TimeInterpolationMethod::Linear;
-    std::string heightProducerName = zParameterDetails[0].mOriginalProducer;
-    std::string heightParameter = zParameterDetails[0].mOriginalParameter;
-
-    if (!parameterDetails[0].mMappings.empty())
-    {
-      valueProducerName = parameterDetails[0].mMappings[0].mMapping.mProducerName;
-      valueParameter = parameterDetails[0].mMappings[0].mMapping.mParameterName;
-      geometryId = parameterDetails[0].mMappings[0].mMapping.mGeometryId;
-
-      if (raw)
-        areaInterpolationMethod = T::AreaInterpolationMethod::Linear;
-      else
-        areaInterpolationMethod =
-            parameterDetails[0].mMappings[0].mMapping.mAreaInterpolationMethod;
-
-      timeInterpolationMethod = parameterDetails[0].mMappings[0].mMapping.mTimeInterpolationMethod;
-    }
-
-    if (!zParameterDetails[0].mMappings.empty())
-    {
-      heightProducerName = zParameterDetails[0].mMappings[0].mMapping.mProducerName;
-      heightParameter = zParameterDetails[0].mMappings[0].mMapping.mParameterName;
-    }
+    if (parameter == std::nullopt || !contours)
+      throw Fmi::Exception(BCP, "Parameter not set for isoline-layer");
 
-    int forecastType = -1;
-    int forecastNumber = -1;
-    std::vector<float> contourValues;
-    std::vector<T::Coordinate> coordinates;
-    std::vector<float> gridData;
-    uint gridWidth = 0;
-    uint gridHeight = 0;
-    size_t smooth_size = 0;
-    size_t smooth_degree = 1;
-    T::ByteData_vec contours;
+    // Isolines may be extracted from the isobands of another layer
 
-    std::string utcTime = Fmi::to_iso_string(theState.time().utc_time());
+    const auto& geoms = contours->isolines(theState);
 
-    gridEngine.getVerticalGrid(lon1,
-                               lat1,
-                               lon2,
-                               lat2,
-                               steps,
-                               utcTime,
-                               valueProducerName,
-                               valueParameter,
-                               heightProducerName,
-                               heightParameter,
-                               geometryId,
-                               forecastType,
-                               forecastNumber,
-                               areaInterpolationMethod,
-                               timeInterpolationMethod,
-                               coordinates,
-                               gridData,
-                               gridWidth,
-                               gridHeight);
+    // Store the isolines into the template engine
 
-    double maxHeight = 0;
-    double maxDistance = 0;
-    float maxValue = -1000000000;
-    float minValue = 1000000000;
-
-    for (auto value : gridData)
-    {
-      maxValue = std::max<double>(value, maxValue);
-
-      if (value != ParamValueMissing)
-        minValue = std::min(minValue, value);
-    }
-
-    for (const auto& coord : coordinates)
-    {
-      maxHeight = std::max(coord.y(), maxHeight);
-
-      maxDistance = std::max(coord.x(), maxDistance);
-    }
+    std::string timekey = theState.timeKey();
 
     for (const auto& isoline : isolines)
     {
-      if (isoline.value)
-        contourValues.push_back(isoline.value);
-    }
-
-    getIsolines(gridData,
-                &coordinates,
-                gridWidth,
-                gridHeight,
-                contourValues,
-                T::AreaInterpolationMethod::Linear,
-                smooth_size,
-                smooth_degree,
-                contours);
-
-    if (!contours.empty())
-    {
-      uint c = 0;
-      std::vector<OGRGeometryPtr> geoms;
-      for (const auto& wkb : contours)
-      {
-        const auto* cwkb = reinterpret_cast<const unsigned char*>(wkb.data());
-        OGRGeometry* geom = nullptr;
-        OGRGeometryFactory::createFromWkb(cwkb, nullptr, &geom, wkb.size());
-        auto geomPtr = OGRGeometryPtr(geom);
-        geoms.push_back(geomPtr);
-
-        theState.updateEnvelope(geomPtr);
-        const Isoline& isoline = isolines[c];
-
-        CTPP::CDT hash(CTPP::CDT::HASH_VAL);
-        if (isoline.value)
-          hash["value"] = isoline.value;
-        if (geom != nullptr && geom->IsEmpty() == 0)
-          hash["path"] = Fmi::OGR::exportToSvg(*geom, Fmi::Box::identity(), 1);
-        else
-          hash["path"] = "";
-        theState.addAttributes(theGlobals, hash, isoline.attributes);
-
-        theGlobals["layers"][utcTime]["isolines"][*parameter].PushBack(hash);
-
-        c++;
-      }
-    }
-    /*
-        int imageWidth = 1200;
-        int imageHeight = 1100;
-        bool rotate = true;
-        double mpy = (double)imageHeight / maxHeight;
-        double mpx = (double)imageWidth / maxDistance;
-        double ms = 2;
-        float m = minValue;
-
-        ImagePaint imagePaint(imageWidth,imageHeight,0xFFFFFF,false,rotate);
-
-        int sz = imageWidth * imageHeight;
-        unsigned long *image = new unsigned long[sz];
-        for (int t=0; t<sz; t++)
-          image[t] = 0xFF0000;
-
-        // ### Painting contours into the image:
-
-        if (contours.size() > 0)
-        {
-          for (auto it = contours.begin(); it != contours.end(); ++it)
-          {
-            imagePaint.paintWkb(mpx,mpy,0,0,*it,0x000000);
-          }
-        }
-
-        char fname[200];
-        sprintf(fname,"/tmp/contour.png");
-        imagePaint.savePngImage(fname);
-    */
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-void IsolineLayer::generate_qEngine(CTPP::CDT& theGlobals, State& theState)
-{
-  try
-  {
-    std::unique_ptr<boost::timer::auto_cpu_timer> timer;
-    if (theState.query().timer)
-    {
-      std::string report = "IsolineLayer::generate finished in %t sec CPU, %w sec real\n";
-      timer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
-    }
-
-    // Establish the data
-    auto q = theState.producer();
-
-    // Establish the desired direction parameter
-
-    if (parameter == std::nullopt)
-      throw Fmi::Exception(BCP, "Parameter not set for isoband-layer");
-
-    auto param = SmartMet::TimeSeries::ParameterFactory::instance().parse(*parameter);
+      // The group may contour also the isolines of other layers
+      auto index = contours->isolineIndex(isoline);
+      if (index >= geoms.size())
+        continue;
 
-    // Establish z-parameter
-
-    auto zparam = param;
-    if (zparameter)
-      zparam = SmartMet::TimeSeries::ParameterFactory::instance().parse(*zparameter);
-
-    // Generate isolines and store them into the template engine
-
-    std::unique_ptr<Fmi::TimeFormatter> timeformatter(Fmi::TimeFormatter::create("iso"));
-    std::string timekey = timeformatter->format(theState.time());
-
-    const auto& contourer = theState.getContourEngine();
-    std::vector<double> isoline_options;
-    isoline_options.reserve(isolines.size());
-    for (const auto& isoline : isolines)
-      isoline_options.push_back(isoline.value);
-
-    SmartMet::Engine::Contour::Options options(param, theState.time().utc_time(), isoline_options);
-
-    if (multiplier || offset)
-      options.transformation(multiplier ? *multiplier : 1.0, offset ? *offset : 0.0);
-
-    if (interpolation == "linear")
-      options.interpolation = Trax::InterpolationType::Linear;
-    else if (interpolation == "nearest" || interpolation == "discrete" ||
-             interpolation == "midpoint")
-      options.interpolation = Trax::InterpolationType::Midpoint;
-    else
-      throw Fmi::Exception(BCP, "Unknown isoline interpolation method '" + interpolation + "'");
-
-    auto qInfo = q->info();
-
-    std::vector<OGRGeometryPtr> geoms;
-    if (!zparameter)
-      geoms = contourer.crossection(*qInfo,
-                                    options,
-                                    theState.query().longitude1,
-                                    theState.query().latitude1,
-                                    theState.query().longitude2,
-                                    theState.query().latitude2,
-                                    theState.query().steps);
-    else
-      geoms = contourer.crossection(*qInfo,
-                                    zparam,
-                                    options,
-                                    theState.query().longitude1,
-                                    theState.query().latitude1,
-                                    theState.query().longitude2,
-                                    theState.query().latitude2,
-                                    theState.query().steps);
-
-    for (unsigned int i = 0; i < isolines.size(); i++)
-    {
-      const OGRGeometryPtr& geom = geoms[i];
+      const OGRGeometryPtr& geom = geoms[index];
 
       theState.updateEnvelope(geom);
 
       // Add the layer
-      const Isoline& isoline = isolines[i];
 
       CTPP::CDT hash(CTPP::CDT::HASH_VAL);
       if (isoline.value != 0)
         hash["value"] = isoline.value;
-      if (geom != nullptr && geom->IsEmpty() == 0)
-        hash["path"] = Fmi::OGR::exportToSvg(*geom, Fmi::Box::identity(), 1);
-      else
-        hash["path"] = "";
       theState.addAttributes(theGlobals, hash, isoline.attributes);
-
-      theGlobals["layers"][timekey]["isolines"][*parameter].PushBack(hash);
+      theState.addContour(theGlobals, timekey, "isolines", *parameter, hash, geom);
     }
   }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "ContourGroup.h"
 #include "Isoline.h"
 #include "Layer.h"
+#include <memory>
 #include <vector>
 
 namespace SmartMet
@@ -31,9 +33,13 @@ class IsolineLayer : public Layer
   std::optional<double> multiplier;
   std::optional<double> offset;
 
+  // Contour a statistic of ensemble members instead of a single field
+  std::optional<Ensemble> ensemble;
+
+  // Possibly shared with an isoband layer contouring the same data
+  std::shared_ptr<ContourGroup> contours;
+
  private:
-  void generate_qEngine(CTPP::CDT& theGlobals, State& theState);
-  void generate_gridEngine(CTPP::CDT& theGlobals, State& theState);
 };  // class IsolineHandler
 
 }  // namespace CrossSection
@@ -0,0 +1,33 @@
+#include "KeyHash.h"
+#include <cstdint>
+#include <cstdio>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief 64-bit FNV-1a hash as 16 hexadecimal digits
+ */
+// ----------------------------------------------------------------------
+
+std::string key_hash(const std::string& theKey)
+{
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char ch : theKey)
+  {
+    hash ^= ch;
+    hash *= 1099511628211ULL;
+  }
+
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+  return buffer;
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
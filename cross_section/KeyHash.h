@@ -0,0 +1,26 @@
+// ======================================================================
+/*!
+ * \brief Stable hashes of cache keys
+ *
+ * Unlike std::hash the hash is guaranteed to be the same on all nodes
+ * and builds, hence it can be published in HTTP headers and used for
+ * naming persistent cache files.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// 64-bit FNV-1a hash as 16 hexadecimal digits
+std::string key_hash(const std::string& theKey);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -45,6 +45,9 @@ class Layer
 
   virtual void init(const Json::Value& theJson, const Config& theConfig) = 0;
 
+  // The layers are shared by concurrent requests and by the parallel routes of a
+  // batch request. Generating must not modify the layer, all per-request data
+  // belongs to the state.
   virtual void generate(CTPP::CDT& theGlobals, State& theState) = 0;
 
   Attributes attributes;
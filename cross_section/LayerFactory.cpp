@@ -1,8 +1,11 @@
 // ======================================================================
 
 #include "LayerFactory.h"
+#include "ArrowLayer.h"
 #include "IsobandLayer.h"
 #include "IsolineLayer.h"
+#include "RasterLayer.h"
+#include "WindComponentLayer.h"
 #include <macgyver/Exception.h>
 #include <fstream>
 #include <stdexcept>
@@ -34,6 +37,14 @@ Layer* create(const Json::Value& theJson)
       return new IsobandLayer;
     if (name == "isoline")
       return new IsolineLayer;
+    if (name == "wind_component")
+      return new WindComponentLayer;
+    if (name == "arrow")
+      return new ArrowLayer("arrows");
+    if (name == "barb")
+      return new ArrowLayer("barbs");
+    if (name == "raster")
+      return new RasterLayer;
 
     throw Fmi::Exception(BCP, "Unknown layer type '" + name + "'");
   }
@@ -1,7 +1,11 @@
 #include "Layers.h"
+#include "Deadline.h"
+#include "IsobandLayer.h"
+#include "IsolineLayer.h"
 #include "Layer.h"
 #include "LayerFactory.h"
 #include "State.h"
+#include "WindComponentLayer.h"
 #include <ctpp2/CDT.hpp>
 #include <macgyver/Exception.h>
 
@@ -11,6 +15,21 @@ namespace Plugin
 {
 namespace CrossSection
 {
+namespace
+{
+// The contour group of a contouring layer, or nullptr for other layers
+std::shared_ptr<ContourGroup>* contour_group(Layer& theLayer)
+{
+  if (auto* layer = dynamic_cast<IsobandLayer*>(&theLayer))
+    return &layer->contours;
+  if (auto* layer = dynamic_cast<IsolineLayer*>(&theLayer))
+    return &layer->contours;
+  if (auto* layer = dynamic_cast<WindComponentLayer*>(&theLayer))
+    return &layer->contours;
+  return nullptr;
+}
+}  // namespace
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Initialize the layers from JSON
@@ -30,6 +49,52 @@ void Layers::init(const Json::Value& theJson, const Config& theConfig)
       layer->init(json, theConfig);
       layers.push_back(layer);
     }
+
+    groupContours();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Share contouring work between the layers
+ *
+ * Layers which contour the same data slice share a single contour
+ * group, which contours the union of their isoband limits and isoline
+ * values with one call per timestep. Isolines which are limits between
+ * isobands are extracted from the isoband edges.
+ */
+// ----------------------------------------------------------------------
+
+void Layers::groupContours()
+{
+  try
+  {
+    std::vector<std::shared_ptr<ContourGroup>> groups;
+
+    for (auto& layer : layers)
+    {
+      auto* contours = contour_group(*layer);
+      if (contours == nullptr || !*contours)
+        continue;
+
+      bool merged = false;
+      for (auto& group : groups)
+      {
+        if (group->merge(**contours))
+        {
+          *contours = group;
+          merged = true;
+          break;
+        }
+      }
+
+      if (!merged)
+        groups.push_back(*contours);
+    }
   }
   catch (...)
   {
@@ -49,9 +114,14 @@ void Layers::generate(CTPP::CDT& theGlobals, State& theState)
   {
     for (auto& layer : layers)
     {
+      theState.checkDeadline();
       layer->generate(theGlobals, theState);
     }
   }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
@@ -33,8 +33,11 @@ class Layers
   void generate(CTPP::CDT& theGlobals, State& theState);
 
   bool empty() const { return layers.empty(); }
+  std::size_t size() const { return layers.size(); }
 
  private:
+  void groupContours();
+
   std::list<std::shared_ptr<Layer> > layers;
 };
 
@@ -0,0 +1,162 @@
+#include "LocationCache.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// Request parameters used by geonames to resolve the locations
+
+const std::array<const char*, 13> location_parameters{"place",
+                                                      "places",
+                                                      "lonlat",
+                                                      "lonlats",
+                                                      "latlon",
+                                                      "latlons",
+                                                      "geoid",
+                                                      "geoids",
+                                                      "fmisid",
+                                                      "wmo",
+                                                      "lpnn",
+                                                      "keyword",
+                                                      "lang"};
+
+// Other location options of geonames. Their effect on the resolved
+// locations is not captured by the key, hence such requests are not
+// cached at all.
+
+const std::array<const char*, 13> uncached_parameters{"area",
+                                                      "areas",
+                                                      "bbox",
+                                                      "bboxes",
+                                                      "path",
+                                                      "paths",
+                                                      "wkt",
+                                                      "feature",
+                                                      "features",
+                                                      "maxdistance",
+                                                      "inkeyword",
+                                                      "numberofstations",
+                                                      "geometryid"};
+
+template <std::size_t N>
+bool contains(const std::array<const char*, N>& theNames, const std::string& theName)
+{
+  return std::find(theNames.begin(), theNames.end(), theName) != theNames.end();
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+LocationCache::LocationCache(std::size_t theMaxSize) : itsCache(theMaxSize) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Normalized form of the location parameters of a request
+ *
+ * The order of repeated parameters is significant since it determines
+ * the order of the waypoints, the order of different parameters is not.
+ * The key is empty if the request has no cacheable location parameters
+ * or has options which may change the outcome of the location search.
+ */
+// ----------------------------------------------------------------------
+
+std::string LocationCache::key(const SmartMet::Spine::HTTP::Request& theRequest)
+{
+  try
+  {
+    std::vector<std::pair<std::string, std::string>> params;
+    for (const auto& param : theRequest.getParameterMap())
+    {
+      if (contains(uncached_parameters, param.first))
+        return {};
+      if (contains(location_parameters, param.first))
+        params.emplace_back(param.first, param.second);
+    }
+
+    std::stable_sort(params.begin(),
+                     params.end(),
+                     [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+    std::string ret;
+    for (const auto& param : params)
+    {
+      ret += param.first;
+      ret += '=';
+      ret += param.second;
+      ret += '&';
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find a cached route
+ */
+// ----------------------------------------------------------------------
+
+std::optional<Waypoints> LocationCache::find(const std::string& theKey)
+{
+  try
+  {
+    if (theKey.empty())
+      return {};
+    return itsCache.find(theKey);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cache a resolved route
+ */
+// ----------------------------------------------------------------------
+
+void LocationCache::insert(const std::string& theKey, const Waypoints& theWaypoints)
+{
+  try
+  {
+    if (!theKey.empty())
+      itsCache.insert(theKey, theWaypoints);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Number of cached entries
+ */
+// ----------------------------------------------------------------------
+
+std::size_t LocationCache::size() const
+{
+  return itsCache.size();
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
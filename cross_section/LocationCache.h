@@ -0,0 +1,49 @@
+// ======================================================================
+/*!
+ * \brief Cache for resolved cross-section routes
+ *
+ * Clients use the same few hundred place names over and over again.
+ * The resolved coordinates of the waypoints are cached under the
+ * normalized location parameters of the request so that geonames is
+ * not consulted for every request. The least recently used entries
+ * are evicted once the cache is full. Requests with location options
+ * whose effect is not captured by the key are not cached.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Geodesy.h"
+#include "LruCache.h"
+#include <spine/HTTP.h>
+#include <optional>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class LocationCache
+{
+ public:
+  explicit LocationCache(std::size_t theMaxSize);
+
+  // Normalized form of the request parameters which affect the route, or an
+  // empty string if the route of the request may not be cached
+  static std::string key(const SmartMet::Spine::HTTP::Request& theRequest);
+
+  std::optional<Waypoints> find(const std::string& theKey);
+  void insert(const std::string& theKey, const Waypoints& theWaypoints);
+
+  // Number of cached entries
+  std::size_t size() const;
+
+ private:
+  LruCache<Waypoints> itsCache;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,83 @@
+// ======================================================================
+/*!
+ * \brief Thread safe cache with least recently used eviction
+ *
+ * The cache holds at most the given number of values, zero disables
+ * the cache.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+template <typename Value>
+class LruCache
+{
+ public:
+  explicit LruCache(std::size_t theMaxSize) : itsMaxSize(theMaxSize) {}
+
+  std::optional<Value> find(const std::string& theKey)
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto it = itsIndex.find(theKey);
+    if (it == itsIndex.end())
+      return {};
+    itsEntries.splice(itsEntries.begin(), itsEntries, it->second);
+    return it->second->second;
+  }
+
+  void insert(const std::string& theKey, Value theValue)
+  {
+    if (itsMaxSize == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto it = itsIndex.find(theKey);
+    if (it != itsIndex.end())
+    {
+      it->second->second = std::move(theValue);
+      itsEntries.splice(itsEntries.begin(), itsEntries, it->second);
+      return;
+    }
+
+    itsEntries.emplace_front(theKey, std::move(theValue));
+    itsIndex[theKey] = itsEntries.begin();
+
+    while (itsEntries.size() > itsMaxSize)
+    {
+      itsIndex.erase(itsEntries.back().first);
+      itsEntries.pop_back();
+    }
+  }
+
+  // Number of cached values
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    return itsEntries.size();
+  }
+
+ private:
+  using Entries = std::list<std::pair<std::string, Value>>;
+
+  const std::size_t itsMaxSize;
+  mutable std::mutex itsMutex;
+  Entries itsEntries;  // most recently used first
+  std::unordered_map<std::string, typename Entries::iterator> itsIndex;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
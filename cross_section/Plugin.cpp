@@ -5,23 +5,39 @@
 // ======================================================================
 
 #include "Plugin.h"
+#include "Batch.h"
+#include "Deadline.h"
+#include "Geodesy.h"
 #include "Json.h"
+#include "KeyHash.h"
 #include "Product.h"
 #include "Query.h"
+#include "Snapping.h"
 #include "State.h"
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/move/unique_ptr.hpp>
 #include <boost/timer/timer.hpp>
 #include <ctpp2/CDT.hpp>
 #include <engines/geonames/Engine.h>
+#include <grid-files/identification/GridDef.h>
 #include <json/json.h>
 #include <json/reader.h>
 #include <macgyver/AnsiEscapeCodes.h>
 #include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <macgyver/TimeFormatter.h>
+#include <macgyver/TimeParser.h>
+#include <newbase/NFmiFastQueryInfo.h>
 #include <spine/Convenience.h>
 #include <spine/HostInfo.h>
 #include <spine/SmartMet.h>
 #include <timeseries/OptionParsers.h>
 #include <timeseries/TimeSeriesGeneratorOptions.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <optional>
 #include <stdexcept>
 
 namespace
@@ -46,6 +62,109 @@ void check_attack(const std::string &theName)
       BCP, "Attack IRI detected, relative paths upwards are not safe: '" + theName + "'");
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Canonical key of a request
+ *
+ * The key is built from the normalized query instead of the query string
+ * so that different spellings of the same request (parameter order,
+ * place names vs coordinates, time options) map to the same key. The
+ * key is used for coalescing and caching responses, and its hash is
+ * published for routing requests in multi-node deployments.
+ */
+// ----------------------------------------------------------------------
+
+std::string request_key(const SmartMet::Plugin::CrossSection::Query &theQuery,
+                        const std::string &theProduct,
+                        const std::string &theFormat,
+                        const SmartMet::TimeSeries::TimeSeriesGenerator::LocalTimeList &theTimes)
+{
+  std::string key = theQuery.customer;
+  key += ';';
+  key += theProduct;
+  key += ';';
+  key += theFormat;
+  key += ';';
+  key += theQuery.producer;
+  key += ';';
+  key += theQuery.zproducer ? *theQuery.zproducer : "";
+  key += ';';
+  key += theQuery.source ? *theQuery.source : "";
+  key += ';';
+  key += SmartMet::Plugin::CrossSection::route_string(theQuery.waypoints);
+  for (const auto &t : theQuery.waypoint_times)
+  {
+    key += ',';
+    key += Fmi::to_iso_string(t);
+  }
+  key += ';';
+  key += Fmi::to_string(theQuery.steps);
+  key += ';';
+  key += theQuery.timezone;
+  for (const auto &t : theTimes)
+  {
+    key += ';';
+    key += Fmi::to_iso_string(t.utc_time());
+  }
+  return key;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief True if the times of a request depend on the valid times of the data
+ */
+// ----------------------------------------------------------------------
+
+bool uses_data_times(const SmartMet::TimeSeries::TimeSeriesGeneratorOptions &theOptions)
+{
+  using Options = SmartMet::TimeSeries::TimeSeriesGeneratorOptions;
+  return (theOptions.mode == Options::DataTimes || theOptions.mode == Options::GraphTimes ||
+          theOptions.startTimeData || theOptions.endTimeData);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Set the HTTP cache headers based on the data
+ *
+ * The response is valid until the next expected update of the data,
+ * which is estimated from the time the data was last updated and the
+ * configured update interval of the producer. Without a known update
+ * interval, or if the update is already overdue, the default lifetime
+ * is used. Stale responses being refreshed also get the default.
+ */
+// ----------------------------------------------------------------------
+
+void set_cache_headers(SmartMet::Spine::HTTP::Response &theResponse,
+                       const SmartMet::Plugin::CrossSection::DataGeneration &theGeneration,
+                       const std::optional<int> &theUpdateInterval,
+                       int theDefaultExpires,
+                       bool theStale)
+{
+  const Fmi::DateTime t_now = Fmi::SecondClock::universal_time();
+
+  Fmi::DateTime t_modified = t_now;
+  if (!theGeneration.modificationTime.is_not_a_date_time())
+    t_modified = theGeneration.modificationTime;
+  else if (!theGeneration.originTime.is_not_a_date_time())
+    t_modified = theGeneration.originTime;
+
+  long expires_seconds = theDefaultExpires;
+  if (theUpdateInterval && !theStale && t_modified != t_now)
+  {
+    const auto t_next = t_modified + Fmi::Seconds(*theUpdateInterval);
+    if (t_next > t_now)
+      expires_seconds = (t_next - t_now).total_seconds();
+  }
+
+  const Fmi::DateTime t_expires = t_now + Fmi::Seconds(expires_seconds);
+
+  std::shared_ptr<Fmi::TimeFormatter> tformat(Fmi::TimeFormatter::create("http"));
+
+  theResponse.setHeader("Cache-Control", "public, max-age=" + std::to_string(expires_seconds));
+  theResponse.setHeader("Expires", tformat->format(t_expires));
+  theResponse.setHeader("Last-Modified", tformat->format(t_modified));
+}
+
 }  // namespace
 
 namespace SmartMet
@@ -57,12 +176,16 @@ namespace CrossSection
 // ----------------------------------------------------------------------
 /*!
  * \brief Perform a CSection query
+ *
+ * A refresh regenerates the response even if a cached one is available.
+ * Refreshes are background work and bypass the admission control.
  */
 // ----------------------------------------------------------------------
 
 std::string Plugin::query(SmartMet::Spine::Reactor & /* theReactor */,
                           const SmartMet::Spine::HTTP::Request &theRequest,
-                          SmartMet::Spine::HTTP::Response & /* theResponse */)
+                          SmartMet::Spine::HTTP::Response &theResponse,
+                          bool theRefresh)
 {
   try
   {
@@ -87,99 +210,469 @@ std::string Plugin::query(SmartMet::Spine::Reactor & /* theReactor */,
         SmartMet::Spine::optional_string(theRequest.getParameter("zproducer"), q.producer);
     q.source = SmartMet::Spine::optional_string(theRequest.getParameter("source"), "querydata");
 
-    q.steps = SmartMet::Spine::required_unsigned_long(
+    // steps=auto is resolved once the endpoints are known
+
+    const auto steps = SmartMet::Spine::required_string(
         theRequest.getParameter("steps"),
         "Configuration option 'steps' must be given to determine "
         "how many parts the isocircle is divided into");
+    const bool auto_steps_requested = (steps == "auto");
+    if (!auto_steps_requested)
+      q.steps = SmartMet::Spine::required_unsigned_long(theRequest.getParameter("steps"), "");
 
     q.timezone = SmartMet::Spine::optional_string(theRequest.getParameter("timezone"),
                                                   itsConfig.defaultTimeZone());
 
-    // We require exactly two locations
+    // Deadline for abandoning the request. The request may not extend the configured maximum.
 
-    SmartMet::Engine::Geonames::LocationOptions loptions = itsGeoEngine->parseLocations(theRequest);
+    auto timeout = SmartMet::Spine::optional_unsigned_long(theRequest.getParameter("timeout"),
+                                                           itsConfig.timeout());
+    if (itsConfig.maxTimeout() > 0 &&
+        (timeout == 0 || timeout > static_cast<unsigned long>(itsConfig.maxTimeout())))
+      timeout = itsConfig.maxTimeout();
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (timeout > 0)
+    {
+      deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+      q.deadline = deadline;
+    }
 
-    if (loptions.size() != 2)
-      throw Fmi::Exception(BCP, "Exactly two locations are required for a cross-section");
+    // The template to fill. Topology output requires shared arcs to be extracted.
 
-    const auto &locs = loptions.locations();
-    q.longitude1 = locs.front().loc->longitude;
-    q.latitude1 = locs.front().loc->latitude;
-    q.longitude2 = locs.back().loc->longitude;
-    q.latitude2 = locs.back().loc->latitude;
+    auto format_name = SmartMet::Spine::optional_string(theRequest.getParameter("format"),
+                                                        itsConfig.defaultTemplate());
+    q.topology = (format_name == "topojson");
 
-    // State variable
+    // A batch request lists its routes in repeated route parameters, otherwise
+    // the route is given by the locations of the request
 
-    State state(*this);
-    state.query(q);
+    std::vector<Query> queries;
+    const auto routes = theRequest.getParameterMap().equal_range("route");
+    const bool batch = (routes.first != routes.second);
 
-    // And timeseries options now that state (and querydata) is established
+    if (batch)
+    {
+      for (auto it = routes.first; it != routes.second; ++it)
+      {
+        queries.push_back(q);
+        queries.back().waypoints = parse_route(it->second);
+      }
+      if (queries.size() > itsConfig.batchMaxRoutes())
+        throw Fmi::Exception(BCP, "Too many routes in a batch request")
+            .addParameter("Routes", Fmi::to_string(queries.size()))
+            .addParameter("Limit", Fmi::to_string(itsConfig.batchMaxRoutes()));
+    }
+    else
+    {
+      // We require at least two locations, more make a polyline route. Clients use
+      // the same places over and over again, hence geonames is consulted only for new ones.
+
+      const auto location_key = LocationCache::key(theRequest);
+      auto waypoints = itsLocationCache.find(location_key);
+      if (!waypoints)
+      {
+        SmartMet::Engine::Geonames::LocationOptions loptions =
+            itsGeoEngine->parseLocations(theRequest);
 
-    TimeSeries::TimeSeriesGeneratorOptions toptions = SmartMet::TimeSeries::parseTimes(theRequest);
+        if (loptions.size() < 2)
+          throw Fmi::Exception(BCP, "At least two locations are required for a cross-section");
+
+        waypoints = Waypoints();
+        for (const auto &loc : loptions.locations())
+          waypoints->push_back(Waypoint{loc.loc->longitude, loc.loc->latitude});
+        itsLocationCache.insert(location_key, *waypoints);
+      }
+
+      q.waypoints = *waypoints;
+      queries.push_back(q);
+    }
+
+    // Match the number of steps to the resolution of the data
+
+    if (auto_steps_requested)
+    {
+      auto spacing = getGridSpacing(*q.source, q.producer);
+      if (!spacing)
+        throw Fmi::Exception(BCP, "Cannot determine the grid spacing for steps=auto")
+            .addParameter("Producer", q.producer);
+
+      auto oversampling = SmartMet::Spine::optional_double(
+          theRequest.getParameter("oversampling"), itsConfig.autoStepsOversampling());
+      auto max_steps = SmartMet::Spine::optional_unsigned_long(theRequest.getParameter("maxsteps"),
+                                                               itsConfig.autoStepsMax());
+      max_steps = std::min<unsigned long>(max_steps, itsConfig.autoStepsMax());
+
+      if (!(oversampling > 0))
+        throw Fmi::Exception(BCP, "oversampling must be positive");
+
+      for (auto &query : queries)
+        query.steps = auto_steps(route_length(query.waypoints), *spacing, oversampling, max_steps);
+    }
+
+    // Nearly identical routes of interactive clients are snapped to the same
+    // one before the cache keys are computed
+
+    const auto *snap_policy = itsConfig.snapPolicy(q.customer);
+    if (snap_policy != nullptr)
+    {
+      for (auto &query : queries)
+        query.snapped = snap_route(query, *snap_policy);
+    }
 
-    if (!q.source || *q.source != "grid")
-      toptions.setDataTimes(state.producer()->validTimes(), state.producer()->isClimatology());
+    // Along a trajectory each waypoint has its own valid time, for example the
+    // estimated time of arrival of a flight
+
+    const auto trajectory = theRequest.getParameter("trajectory");
+    if (trajectory)
+    {
+      if (q.source && *q.source == "grid")
+        throw Fmi::Exception(BCP, "Trajectory cross-sections are available only for querydata");
+
+      std::vector<std::string> parts;
+      boost::algorithm::split(parts, *trajectory, boost::algorithm::is_any_of(","));
+
+      std::vector<Fmi::DateTime> waypoint_times;
+      for (const auto &part : parts)
+      {
+        waypoint_times.push_back(Fmi::TimeParser::parse(part));
+        if (waypoint_times.size() > 1 && waypoint_times.back() < waypoint_times.end()[-2])
+          throw Fmi::Exception(BCP, "Trajectory times must be in increasing order");
+      }
+
+      for (auto &query : queries)
+      {
+        if (waypoint_times.size() != query.waypoints.size())
+          throw Fmi::Exception(BCP, "Each waypoint of a trajectory must have a time")
+              .addParameter("Waypoints", Fmi::to_string(query.waypoints.size()))
+              .addParameter("Times", Fmi::to_string(waypoint_times.size()));
+        query.waypoint_times = waypoint_times;
+      }
+    }
+
+    // State variable. The data and the times are shared by all routes. The data
+    // is fetched only once it is needed.
+
+    State state(*this);
+    state.query(queries.front());
+
+    // A trajectory is rendered once, labeled by its departure time. Otherwise the
+    // times are generated from the timeseries options, which need the querydata
+    // only if they refer to the valid times of the data.
 
     auto tz = itsGeoEngine->getTimeZones().time_zone_from_string(q.timezone);
-    auto times = TimeSeries::TimeSeriesGenerator::generate(toptions, tz);
+    TimeSeries::TimeSeriesGenerator::LocalTimeList times;
+
+    if (trajectory)
+      times.emplace_back(queries.front().waypoint_times.front(), tz);
+    else
+    {
+      TimeSeries::TimeSeriesGeneratorOptions toptions =
+          SmartMet::TimeSeries::parseTimes(theRequest);
+
+      if ((!q.source || *q.source != "grid") && uses_data_times(toptions))
+        toptions.setDataTimes(state.producer()->validTimes(), state.producer()->isClimatology());
+
+      times = TimeSeries::TimeSeriesGenerator::generate(toptions, tz);
+    }
 
     // Product JSON
 
     auto product_name = SmartMet::Spine::required_string(
         theRequest.getParameter("product"), "Product configuration option 'product' not given");
-    auto product = getProduct(q.customer, product_name, print_json);
 
-    // The template to fill
+    // The canonical key of the request is published so that a frontend can
+    // route identical requests to the same backend. A pre-flight request
+    // with keyonly=1 returns just the key, which requires no data unless
+    // the times are relative to the data. Each route of a batch request
+    // is cached separately.
 
-    auto format_name = SmartMet::Spine::optional_string(theRequest.getParameter("format"),
-                                                        itsConfig.defaultTemplate());
+    std::vector<std::string> keys;
+    for (const auto &query : queries)
+      keys.push_back(request_key(query, product_name, format_name, times));
+
+    std::string key = keys.front();
+    if (batch)
+    {
+      key = "batch";
+      for (const auto &k : keys)
+        key += '\n' + k;
+    }
+    theResponse.setHeader("X-CSection-Key", key_hash(key));
+
+    if (SmartMet::Spine::optional_bool(theRequest.getParameter("keyonly"), false))
+      return "{\"key\":\"" + key_hash(key) + "\"}";
+
+    auto product = getProduct(q.customer, product_name, print_json);
 
     auto tmpl = getTemplate(format_name);
 
-    // Build the response CDT
-    CTPP::CDT hash(CTPP::CDT::HASH_VAL);
+    // Reject too expensive requests before any data is processed
+
+    auto max_cost = itsConfig.maxCost(q.customer);
+    if (max_cost > 0)
     {
-      std::unique_ptr<boost::timer::auto_cpu_timer> mytimer;
-      if (q.timer)
+      std::size_t levels = itsConfig.defaultLevels();
+      if (!q.source || *q.source != "grid")
+        levels = state.producer()->info()->SizeLevels();
+
+      for (const auto &query : queries)
       {
-        std::string report = "Product::generate finished in %t sec CPU, %w sec real\n";
-        mytimer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
+        auto cost = request_cost(query.steps, levels, times.size(), product.layers.size());
+        if (cost > static_cast<double>(max_cost))
+          throw AdmissionError("Request is too expensive, estimated cost " +
+                                   Fmi::to_string(cost) + " exceeds the limit " +
+                                   std::to_string(max_cost),
+                               false);
       }
-      product.generate(hash, state, times);
     }
 
-    if (print_hash)
+    // Each admitted client request takes one processing slot for the rest of its duration.
+    // Parsing, keyonly pre-flights and rejected requests do not wait for a slot. Prewarming
+    // and refreshing run in the background and are limited by their own thread pool.
+
+    std::optional<AdmissionControl::Slot> slot;
+    if (!theRefresh)
+      slot.emplace(itsAdmission.acquire());
+
+    // The data determines how long the response is valid. All routes are rendered
+    // from the same querydata, and the generation is taken from that data.
+
+    const bool grid_source = (q.source && *q.source == "grid");
+
+    SmartMet::Engine::Querydata::Q data;
+    DataGeneration generation;
+    if (grid_source)
+      generation = getDataGeneration(q);
+    else
     {
-      std::cout << "Generated CDT for " << q.customer << " " << product_name << '\n'
-                << hash.RecursiveDump() << '\n';
+      data = state.producer();
+      generation = getDataGeneration(data);
     }
+    auto update_interval = itsConfig.updateInterval(q.producer);
 
-    std::string output;
-    try
+    // Generate the output for one route
+
+    auto generate = [&](const Query &theQuery) -> std::string
     {
-      std::string log;
-      std::unique_ptr<boost::timer::auto_cpu_timer> mytimer;
-      if (q.timer)
+      // Each route has its own state, but they all use the same data
+      State route_state(*this);
+      route_state.query(theQuery);
+      route_state.generation(generation);
+      if (data)
+        route_state.producer(data);
+
+      // Build the response CDT
+      CTPP::CDT hash(CTPP::CDT::HASH_VAL);
       {
-        std::string report = "Template processing finished in %t sec CPU, %w sec real\n";
-        mytimer.reset(new boost::timer::auto_cpu_timer(2, report));
+        std::unique_ptr<boost::timer::auto_cpu_timer> mytimer;
+        if (q.timer)
+        {
+          std::string report = "Product::generate finished in %t sec CPU, %w sec real\n";
+          mytimer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
+        }
+        product.generate(hash, route_state, times);
       }
-      tmpl->process(hash, output, log);
-    }
-    catch (const CTPP::CTPPException & /* ex */)
+
+      if (print_hash)
+      {
+        std::cout << "Generated CDT for " << q.customer << " " << product_name << '\n'
+                  << hash.RecursiveDump() << '\n';
+      }
+
+      std::string output;
+      try
+      {
+        std::string log;
+        std::unique_ptr<boost::timer::auto_cpu_timer> mytimer;
+        if (q.timer)
+        {
+          std::string report = "Template processing finished in %t sec CPU, %w sec real\n";
+          mytimer.reset(new boost::timer::auto_cpu_timer(2, report));
+        }
+        tmpl->process(hash, output, log);
+      }
+      catch (const CTPP::CTPPException & /* ex */)
+      {
+        throw Fmi::Exception(BCP, "Template processing failed!")
+            .addParameter("Product", product_name)
+            .addParameter("Format name", format_name);
+      }
+      catch (...)
+      {
+        throw Fmi::Exception(BCP, "Template processing failed!")
+            .addParameter("Product", product_name)
+            .addParameter("Format name", format_name);
+      }
+
+      return output;
+    };
+
+    // Debugging output is printed only when the response is actually
+    // generated, hence such requests are never cached or coalesced.
+
+    const bool debugging = (print_hash || print_json || q.timer);
+
+    // Responses can be cached only if the data can be identified. Stale
+    // responses are served while they are being refreshed in the background.
+
+    const bool cacheable =
+        (!debugging && !generation.id.empty() &&
+         (itsConfig.memoryCacheSize() > 0 || itsDiskCache));
+
+    std::atomic<bool> stale{false};
+    std::vector<char> needs_refresh(queries.size(), 0);
+
+    auto render = [&](std::size_t theIndex) -> std::string
     {
-      throw Fmi::Exception(BCP, "Template processing failed!")
-          .addParameter("Product", product_name)
-          .addParameter("Format name", format_name);
-    }
-    catch (...)
+      const auto &route_query = queries[theIndex];
+      const auto &route_key = keys[theIndex];
+
+      if (debugging)
+        return generate(route_query);
+
+      if (cacheable && !theRefresh)
+      {
+        auto lookup = itsResponseCache.find(route_key,
+                                            generation.id,
+                                            std::chrono::seconds(product.soft_ttl),
+                                            std::chrono::seconds(product.hard_ttl));
+        if (lookup.response)
+        {
+          if (lookup.refresh)
+            needs_refresh[theIndex] = 1;
+          if (lookup.stale)
+            stale = true;
+          return *lookup.response;
+        }
+
+        // The disk cache holds only responses made from the current data
+
+        if (itsDiskCache)
+        {
+          auto entry = itsDiskCache->find(route_key, generation.id);
+          const auto age = std::chrono::seconds(std::time(nullptr) - (entry ? entry->created : 0));
+          if (entry && age < std::chrono::seconds(product.hard_ttl))
+          {
+            itsResponseCache.insert(route_key, entry->data, generation.id, age);
+            return entry->data;
+          }
+        }
+      }
+
+      // Identical concurrent requests share a single computation
+
+      std::string output;
+      if (!itsConfig.coalesce())
+        output = generate(route_query);
+      else
+      {
+        // Do not wait for other requests beyond our own deadline
+
+        auto wait = std::chrono::milliseconds(itsConfig.coalesceTimeout());
+        bool wait_until_deadline = false;
+        if (deadline)
+        {
+          const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+              *deadline - std::chrono::steady_clock::now());
+          wait_until_deadline = (remaining < wait);
+          wait = std::min(wait, remaining);
+        }
+
+        // Failures caused by our own deadline or admission are not shared with the
+        // waiting requests, one of them reruns the computation instead
+
+        auto own_failure = [](const std::exception_ptr &theError)
+        {
+          try
+          {
+            std::rethrow_exception(theError);
+          }
+          catch (const AdmissionError &)
+          {
+            return true;
+          }
+          catch (const DeadlineExceeded &)
+          {
+            return true;
+          }
+          catch (...)
+          {
+            return false;
+          }
+        };
+
+        try
+        {
+          output = itsCoalescer.run(
+              route_key, [&]() { return generate(route_query); }, wait, own_failure);
+        }
+        catch (const CoalesceTimeout &)
+        {
+          if (wait_until_deadline)
+            throw DeadlineExceeded("Request deadline exceeded");
+          throw;
+        }
+      }
+
+      // The grid engine always samples its latest data, which may have been replaced
+      // during rendering. Such responses are served but not cached.
+
+      bool store = cacheable;
+      if (store && grid_source)
+        store = (getDataGeneration(q).id == generation.id);
+
+      if (store)
+      {
+        itsResponseCache.insert(route_key, output, generation.id);
+        if (itsDiskCache)
+        {
+          try
+          {
+            itsDiskCache->insert(route_key, generation.id, output);
+          }
+          catch (...)
+          {
+            Fmi::Exception::Trace(BCP, "Failed to store the response in the disk cache")
+                .printError();
+          }
+        }
+      }
+
+      return output;
+    };
+
+    // The routes of a batch are rendered in parallel
+
+    std::vector<std::string> outputs(queries.size());
+    run_parallel(itsThreadPool,
+                 queries.size(),
+                 itsConfig.batchThreads(),
+                 [&](std::size_t theIndex) { outputs[theIndex] = render(theIndex); });
+
+    for (std::size_t i = 0; i < queries.size(); i++)
     {
-      throw Fmi::Exception(BCP, "Template processing failed!")
-          .addParameter("Product", product_name)
-          .addParameter("Format name", format_name);
+      if (needs_refresh[i] == 0)
+        continue;
+      if (batch)
+        refresh(theRequest, &queries[i].waypoints);
+      else
+        refresh(theRequest);
     }
 
-    return output;
+    set_cache_headers(theResponse, generation, update_interval, itsConfig.expires(), stale);
+
+    if (!batch)
+      return outputs.front();
+
+    return combine_outputs(outputs);
+  }
+  catch (const AdmissionError &)
+  {
+    throw;
+  }
+  catch (const DeadlineExceeded &)
+  {
+    throw;
   }
   catch (...)
   {
@@ -262,6 +755,343 @@ Product Plugin::getProduct(const std::string &theCustomer,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Identify the latest data of a producer
+ *
+ * For querydata the origin time and the modification time of the
+ * latest data identify the data. For grid data the latest ready
+ * generation of the producer is used.
+ */
+// ----------------------------------------------------------------------
+
+DataGeneration Plugin::getDataGeneration(const std::string &theSource,
+                                         const std::string &theProducer) const
+{
+  try
+  {
+    DataGeneration generation;
+
+    if (theSource != "grid")
+      return getDataGeneration(itsQEngine->get(theProducer));
+
+    if (!itsGridEngine || !itsGridEngine->isEnabled())
+      return generation;
+
+    auto contentServer = itsGridEngine->getContentServer_sptr();
+
+    T::ProducerInfo producerInfo;
+    if (contentServer->getProducerInfoByName(0, theProducer, producerInfo) != 0)
+      return generation;
+
+    T::GenerationInfo generationInfo;
+    if (contentServer->getLastGenerationInfoByProducerIdAndStatus(
+            0, producerInfo.mProducerId, T::GenerationInfo::Status::Ready, generationInfo) != 0)
+      return generation;
+
+    generation.originTime = Fmi::TimeParser::parse_iso(generationInfo.mAnalysisTime);
+    generation.id = std::to_string(generationInfo.mGenerationId) + '/' +
+                    generationInfo.mAnalysisTime;
+    return generation;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!")
+        .addParameter("Source", theSource)
+        .addParameter("Producer", theProducer);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Identify querydata
+ *
+ * The generation must be taken from the same data that is rendered,
+ * otherwise a response rendered from old data may be cached as if it
+ * were based on newer data which arrived during the request.
+ */
+// ----------------------------------------------------------------------
+
+DataGeneration Plugin::getDataGeneration(const SmartMet::Engine::Querydata::Q &theQ) const
+{
+  try
+  {
+    DataGeneration generation;
+    generation.originTime = theQ->originTime();
+    generation.modificationTime = theQ->modificationTime();
+    generation.id = Fmi::to_iso_string(generation.originTime) + '/' +
+                    Fmi::to_iso_string(generation.modificationTime);
+    return generation;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Identify the data used by a query
+ *
+ * The generation is unknown if either the producer or the z-producer
+ * data cannot be identified.
+ */
+// ----------------------------------------------------------------------
+
+DataGeneration Plugin::getDataGeneration(const Query &theQuery) const
+{
+  try
+  {
+    const std::string source = (theQuery.source ? *theQuery.source : "querydata");
+
+    auto generation = getDataGeneration(source, theQuery.producer);
+    if (generation.id.empty() || !theQuery.zproducer || *theQuery.zproducer == theQuery.producer)
+      return generation;
+
+    auto zgeneration = getDataGeneration(source, *theQuery.zproducer);
+    if (zgeneration.id.empty())
+      generation.id.clear();
+    else
+      generation.id += ';' + zgeneration.id;
+
+    return generation;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Plan for sampling querydata along the route
+ *
+ * Routes along grid rows or columns, polyline routes, trajectories and
+ * inputs of expressions are always sampled by the plugin, other routes
+ * only if enabled in the configuration. The plans are cached by the route and the grid of
+ * the data.
+ */
+// ----------------------------------------------------------------------
+
+SamplingPlanPtr Plugin::getSamplingPlan(const Query &theQuery,
+                                        const SmartMet::Engine::Querydata::Q &theQ,
+                                        bool theRequired) const
+{
+  try
+  {
+    // Trajectories and expressions get a plan even if ordinary requests for
+    // the same route do not
+
+    const bool required = (theRequired || !theQuery.waypoint_times.empty());
+    const auto key = route_string(theQuery.waypoints) + ';' + Fmi::to_string(theQuery.steps) +
+                     ';' + Fmi::to_string(theQ->gridHashValue()) + (required ? ";r" : "");
+
+    auto cached = itsSamplingPlans.find(key);
+    if (cached)
+      return *cached;
+
+    // The contour engine handles only single segment routes
+
+    const auto &route = theQuery.waypoints;
+    auto info = theQ->info();
+
+    SamplingPlanPtr plan;
+    if (route.size() == 2)
+      plan = aligned_sampling_plan(*info,
+                                   route.front().longitude,
+                                   route.front().latitude,
+                                   route.back().longitude,
+                                   route.back().latitude);
+
+    if (!plan && (itsConfig.querydataSampling() || route.size() > 2 || required))
+      plan = sampling_plan(*info, route, theQuery.steps, itsConfig.columnResolution());
+
+    if (plan)
+      itsSamplingPlans.insert(key, plan);
+
+    return plan;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cache for columns sampled at quantized points
+ *
+ * The cache is useful only if the sample points are quantized.
+ */
+// ----------------------------------------------------------------------
+
+ColumnCache *Plugin::getColumnCache() const
+{
+  if (itsConfig.columnResolution() <= 0 || itsConfig.columnCacheSize() == 0)
+    return nullptr;
+  return &itsColumns;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Native grid spacing of the data of a producer
+ *
+ * The spacing is measured between the grid points nearest to the
+ * centre of the grid along both grid axes, and the smaller one is
+ * returned. Grid engine geometries are measured only once.
+ */
+// ----------------------------------------------------------------------
+
+std::optional<double> Plugin::getGridSpacing(const std::string &theSource,
+                                             const std::string &theProducer) const
+{
+  try
+  {
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::function<std::pair<double, double>(std::size_t)> lonlat;
+
+    auto spacing = [&]() -> std::optional<double>
+    {
+      if (width < 2 || height < 2)
+        return {};
+      const auto i = (height / 2 - 1) * width + (width / 2 - 1);
+      const auto p = lonlat(i);
+      const auto px = lonlat(i + 1);
+      const auto py = lonlat(i + width);
+      const auto dx = geodistance(p.first, p.second, px.first, px.second);
+      const auto dy = geodistance(p.first, p.second, py.first, py.second);
+      const auto ret = std::min(dx, dy);
+      if (!(ret > 0))
+        return {};
+      return ret;
+    };
+
+    if (theSource != "grid")
+    {
+      auto q = itsQEngine->get(theProducer);
+      auto info = q->info();
+      if (!info->IsGrid())
+        return {};
+      width = info->GridXNumber();
+      height = info->GridYNumber();
+      lonlat = [&info](std::size_t theIndex)
+      {
+        auto point = info->LatLon(theIndex);
+        return std::make_pair(point.X(), point.Y());
+      };
+      return spacing();
+    }
+
+    if (!itsGridEngine || !itsGridEngine->isEnabled())
+      return {};
+
+    auto contentServer = itsGridEngine->getContentServer_sptr();
+
+    T::ProducerInfo producerInfo;
+    if (contentServer->getProducerInfoByName(0, theProducer, producerInfo) != 0)
+      return {};
+
+    T::GenerationInfo generationInfo;
+    if (contentServer->getLastGenerationInfoByProducerIdAndStatus(
+            0, producerInfo.mProducerId, T::GenerationInfo::Status::Ready, generationInfo) != 0)
+      return {};
+
+    T::ContentInfoList contentInfoList;
+    if (contentServer->getContentListByGenerationId(
+            0, generationInfo.mGenerationId, 0, 0, 1, contentInfoList) != 0 ||
+        contentInfoList.getLength() == 0)
+      return {};
+
+    const auto geometryId = contentInfoList.getContentInfoByIndex(0)->mGeometryId;
+
+    {
+      std::lock_guard<std::mutex> lock(itsGridSpacingMutex);
+      auto it = itsGridSpacings.find(geometryId);
+      if (it != itsGridSpacings.end())
+        return it->second;
+    }
+
+    int cols = 0;
+    int rows = 0;
+    T::Coordinate_vec coordinates;
+    if (!Identification::gridDef.getGridDimensionsByGeometryId(geometryId, cols, rows) ||
+        !Identification::gridDef.getGridLatLonCoordinatesByGeometryId(geometryId, coordinates) ||
+        coordinates.size() != static_cast<std::size_t>(cols) * static_cast<std::size_t>(rows))
+      return {};
+
+    width = cols;
+    height = rows;
+    lonlat = [&coordinates](std::size_t theIndex)
+    { return std::make_pair(coordinates[theIndex].x(), coordinates[theIndex].y()); };
+
+    auto ret = spacing();
+    if (ret)
+    {
+      std::lock_guard<std::mutex> lock(itsGridSpacingMutex);
+      itsGridSpacings[geometryId] = *ret;
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!")
+        .addParameter("Source", theSource)
+        .addParameter("Producer", theProducer);
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Render a prewarm job or a refresh into the response cache
+ */
+// ----------------------------------------------------------------------
+
+void Plugin::prewarm(const Prewarmer::Job &theJob)
+{
+  try
+  {
+    SmartMet::Spine::HTTP::Request request;
+    for (const auto &param : theJob)
+      request.setParameter(param.first, param.second);
+
+    SmartMet::Spine::HTTP::Response response;
+    query(*itsReactor, request, response, true);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Refresh a stale response in the background
+ *
+ * A stale route of a batch request is refreshed as a batch of its own.
+ */
+// ----------------------------------------------------------------------
+
+void Plugin::refresh(const SmartMet::Spine::HTTP::Request &theRequest, const Waypoints *theRoute)
+{
+  try
+  {
+    if (!itsPrewarmer)
+      return;
+
+    Prewarmer::Job job;
+    for (const auto &param : theRequest.getParameterMap())
+      job.insert(param);
+    if (theRoute != nullptr)
+      job["route"] = route_string(*theRoute);
+    itsPrewarmer->submit(job);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Get template from the plugin cache
@@ -307,40 +1137,16 @@ void Plugin::requestHandler(SmartMet::Spine::Reactor &theReactor,
   {
     theResponse.setHeader("Access-Control-Allow-Origin", "*");
 
-    using Fmi::DateTime;
-
     const bool isdebug = SmartMet::Spine::optional_bool(theRequest.getParameter("debug"), false);
 
-    // Default expiration time
-
-    const int expires_seconds = 60;
-
-    // Now
-
-    Fmi::DateTime t_now = Fmi::SecondClock::universal_time();
-
     try
     {
+      // The query sets the cache headers based on the data
+
       std::string response = query(theReactor, theRequest, theResponse);
 
       theResponse.setStatus(SmartMet::Spine::HTTP::Status::ok);
 
-      // Build cache expiration time info
-
-      Fmi::DateTime t_expires = t_now + Fmi::Seconds(expires_seconds);
-
-      // The headers themselves
-
-      std::shared_ptr<Fmi::TimeFormatter> tformat(Fmi::TimeFormatter::create("http"));
-
-      std::string cachecontrol = "public, max-age=" + std::to_string(expires_seconds);
-      std::string expiration = tformat->format(t_expires);
-      std::string modification = tformat->format(t_now);
-
-      theResponse.setHeader("Cache-Control", cachecontrol);
-      theResponse.setHeader("Expires", expiration);
-      theResponse.setHeader("Last-Modified", modification);
-
       if (response.empty())
       {
         std::cerr << "Warning: Empty input for request " << theRequest.getQueryString() << " from "
@@ -356,6 +1162,28 @@ void Plugin::requestHandler(SmartMet::Spine::Reactor &theReactor,
       }
     }
 
+    catch (const DeadlineExceeded &e)
+    {
+      theResponse.setStatus(SmartMet::Spine::HTTP::Status::gateway_timeout);
+      theResponse.setHeader("X-CSection-Error", e.what());
+    }
+
+    catch (const AdmissionError &e)
+    {
+      // Overloads are temporary, too expensive requests exceed the quota of the customer
+
+      if (e.overload())
+      {
+        theResponse.setStatus(SmartMet::Spine::HTTP::Status::service_unavailable);
+        theResponse.setHeader("Retry-After", std::to_string(itsConfig.retryAfter()));
+      }
+      else
+      {
+        theResponse.setStatus(SmartMet::Spine::HTTP::Status::too_many_requests);
+      }
+      theResponse.setHeader("X-CSection-Error", e.what());
+    }
+
     catch (...)
     {
       Fmi::Exception exception(BCP, "Request processing exception!", nullptr);
@@ -395,7 +1223,16 @@ void Plugin::requestHandler(SmartMet::Spine::Reactor &theReactor,
 // ----------------------------------------------------------------------
 
 Plugin::Plugin(SmartMet::Spine::Reactor *theReactor, const char *theConfig)
-    : itsModuleName("CrossSection"), itsConfig(theConfig), itsReactor(theReactor)
+    : itsModuleName("CrossSection"),
+      itsConfig(theConfig),
+      itsReactor(theReactor),
+      itsAdmission(itsConfig.maxActiveRequests(),
+                   std::chrono::milliseconds(itsConfig.queueTimeout())),
+      itsLocationCache(itsConfig.locationCacheSize()),
+      itsResponseCache(itsConfig.memoryCacheSize()),
+      itsThreadPool(itsConfig.poolThreads()),
+      itsSamplingPlans(itsConfig.samplingPlanCacheSize()),
+      itsColumns(itsConfig.columnCacheSize())
 {
   try
   {
@@ -448,6 +1285,39 @@ void Plugin::init()
                    Spine::HTTP::Response &theResponse)
             { callRequestHandler(theReactor, theRequest, theResponse); }))
       throw Fmi::Exception(BCP, "Failed to register CSection content handler");
+
+    /* Persistent cache */
+
+    if (!itsConfig.diskCacheDirectory().empty())
+      itsDiskCache =
+          std::make_unique<DiskCache>(itsConfig.diskCacheDirectory(), itsConfig.diskCacheSize());
+
+    /* Background rendering is useful only if the responses are cached. The threads
+       are started only for prewarm jobs or when a stale response is first refreshed. */
+
+    if (itsConfig.memoryCacheSize() > 0 || itsDiskCache)
+    {
+      auto generation = [this](const Prewarmer::Job &theJob)
+      {
+        Query q;
+        q.producer = theJob.at("producer");
+        auto zproducer = theJob.find("zproducer");
+        if (zproducer != theJob.end())
+          q.zproducer = zproducer->second;
+        auto source = theJob.find("source");
+        if (source != theJob.end())
+          q.source = source->second;
+        return getDataGeneration(q).id;
+      };
+
+      itsPrewarmer = std::make_unique<Prewarmer>(
+          itsConfig.prewarmJobs(),
+          itsConfig.prewarmThreads(),
+          std::chrono::seconds(itsConfig.prewarmInterval()),
+          generation,
+          [this](const Prewarmer::Job &theJob) { prewarm(theJob); });
+      itsPrewarmer->start();
+    }
   }
   catch (...)
   {
@@ -464,6 +1334,9 @@ void Plugin::init()
 void Plugin::shutdown()
 {
   std::cout << "  -- Shutdown requested (csection)\n";
+  if (itsPrewarmer)
+    itsPrewarmer->stop();
+  itsThreadPool.stop();
 }
 
 // ----------------------------------------------------------------------
@@ -6,10 +6,21 @@
 
 #pragma once
 
+#include "Admission.h"
+#include "Coalescer.h"
 #include "Config.h"
+#include "DataGeneration.h"
+#include "DiskCache.h"
 #include "FileCache.h"
+#include "LocationCache.h"
+#include "LruCache.h"
+#include "Prewarmer.h"
 #include "Product.h"
+#include "Query.h"
+#include "ResponseCache.h"
+#include "Sampling.h"
 #include "TemplateFactory.h"
+#include "ThreadPool.h"
 #include <engines/contour/Engine.h>
 #include <engines/geonames/Engine.h>
 #include <engines/grid/Engine.h>
@@ -18,6 +29,9 @@
 #include <spine/Reactor.h>
 #include <spine/SmartMetPlugin.h>
 #include <spine/Thread.h>
+#include <map>
+#include <mutex>
+#include <optional>
 
 namespace SmartMet
 {
@@ -43,6 +57,13 @@ class Plugin : public SmartMetPlugin
   const SmartMet::Engine::Querydata::Engine& getQEngine() const { return *itsQEngine; }
   const SmartMet::Engine::Grid::Engine& getGridEngine() const { return *itsGridEngine; }
   const SmartMet::Engine::Contour::Engine& getContourEngine() const { return *itsContourEngine; }
+
+  // Persistent cache, or nullptr if disabled
+  DiskCache* getDiskCache() const { return itsDiskCache.get(); }
+
+  // Threads shared by all requests for parallel work
+  ThreadPool& getThreadPool() const { return itsThreadPool; }
+
   // Plugin specific public API:
 
   const Config& getConfig() const;
@@ -51,6 +72,27 @@ class Plugin : public SmartMetPlugin
                      const std::string& theName,
                      bool theDebugFlag) const;
 
+  // Identify the latest data of a producer
+  DataGeneration getDataGeneration(const std::string& theSource,
+                                   const std::string& theProducer) const;
+  DataGeneration getDataGeneration(const Query& theQuery) const;
+
+  // Identify the querydata actually used for rendering
+  DataGeneration getDataGeneration(const SmartMet::Engine::Querydata::Q& theQ) const;
+
+  // Plan for sampling querydata along the route of the query, or an empty
+  // pointer if the contour engine is to sample the data
+  SamplingPlanPtr getSamplingPlan(const Query& theQuery,
+                                  const SmartMet::Engine::Querydata::Q& theQ,
+                                  bool theRequired = false) const;
+
+  // Cache for sampled columns, or nullptr if disabled
+  ColumnCache* getColumnCache() const;
+
+  // Native grid spacing of the data of a producer in kilometers, if known
+  std::optional<double> getGridSpacing(const std::string& theSource,
+                                       const std::string& theProducer) const;
+
  protected:
   void init() override;
   void shutdown() override;
@@ -61,7 +103,14 @@ class Plugin : public SmartMetPlugin
  private:
   std::string query(SmartMet::Spine::Reactor& theReactor,
                     const SmartMet::Spine::HTTP::Request& theRequest,
-                    SmartMet::Spine::HTTP::Response& theResponse);
+                    SmartMet::Spine::HTTP::Response& theResponse,
+                    bool theRefresh = false);
+
+  // Render a request in the background
+  void prewarm(const Prewarmer::Job& theJob);
+  void refresh(const SmartMet::Spine::HTTP::Request& theRequest,
+               const Waypoints* theRoute = nullptr);
+
   // Plugin configuration
   const std::string itsModuleName;
   SmartMet::Plugin::CrossSection::Config itsConfig;
@@ -84,6 +133,37 @@ class Plugin : public SmartMetPlugin
   // Cache files
   mutable FileCache itsFileCache;
 
+  // Identical requests in flight
+  Coalescer<std::string> itsCoalescer;
+
+  // Limits the number of requests processed concurrently
+  AdmissionControl itsAdmission;
+
+  // Cache resolved route endpoints
+  LocationCache itsLocationCache;
+
+  // Cache generated responses
+  ResponseCache itsResponseCache;
+
+  // Persistent cache for responses and vertical grids
+  std::unique_ptr<DiskCache> itsDiskCache;
+
+  // Batch routes and ensemble members are processed by a shared pool
+  mutable ThreadPool itsThreadPool;
+
+  // Render popular products in advance and refresh stale responses
+  std::unique_ptr<Prewarmer> itsPrewarmer;
+
+  // Sampling plans shared by all requests
+  mutable LruCache<SamplingPlanPtr> itsSamplingPlans;
+
+  // Columns sampled at quantized points, shared by overlapping routes
+  mutable ColumnCache itsColumns;
+
+  // Grid spacings of grid engine geometries
+  mutable std::mutex itsGridSpacingMutex;
+  mutable std::map<T::GeometryId, double> itsGridSpacings;
+
 };  // class Plugin
 
 }  // namespace CrossSection
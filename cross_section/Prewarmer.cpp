@@ -0,0 +1,289 @@
+#include "Prewarmer.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// Index of jobs which are not configured prewarm jobs
+const std::size_t submitted_job = static_cast<std::size_t>(-1);
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Lower the scheduling priority of the calling thread
+ *
+ * On Linux the nice value is a per thread attribute.
+ */
+// ----------------------------------------------------------------------
+
+void lower_thread_priority()
+{
+#ifdef __linux__
+  auto tid = static_cast<id_t>(syscall(SYS_gettid));
+  if (setpriority(PRIO_PROCESS, tid, 19) != 0)
+    std::cerr << "Warning: Failed to lower the priority of the prewarm thread\n";
+#endif
+}
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+Prewarmer::Prewarmer(std::vector<Job> theJobs,
+                     std::size_t theThreads,
+                     std::chrono::seconds theInterval,
+                     Generation theGeneration,
+                     Render theRender)
+    : itsJobs(std::move(theJobs)),
+      itsThreadCount(std::max<std::size_t>(theThreads, 1)),
+      itsInterval(theInterval),
+      itsGeneration(std::move(theGeneration)),
+      itsRender(std::move(theRender)),
+      itsGenerations(itsJobs.size())
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Destructor stops the threads
+ */
+// ----------------------------------------------------------------------
+
+Prewarmer::~Prewarmer()
+{
+  try
+  {
+    stop();
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Failed to stop the prewarm threads").printError();
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start the poller and the workers
+ *
+ * Without prewarm jobs there is nothing to poll, and the workers are
+ * started only when the first stale response is submitted for refresh.
+ */
+// ----------------------------------------------------------------------
+
+void Prewarmer::start()
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    if (itsStarted)
+      return;
+    itsStarted = true;
+
+    if (!itsJobs.empty())
+    {
+      itsThreads.emplace_back([this] { poll(); });
+      startWorkers();
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Stop the threads. Jobs being rendered are finished first.
+ */
+// ----------------------------------------------------------------------
+
+void Prewarmer::stop()
+{
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsStopping = true;
+    itsQueue.clear();
+    threads.swap(itsThreads);
+  }
+  itsCondition.notify_all();
+
+  for (auto& thread : threads)
+    if (thread.joinable())
+      thread.join();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Render a job in the background
+ */
+// ----------------------------------------------------------------------
+
+void Prewarmer::submit(const Job& theJob)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    if (itsStopping || !itsStarted)
+      return;
+    startWorkers();
+    enqueue(theJob, submitted_job);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start the workers unless already running. The lock must be held.
+ */
+// ----------------------------------------------------------------------
+
+void Prewarmer::startWorkers()
+{
+  if (itsWorking)
+    return;
+  itsWorking = true;
+
+  for (std::size_t i = 0; i < itsThreadCount; i++)
+    itsThreads.emplace_back([this] { work(); });
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue a job unless it is already queued or being rendered
+ *
+ * Returns false if the job is being rendered, in which case it may be
+ * rendering the data it had before. The lock must be held.
+ */
+// ----------------------------------------------------------------------
+
+bool Prewarmer::enqueue(const Job& theJob, std::size_t theIndex)
+{
+  if (std::find(itsActive.begin(), itsActive.end(), theJob) != itsActive.end())
+    return false;
+
+  for (const auto& job : itsQueue)
+    if (job.first == theJob)
+      return true;
+
+  itsQueue.emplace_back(theJob, theIndex);
+  itsCondition.notify_all();
+  return true;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue the jobs whose data has changed
+ *
+ * A job being rendered is checked again on the next poll, since its
+ * rendering may have started before the data changed.
+ */
+// ----------------------------------------------------------------------
+
+void Prewarmer::poll()
+{
+  lower_thread_priority();
+
+  std::unique_lock<std::mutex> lock(itsMutex);
+  while (!itsStopping)
+  {
+    for (std::size_t i = 0; i < itsJobs.size() && !itsStopping; i++)
+    {
+      // Do not block the workers while querying the engines
+      lock.unlock();
+      std::string generation;
+      try
+      {
+        generation = itsGeneration(itsJobs[i]);
+      }
+      catch (...)
+      {
+        Fmi::Exception::Trace(BCP, "Failed to check the data of a prewarm job").printError();
+      }
+      lock.lock();
+
+      if (generation.empty() || generation == itsGenerations[i])
+        continue;
+
+      if (enqueue(itsJobs[i], i))
+        itsGenerations[i] = generation;
+    }
+
+    itsCondition.wait_for(lock, itsInterval, [this] { return itsStopping; });
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Render queued jobs
+ *
+ * A prewarm job records the generation of the data it was rendered
+ * from, so that the poller does not render it again for the same data.
+ */
+// ----------------------------------------------------------------------
+
+void Prewarmer::work()
+{
+  lower_thread_priority();
+
+  std::unique_lock<std::mutex> lock(itsMutex);
+  while (true)
+  {
+    itsCondition.wait(lock, [this] { return itsStopping || !itsQueue.empty(); });
+    if (itsStopping)
+      return;
+
+    auto job = itsQueue.front();
+    itsQueue.pop_front();
+    itsActive.push_back(job.first);
+
+    lock.unlock();
+    bool ok = false;
+    std::string generation;
+    try
+    {
+      if (job.second != submitted_job)
+        generation = itsGeneration(job.first);
+      itsRender(job.first);
+      ok = true;
+    }
+    catch (...)
+    {
+      Fmi::Exception::Trace(BCP, "Background rendering failed").printError();
+    }
+    lock.lock();
+
+    itsActive.erase(std::find(itsActive.begin(), itsActive.end(), job.first));
+
+    // Retry failed prewarm jobs on the next poll
+    if (job.second != submitted_job)
+    {
+      if (!ok)
+        itsGenerations[job.second].clear();
+      else if (!generation.empty())
+        itsGenerations[job.second] = generation;
+    }
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
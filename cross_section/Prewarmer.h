@@ -0,0 +1,91 @@
+// ======================================================================
+/*!
+ * \brief Background generation of popular products
+ *
+ * A poller checks periodically whether new data has arrived for the
+ * configured jobs, and low priority worker threads then render the
+ * jobs into the response cache before clients ask for them. The
+ * workers also refresh stale responses submitted by live requests, and
+ * are started only once there is work for them.
+ * The number of workers is kept small so that background work does
+ * not compete with live requests.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class Prewarmer
+{
+ public:
+  // Request parameters of a job
+  using Job = std::map<std::string, std::string>;
+
+  // Identifies the data of a job, an empty result means unknown
+  using Generation = std::function<std::string(const Job&)>;
+
+  // Renders a job into the cache
+  using Render = std::function<void(const Job&)>;
+
+  Prewarmer(std::vector<Job> theJobs,
+            std::size_t theThreads,
+            std::chrono::seconds theInterval,
+            Generation theGeneration,
+            Render theRender);
+
+  ~Prewarmer();
+  Prewarmer() = delete;
+  Prewarmer(const Prewarmer& other) = delete;
+  Prewarmer& operator=(const Prewarmer& other) = delete;
+  Prewarmer(Prewarmer&& other) = delete;
+  Prewarmer& operator=(Prewarmer&& other) = delete;
+
+  void start();
+  void stop();
+
+  // Render a job in the background unless it is already queued or being rendered
+  void submit(const Job& theJob);
+
+ private:
+  void poll();
+  void work();
+  bool enqueue(const Job& theJob, std::size_t theIndex);
+  void startWorkers();
+
+  const std::vector<Job> itsJobs;
+  const std::size_t itsThreadCount;
+  const std::chrono::seconds itsInterval;
+  const Generation itsGeneration;
+  const Render itsRender;
+
+  std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  bool itsStopping = false;
+  bool itsStarted = false;
+  bool itsWorking = false;  // workers are started on demand without prewarm jobs
+
+  std::vector<std::string> itsGenerations;            // last seen generation of each job
+  std::deque<std::pair<Job, std::size_t>> itsQueue;  // jobs and their indices waiting
+  std::vector<Job> itsActive;                         // jobs being rendered
+  std::vector<std::thread> itsThreads;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -1,5 +1,7 @@
 #include "Product.h"
 #include "Config.h"
+#include "Deadline.h"
+#include "Geodesy.h"
 #include "State.h"
 #include <boost/lexical_cast.hpp>
 #include <ctpp2/CDT.hpp>
@@ -7,61 +9,6 @@
 #include <macgyver/TimeParser.h>
 #include <spine/HTTP.h>
 
-namespace
-{
-// ----------------------------------------------------------------------
-/*!
- * \brief Distance between two points along earth surface
- *
- * \param theLon1 Longitude of point 1
- * \param theLat1 Latitude of point 1
- * \param theLon2 Longitude of point 2
- * \param theLat2 Latitude of point 2
- * \return The distance in kilometers
- *
- *  Haversine Formula (from R.W. Sinnott, "Virtues of the Haversine",
- *  Sky and Telescope, vol. 68, no. 2, 1984, p. 159)
- *  will give mathematically and computationally exact results. The
- *  intermediate result c is the great circle distance in radians. The
- *  great circle distance d will be in the same units as R.
- *
- *  When the two points are antipodal (on opposite sides of the Earth),
- *  the Haversine Formula is ill-conditioned, but the error, perhaps
- *  as large as 2 km (1 mi), is in the context of a distance near
- *  20,000 km (12,000 mi). Further, there is a possibility that roundoff
- *  errors might cause the value of sqrt(a) to exceed 1.0, which would
- *  cause the inverse sine to crash without the bulletproofing provided by
- *  the min() function.
- *
- * The code was taken from NFmiLocation::Distance
- */
-// ----------------------------------------------------------------------
-
-double torad(double theValue)
-{
-  return theValue * 3.14159265358979323846 / 180.0;
-}
-double geodistance(double theLon1, double theLat1, double theLon2, double theLat2)
-{
-  double lo1 = torad(theLon1);
-  double la1 = torad(theLat1);
-
-  double lo2 = torad(theLon2);
-  double la2 = torad(theLat2);
-
-  double dlon = lo2 - lo1;
-  double dlat = la2 - la1;
-  double sindlat = sin(dlat / 2);
-  double sindlon = sin(dlon / 2);
-
-  double a = sindlat * sindlat + cos(la1) * cos(la2) * sindlon * sindlon;
-  double help1 = sqrt(a);
-  double c = 2. * asin(std::min(1., help1));
-
-  return 6371.220 * c;
-}
-}  // namespace
-
 namespace SmartMet
 {
 namespace Plugin
@@ -81,6 +28,9 @@ void Product::init(const Json::Value& theJson, const Config& theConfig)
     if (!theJson.isObject())
       throw Fmi::Exception(BCP, "Product JSON is not a JSON object (name-value pairs)");
 
+    soft_ttl = theConfig.softTTL();
+    hard_ttl = theConfig.hardTTL();
+
     // Iterate through all the members
 
     const auto members = theJson.getMemberNames();
@@ -90,9 +40,16 @@ void Product::init(const Json::Value& theJson, const Config& theConfig)
 
       if (name == "layers")
         layers.init(json, theConfig);
+      else if (name == "soft_ttl")
+        soft_ttl = json.asInt();
+      else if (name == "hard_ttl")
+        hard_ttl = json.asInt();
       else
         throw Fmi::Exception(BCP, "Product does not have a setting named '" + name + "'");
     }
+
+    if (soft_ttl < 0 || hard_ttl < soft_ttl)
+      throw Fmi::Exception(BCP, "Invalid product soft_ttl or hard_ttl");
   }
   catch (...)
   {
@@ -121,10 +78,15 @@ void Product::generate(CTPP::CDT& theGlobals,
 
     for (const auto& time : theTimes)
     {
+      theState.checkDeadline();
       theState.time(time);
       layers.generate(theGlobals, theState);
     }
 
+    // Shared arcs for topology output
+
+    theState.generateTopology(theGlobals);
+
     // Generate bounding box
 
     const auto& env = theState.envelope();
@@ -137,12 +99,43 @@ void Product::generate(CTPP::CDT& theGlobals,
       theGlobals["bbox"]["ymax"] = env.MaxY;
     }
 
-    // Distance between the two points
+    // Length of the route
+
+    const auto& query = theState.query();
+    theGlobals["distance"] = route_length(query.waypoints);
 
-    theGlobals["distance"] = geodistance(theState.query().longitude1,
-                                         theState.query().latitude1,
-                                         theState.query().longitude2,
-                                         theState.query().latitude2);
+    // Report the route actually used if it was snapped, the positions
+    // of the joints of polyline routes and the times of trajectories
+
+    if (query.snapped || query.waypoints.size() > 2 || !query.waypoint_times.empty())
+    {
+      CTPP::CDT waypoints(CTPP::CDT::ARRAY_VAL);
+      double distance = 0;
+      for (std::size_t i = 0; i < query.waypoints.size(); i++)
+      {
+        const auto& point = query.waypoints[i];
+        if (i > 0)
+          distance += geodistance(query.waypoints[i - 1].longitude,
+                                  query.waypoints[i - 1].latitude,
+                                  point.longitude,
+                                  point.latitude);
+        CTPP::CDT hash(CTPP::CDT::HASH_VAL);
+        hash["longitude"] = point.longitude;
+        hash["latitude"] = point.latitude;
+        hash["distance"] = distance;
+        if (!query.waypoint_times.empty())
+          hash["time"] = Fmi::to_iso_extended_string(query.waypoint_times[i]) + "Z";
+        waypoints.PushBack(hash);
+      }
+
+      theGlobals["route"] = CTPP::CDT(CTPP::CDT::HASH_VAL);
+      theGlobals["route"]["waypoints"] = waypoints;
+      theGlobals["route"]["steps"] = static_cast<long long>(query.steps);
+    }
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
   }
   catch (...)
   {
@@ -31,6 +31,10 @@ class Product
 
   Layers layers;
 
+  // Response cache times to live in seconds
+  int soft_ttl = 0;
+  int hard_ttl = 0;
+
  private:
 };  // class Product
 
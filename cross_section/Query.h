@@ -6,8 +6,12 @@
 
 #pragma once
 
+#include "Geodesy.h"
+#include <macgyver/DateTime.h>
+#include <chrono>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace SmartMet
 {
@@ -22,14 +26,18 @@ struct Query
   std::optional<std::string> zproducer;  // the z-producer
   std::optional<std::string> source;
 
-  double longitude1 = 0;  // cross section start point
-  double latitude1 = 0;
-  double longitude2 = 0;  // cross section end point
-  double latitude2 = 0;
-  std::size_t steps = 0;  // how many steps to take on the iso circle
+  Waypoints waypoints;    // the route, at least the start and end points
+  std::size_t steps = 0;  // how many steps to take along the route
+  bool snapped = false;   // the route was canonicalized by a snapping policy
+
+  std::vector<Fmi::DateTime> waypoint_times;  // valid times at the waypoints of a trajectory
 
   std::string timezone;  // timezone for the timestamps
 
+  bool topology = false;  // output shared arcs instead of SVG paths
+
+  std::optional<std::chrono::steady_clock::time_point> deadline;  // when to abandon the request
+
   bool timer = false;  // print debugging information on timings
 };
 
@@ -0,0 +1,283 @@
+#include "RasterLayer.h"
+#include "Config.h"
+#include "Deadline.h"
+#include "State.h"
+#include <boost/timer/timer.hpp>
+#include <ctpp2/CDT.hpp>
+#include <grid-files/common/GeneralDefinitions.h>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Base64 encode binary data
+ */
+// ----------------------------------------------------------------------
+
+std::string base64(const std::string& theData)
+{
+  static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  std::string ret;
+  ret.reserve(4 * ((theData.size() + 2) / 3));
+
+  const auto* data = reinterpret_cast<const unsigned char*>(theData.data());
+  const std::size_t n = theData.size();
+  std::size_t i = 0;
+  for (; i + 2 < n; i += 3)
+  {
+    const std::uint32_t bits = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    ret += chars[(bits >> 18) & 63];
+    ret += chars[(bits >> 12) & 63];
+    ret += chars[(bits >> 6) & 63];
+    ret += chars[bits & 63];
+  }
+
+  if (i < n)
+  {
+    const std::uint32_t bits = (data[i] << 16) | (i + 1 < n ? data[i + 1] << 8 : 0);
+    ret += chars[(bits >> 18) & 63];
+    ret += chars[(bits >> 12) & 63];
+    ret += (i + 1 < n ? chars[(bits >> 6) & 63] : '=');
+    ret += '=';
+  }
+  return ret;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Quantize values to little endian unsigned integers
+ */
+// ----------------------------------------------------------------------
+
+std::string quantize(const std::vector<float>& theValues,
+                     unsigned int theBits,
+                     double theScale,
+                     double theBase)
+{
+  const std::uint32_t missing = (theBits == 8 ? 0xFF : 0xFFFF);
+  const auto maxcode = static_cast<float>(missing - 1);
+  const auto scale = static_cast<float>(1.0 / theScale);
+  const auto base = static_cast<float>(theBase);
+
+  std::vector<std::uint32_t> codes(theValues.size());
+  for (std::size_t i = 0; i < theValues.size(); i++)
+  {
+    const float value = theValues[i];
+    const float code = std::min(maxcode, std::max(0.0F, std::round((value - base) * scale)));
+    codes[i] = (value == ParamValueMissing ? missing : static_cast<std::uint32_t>(code));
+  }
+
+  std::string ret;
+  ret.reserve(codes.size() * theBits / 8);
+  for (const auto code : codes)
+  {
+    ret += static_cast<char>(code & 0xFF);
+    if (theBits == 16)
+      ret += static_cast<char>(code >> 8);
+  }
+  return ret;
+}
+
+// Round for output
+std::string format(double theValue)
+{
+  return Fmi::to_string(std::round(theValue * 1000) / 1000);
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+RasterLayer::RasterLayer() : interpolation("linear") {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Initialize from JSON
+ */
+// ----------------------------------------------------------------------
+
+void RasterLayer::init(const Json::Value& theJson, const Config& theConfig)
+{
+  try
+  {
+    if (!theJson.isObject())
+      throw Fmi::Exception(BCP, "Raster-layer JSON is not a JSON object");
+
+    // Iterate through all the members
+
+    const auto members = theJson.getMemberNames();
+    for (const auto& name : members)
+    {
+      const Json::Value& json = theJson[name];
+
+      if (Layer::init(name, json, theConfig))
+        ;
+      else if (name == "parameter")
+        parameter = json.asString();
+      else if (name == "zparameter")
+        zparameter = json.asString();
+      else if (name == "interpolation")
+        interpolation = json.asString();
+      else if (name == "multiplier")
+        multiplier = json.asDouble();
+      else if (name == "offset")
+        offset = json.asDouble();
+      else if (name == "ensemble")
+      {
+        ensemble = Ensemble();
+        ensemble->init(json);
+      }
+      else if (name == "bits")
+        bits = json.asUInt();
+      else if (name == "scale")
+        scale = json.asDouble();
+      else if (name == "base")
+        base = json.asDouble();
+      else
+        throw Fmi::Exception(BCP, "Raster-layer does not have a setting named '" + name + "'");
+    }
+
+    if (bits != 8 && bits != 16)
+      throw Fmi::Exception(BCP, "Raster-layer bits must be 8 or 16");
+    if (scale.has_value() != base.has_value())
+      throw Fmi::Exception(BCP, "Raster-layer scale and base must be given together");
+    if (scale && *scale <= 0)
+      throw Fmi::Exception(BCP, "Raster-layer scale must be positive");
+
+    if (parameter)
+    {
+      contours = std::make_shared<ContourGroup>(
+          *parameter, zparameter, interpolation, multiplier, offset, ensemble);
+      contours->requireGrid();
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate the layer details into the template hash
+ *
+ * The values are in row-major order, one row per level in the order of
+ * the grid. The vertical coordinates are given per level if they are
+ * the same for all columns, otherwise per point.
+ */
+// ----------------------------------------------------------------------
+
+void RasterLayer::generate(CTPP::CDT& theGlobals, State& theState)
+{
+  try
+  {
+    std::unique_ptr<boost::timer::auto_cpu_timer> timer;
+    if (theState.query().timer)
+    {
+      std::string report = "RasterLayer::generate finished in %t sec CPU, %w sec real\n";
+      timer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
+    }
+
+    if (parameter == std::nullopt || !contours)
+      throw Fmi::Exception(BCP, "Parameter not set for raster-layer");
+
+    auto grid = contours->verticalGrid(theState);
+    if (!grid)
+      throw Fmi::Exception(BCP, "Raster-layer requires gridded data and linear interpolation");
+
+    const uint width = grid->width;
+    const uint height = grid->height;
+    const auto& coordinates = grid->coordinates;
+
+    // Spread the range of the data over all codes unless fixed
+
+    double s = (scale ? *scale : 1.0);
+    double b = (base ? *base : 0.0);
+    if (!scale)
+    {
+      auto lo = std::numeric_limits<float>::max();
+      auto hi = std::numeric_limits<float>::lowest();
+      for (const auto value : grid->values)
+      {
+        if (value == ParamValueMissing)
+          continue;
+        lo = std::min(lo, value);
+        hi = std::max(hi, value);
+      }
+      if (lo <= hi)
+      {
+        const double codes = (bits == 8 ? 0xFE : 0xFFFE);
+        b = lo;
+        s = (hi > lo ? (hi - lo) / codes : 1.0);
+      }
+    }
+
+    std::string x = "[";
+    for (uint col = 0; col < width; col++)
+    {
+      if (col > 0)
+        x += ',';
+      x += format(coordinates[col].x());
+    }
+    x += ']';
+
+    bool levels = true;
+    for (uint row = 0; row < height && levels; row++)
+      for (uint col = 1; col < width && levels; col++)
+        levels = (coordinates[row * width + col].y() == coordinates[row * width].y());
+
+    const uint ycolumns = (levels ? std::min(width, 1U) : width);
+    std::string y = "[";
+    for (uint row = 0; row < height; row++)
+      for (uint col = 0; col < ycolumns; col++)
+      {
+        if (y.size() > 1)
+          y += ',';
+        y += format(coordinates[row * width + col].y());
+      }
+    y += ']';
+
+    std::string raster = "{\"width\":" + Fmi::to_string(static_cast<unsigned long>(width)) +
+                         ",\"height\":" + Fmi::to_string(static_cast<unsigned long>(height)) +
+                         ",\"bits\":" + Fmi::to_string(static_cast<unsigned long>(bits)) +
+                         ",\"scale\":" + Fmi::to_string(s) + ",\"base\":" + Fmi::to_string(b) +
+                         ",\"missing\":" + Fmi::to_string(bits == 8 ? 0xFF : 0xFFFF) +
+                         ",\"x\":" + x + ",\"y\":" + y + ",\"values\":\"" +
+                         base64(quantize(grid->values, bits, s, b)) + "\"}";
+
+    CTPP::CDT hash(CTPP::CDT::HASH_VAL);
+    theState.addAttributes(theGlobals, hash, attributes);
+    hash["raster"] = raster;
+    theState.addRecord(theGlobals, theState.timeKey(), "rasters", *parameter, hash);
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
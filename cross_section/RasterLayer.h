@@ -0,0 +1,62 @@
+// ======================================================================
+/*!
+ * \brief Raster layer
+ *
+ * Outputs the vertical grid itself instead of contours so that clients
+ * can shade dense fields themselves. The values are quantized to 8 or
+ * 16 bit unsigned integers and base64 encoded, and are accompanied by
+ * the distances of the columns and the vertical coordinates.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "ContourGroup.h"
+#include "Ensemble.h"
+#include "Layer.h"
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class Config;
+class State;
+
+class RasterLayer : public Layer
+{
+ public:
+  RasterLayer();
+
+  void init(const Json::Value& theJson, const Config& theConfig) override;
+
+  void generate(CTPP::CDT& theGlobals, State& theState) override;
+
+  std::optional<std::string> parameter;
+  std::optional<std::string> zparameter;
+  std::string interpolation;
+
+  std::optional<double> multiplier;
+  std::optional<double> offset;
+
+  std::optional<Ensemble> ensemble;
+
+  // Quantization: value = base + scale * code. By default the range of
+  // the data is spread over all codes. The largest code marks missing values.
+  unsigned int bits = 8;
+  std::optional<double> scale;
+  std::optional<double> base;
+
+  // Shares the grid with other layers using the same data
+  std::shared_ptr<ContourGroup> contours;
+
+ private:
+};  // class RasterLayer
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,153 @@
+#include "ResponseCache.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+ResponseCache::ResponseCache(std::size_t theMaxSize) : itsMaxSize(theMaxSize) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find a cached response
+ *
+ * Expired responses are not returned. Stale responses are returned,
+ * and the first caller after the response became stale is asked to
+ * refresh it. If the refresh does not arrive within the soft TTL,
+ * the next caller is asked to refresh again. Responses of older data
+ * expire once the soft TTL has passed since the new data was first
+ * requested, and are then regenerated by the caller.
+ */
+// ----------------------------------------------------------------------
+
+ResponseCache::Lookup ResponseCache::find(const std::string& theKey,
+                                          const std::string& theGeneration,
+                                          std::chrono::seconds theSoftTTL,
+                                          std::chrono::seconds theHardTTL)
+{
+  try
+  {
+    Lookup lookup;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto it = itsIndex.find(theKey);
+    if (it == itsIndex.end())
+      return lookup;
+
+    auto& entry = *it->second;
+    const auto now = Clock::now();
+    const auto age = now - entry.created;
+
+    if (age >= theHardTTL)
+      return lookup;
+
+    if (entry.generation != theGeneration)
+    {
+      if (!entry.superseded)
+      {
+        entry.superseded = now;
+        entry.refreshed.reset();
+      }
+      if (now - *entry.superseded >= theSoftTTL)
+        return lookup;
+    }
+
+    itsEntries.splice(itsEntries.begin(), itsEntries, it->second);
+    lookup.response = entry.response;
+
+    const bool fresh = (entry.generation == theGeneration && age < theSoftTTL);
+    lookup.stale = !fresh;
+    if (!fresh && (!entry.refreshed || now - *entry.refreshed >= theSoftTTL))
+    {
+      entry.refreshed = now;
+      lookup.refresh = true;
+    }
+
+    return lookup;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cache a response
+ *
+ * Responses larger than the whole cache are not cached.
+ */
+// ----------------------------------------------------------------------
+
+void ResponseCache::insert(const std::string& theKey,
+                           const std::string& theResponse,
+                           const std::string& theGeneration,
+                           std::chrono::seconds theAge)
+{
+  try
+  {
+    if (theResponse.size() > itsMaxSize)
+      return;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+    auto it = itsIndex.find(theKey);
+    if (it != itsIndex.end())
+    {
+      itsSize -= it->second->response.size();
+      itsEntries.erase(it->second);
+      itsIndex.erase(it);
+    }
+
+    const auto created = Clock::now() - theAge;
+    itsEntries.push_front(
+        Entry{theKey, theResponse, theGeneration, created, std::nullopt, std::nullopt});
+    itsIndex[theKey] = itsEntries.begin();
+    itsSize += theResponse.size();
+    evict();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Evict the least recently used responses until the cache fits its limit
+ */
+// ----------------------------------------------------------------------
+
+void ResponseCache::evict()
+{
+  while (itsSize > itsMaxSize && !itsEntries.empty())
+  {
+    const auto& entry = itsEntries.back();
+    itsSize -= entry.response.size();
+    itsIndex.erase(entry.key);
+    itsEntries.pop_back();
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Total size of the cached responses
+ */
+// ----------------------------------------------------------------------
+
+std::size_t ResponseCache::size() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsSize;
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
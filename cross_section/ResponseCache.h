@@ -0,0 +1,85 @@
+// ======================================================================
+/*!
+ * \brief Memory cache for generated responses
+ *
+ * The responses are keyed by the canonical request key and stored
+ * together with the generation of the data they were generated from.
+ * A response is fresh while the data has not changed and its age is
+ * below the soft TTL. Stale responses are still served until the hard
+ * TTL while a single background refresh regenerates them. Responses of
+ * replaced data are served only for the soft TTL after the new data was
+ * first requested, so that a failing refresh cannot hide new data for
+ * long. Responses are evicted in least recently used order once the
+ * cache is full.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class ResponseCache
+{
+ public:
+  explicit ResponseCache(std::size_t theMaxSize);
+
+  struct Lookup
+  {
+    std::optional<std::string> response;
+    bool stale = false;    // the response is no longer fresh
+    bool refresh = false;  // the caller should refresh the stale response
+  };
+
+  Lookup find(const std::string& theKey,
+              const std::string& theGeneration,
+              std::chrono::seconds theSoftTTL,
+              std::chrono::seconds theHardTTL);
+
+  // The age is nonzero for responses loaded from a persistent cache
+  void insert(const std::string& theKey,
+              const std::string& theResponse,
+              const std::string& theGeneration,
+              std::chrono::seconds theAge = std::chrono::seconds(0));
+
+  // Total size of the cached responses in bytes
+  std::size_t size() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry
+  {
+    std::string key;
+    std::string response;
+    std::string generation;
+    Clock::time_point created;
+    std::optional<Clock::time_point> refreshed;   // when a refresh was last requested
+    std::optional<Clock::time_point> superseded;  // when newer data was first requested
+  };
+
+  using Entries = std::list<Entry>;
+
+  void evict();
+
+  const std::size_t itsMaxSize;
+  mutable std::mutex itsMutex;
+  Entries itsEntries;  // most recently used first
+  std::unordered_map<std::string, Entries::iterator> itsIndex;
+  std::size_t itsSize = 0;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,649 @@
+#include "Sampling.h"
+#include "Geodesy.h"
+#include "Snapping.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <newbase/NFmiFastQueryInfo.h>
+#include <newbase/NFmiGlobals.h>
+#include <newbase/NFmiGrid.h>
+#include <newbase/NFmiMetTime.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+// Maximum distance of an aligned route from the grid points in grid cells
+const double aligned_tolerance = 0.01;
+
+const double deg2rad = 3.14159265358979323846 / 180.0;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Grid point index of a grid coordinate, if within tolerance
+ */
+// ----------------------------------------------------------------------
+
+std::optional<long> grid_index(double theCoordinate, unsigned long theSize)
+{
+  const double index = std::round(theCoordinate);
+  if (std::abs(theCoordinate - index) > aligned_tolerance || index < 0 ||
+      index >= static_cast<double>(theSize))
+    return {};
+  return static_cast<long>(index);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Interpolate the value of the current parameter and level at a point
+ */
+// ----------------------------------------------------------------------
+
+float interpolate(NFmiFastQueryInfo& theInfo, const SamplePoint& thePoint)
+{
+  if (!thePoint.inside)
+    return kFloatMissing;
+
+  float sum = 0;
+  for (std::size_t i = 0; i < thePoint.indices.size(); i++)
+  {
+    if (thePoint.weights[i] == 0)
+      continue;
+    theInfo.LocationIndex(thePoint.indices[i]);
+    const float value = theInfo.FloatValue();
+    if (value == kFloatMissing)
+      return kFloatMissing;
+    sum += thePoint.weights[i] * value;
+  }
+  return sum;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * rief Interpolate a direction in degrees at a point
+ *
+ * The unit vectors of the directions are interpolated instead of the
+ * angles, which would wrap around incorrectly at north.
+ */
+// ----------------------------------------------------------------------
+
+float interpolate_direction(NFmiFastQueryInfo& theInfo, const SamplePoint& thePoint)
+{
+  if (!thePoint.inside)
+    return kFloatMissing;
+
+  double x = 0;
+  double y = 0;
+  for (std::size_t i = 0; i < thePoint.indices.size(); i++)
+  {
+    if (thePoint.weights[i] == 0)
+      continue;
+    theInfo.LocationIndex(thePoint.indices[i]);
+    const float value = theInfo.FloatValue();
+    if (value == kFloatMissing)
+      return kFloatMissing;
+    x += thePoint.weights[i] * std::sin(value * deg2rad);
+    y += thePoint.weights[i] * std::cos(value * deg2rad);
+  }
+  return static_cast<float>(std::fmod(std::atan2(x, y) / deg2rad + 360.0, 360.0));
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample a column unless it is already in the cache
+ *
+ * The time of the data is set only if the column has to be sampled,
+ * otherwise the time must have been set already.
+ */
+// ----------------------------------------------------------------------
+
+ColumnPtr cached_column(NFmiFastQueryInfo& theInfo,
+                        const SamplePoint& thePoint,
+                        unsigned long theParameter,
+                        std::optional<unsigned long> theZParameter,
+                        double theMultiplier,
+                        double theOffset,
+                        ColumnCache* theCache,
+                        const std::string& theCacheKey,
+                        bool theDirection,
+                        const std::optional<Fmi::DateTime>& theTime = std::nullopt)
+{
+  std::string key;
+  if (theCache != nullptr)
+  {
+    key = theCacheKey + ';' + Fmi::to_string(thePoint.longitude) + ',' +
+          Fmi::to_string(thePoint.latitude);
+    auto cached = theCache->find(key);
+    if (cached)
+      return *cached;
+  }
+
+  if (theTime && !theInfo.Time(NFmiMetTime(*theTime)))
+    return {};
+
+  auto column = sample_column(
+      theInfo, thePoint, theParameter, theZParameter, theMultiplier, theOffset, theDirection);
+  if (column && theCache != nullptr)
+    theCache->insert(key, column);
+  return column;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Linear interpolation between two columns
+ *
+ * Directions are interpolated along the circle.
+ */
+// ----------------------------------------------------------------------
+
+ColumnPtr blend_columns(const Column& theFirst,
+                        const Column& theSecond,
+                        float theWeight,
+                        bool theDirection)
+{
+  const auto n = theFirst.values.size();
+  auto column = std::make_shared<Column>();
+  column->values.resize(n);
+  column->heights.resize(n);
+
+  for (std::size_t i = 0; i < n; i++)
+  {
+    const float v1 = theFirst.values[i];
+    const float v2 = theSecond.values[i];
+    if (v1 == ParamValueMissing || v2 == ParamValueMissing)
+      column->values[i] = ParamValueMissing;
+    else if (!theDirection)
+      column->values[i] = (1 - theWeight) * v1 + theWeight * v2;
+    else
+    {
+      // Turn the shorter way from the first direction to the second one
+      const double turn = std::remainder(static_cast<double>(v2) - v1, 360.0);
+      column->values[i] = static_cast<float>(std::fmod(v1 + theWeight * turn + 360.0, 360.0));
+    }
+    column->heights[i] = (1 - theWeight) * theFirst.heights[i] + theWeight * theSecond.heights[i];
+  }
+  return column;
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sampling plan for bilinear interpolation along the route
+ *
+ * The points are spaced equally along the great circle segments of the
+ * route, the waypoints included. The steps are distributed to the
+ * segments in proportion to their lengths, and the distances of the
+ * points are measured along the whole route. If a resolution is given, the points are moved
+ * to the nearest multiple of it so that overlapping routes share
+ * their columns. The distances along the route are not changed.
+ */
+// ----------------------------------------------------------------------
+
+SamplingPlanPtr sampling_plan(const NFmiFastQueryInfo& theInfo,
+                              const Waypoints& theWaypoints,
+                              std::size_t theSteps,
+                              double theResolution)
+{
+  try
+  {
+    if (!theInfo.IsGrid() || theSteps == 0 || theWaypoints.size() < 2)
+      return {};
+
+    const auto* grid = theInfo.Grid();
+    const auto width = grid->XNumber();
+    const auto height = grid->YNumber();
+    if (width < 2 || height < 2)
+      return {};
+
+    // Sample points along each segment, the joints only once
+
+    std::vector<std::pair<double, double>> lonlats;
+    std::vector<double> distances;
+
+    const auto steps = segment_steps(theWaypoints, theSteps);
+    double offset = 0;
+    for (std::size_t s = 0; s < steps.size(); s++)
+    {
+      if (steps[s] == 0)
+        continue;
+
+      const auto& p1 = theWaypoints[s];
+      const auto& p2 = theWaypoints[s + 1];
+      const double distance = geodistance(p1.longitude, p1.latitude, p2.longitude, p2.latitude);
+      for (std::size_t k = (lonlats.empty() ? 0 : 1); k <= steps[s]; k++)
+      {
+        const double fraction = static_cast<double>(k) / static_cast<double>(steps[s]);
+        lonlats.push_back(
+            intermediate_point(p1.longitude, p1.latitude, p2.longitude, p2.latitude, fraction));
+        distances.push_back(offset + fraction * distance);
+      }
+      offset += distance;
+    }
+
+    if (lonlats.size() < 2)
+      return {};
+
+    auto plan = std::make_shared<SamplingPlan>();
+    plan->points.reserve(lonlats.size());
+
+    for (std::size_t k = 0; k < lonlats.size(); k++)
+    {
+      SamplePoint point;
+      point.longitude = snap_coordinate(lonlats[k].first, theResolution);
+      point.latitude = snap_coordinate(lonlats[k].second, theResolution);
+      point.distance = distances[k];
+
+      const auto xy = grid->LatLonToGrid(NFmiPoint(point.longitude, point.latitude));
+      const double x = xy.X();
+      const double y = xy.Y();
+
+      if (x >= 0 && y >= 0 && x <= width - 1 && y <= height - 1)
+      {
+        const auto i = std::min(static_cast<unsigned long>(x), width - 2);
+        const auto j = std::min(static_cast<unsigned long>(y), height - 2);
+        const auto fx = static_cast<float>(x - i);
+        const auto fy = static_cast<float>(y - j);
+
+        point.inside = true;
+        point.indices = {
+            j * width + i, j * width + i + 1, (j + 1) * width + i, (j + 1) * width + i + 1};
+        point.weights = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+      }
+
+      plan->points.push_back(point);
+    }
+
+    return plan;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sampling plan for a route along a grid row or column
+ *
+ * Both endpoints must be grid points on the same row or column, and
+ * the grid points in between must lie on the great circle through the
+ * endpoints. This holds for example for meridians on a latlon grid.
+ */
+// ----------------------------------------------------------------------
+
+SamplingPlanPtr aligned_sampling_plan(const NFmiFastQueryInfo& theInfo,
+                                      double theLon1,
+                                      double theLat1,
+                                      double theLon2,
+                                      double theLat2)
+{
+  try
+  {
+    if (!theInfo.IsGrid())
+      return {};
+
+    const auto* grid = theInfo.Grid();
+    const auto width = grid->XNumber();
+    const auto height = grid->YNumber();
+
+    const auto p1 = grid->LatLonToGrid(NFmiPoint(theLon1, theLat1));
+    const auto p2 = grid->LatLonToGrid(NFmiPoint(theLon2, theLat2));
+
+    const auto i1 = grid_index(p1.X(), width);
+    const auto j1 = grid_index(p1.Y(), height);
+    const auto i2 = grid_index(p2.X(), width);
+    const auto j2 = grid_index(p2.Y(), height);
+
+    if (!i1 || !j1 || !i2 || !j2)
+      return {};
+    if ((*i1 != *i2 && *j1 != *j2) || (*i1 == *i2 && *j1 == *j2))
+      return {};
+
+    const long di = (*i2 > *i1 ? 1 : (*i2 < *i1 ? -1 : 0));
+    const long dj = (*j2 > *j1 ? 1 : (*j2 < *j1 ? -1 : 0));
+    const long n = std::max(std::abs(*i2 - *i1), std::abs(*j2 - *j1)) + 1;
+
+    auto plan = std::make_shared<SamplingPlan>();
+    plan->aligned = true;
+    plan->points.reserve(n);
+
+    for (long k = 0; k < n; k++)
+    {
+      const auto index = static_cast<unsigned long>((*j1 + k * dj) * width + (*i1 + k * di));
+      const auto latlon = theInfo.LatLon(index);
+
+      SamplePoint point;
+      point.longitude = latlon.X();
+      point.latitude = latlon.Y();
+      point.indices.fill(index);
+      point.weights[0] = 1;
+      point.inside = true;
+
+      if (k > 0)
+      {
+        const auto& first = plan->points.front();
+        const auto& previous = plan->points.back();
+        point.distance = geodistance(first.longitude, first.latitude, latlon.X(), latlon.Y());
+
+        // Grid rows are not necessarily great circles
+
+        const double spacing =
+            geodistance(previous.longitude, previous.latitude, latlon.X(), latlon.Y());
+        if (crosstrack_distance(theLon1, theLat1, theLon2, theLat2, latlon.X(), latlon.Y()) >
+            aligned_tolerance * spacing)
+          return {};
+      }
+
+      plan->points.push_back(point);
+    }
+
+    return plan;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample all levels of a parameter at a point
+ *
+ * The time of the data must have been set. Missing values are marked
+ * with ParamValueMissing as in grid engine data, and values without a
+ * vertical coordinate are missing too.
+ */
+// ----------------------------------------------------------------------
+
+ColumnPtr sample_column(NFmiFastQueryInfo& theInfo,
+                        const SamplePoint& thePoint,
+                        unsigned long theParameter,
+                        std::optional<unsigned long> theZParameter,
+                        double theMultiplier,
+                        double theOffset,
+                        bool theDirection)
+{
+  try
+  {
+    const auto n = theInfo.SizeLevels();
+    auto column = std::make_shared<Column>();
+    column->values.resize(n, ParamValueMissing);
+    column->heights.resize(n);
+    std::vector<char> valid(n, 1);
+
+    if (theZParameter && !theInfo.Param(static_cast<FmiParameterName>(*theZParameter)))
+      return {};
+
+    std::size_t row = 0;
+    for (theInfo.ResetLevel(); theInfo.NextLevel(); ++row)
+    {
+      column->heights[row] = theInfo.Level()->LevelValue();
+      if (theZParameter)
+      {
+        const float z = interpolate(theInfo, thePoint);
+        if (z != kFloatMissing)
+          column->heights[row] = z;
+        else
+          valid[row] = 0;
+      }
+    }
+
+    if (!theInfo.Param(static_cast<FmiParameterName>(theParameter)))
+      return {};
+
+    row = 0;
+    for (theInfo.ResetLevel(); theInfo.NextLevel(); ++row)
+    {
+      if (valid[row] == 0)
+        continue;
+      const float value = (theDirection ? interpolate_direction(theInfo, thePoint)
+                                        : interpolate(theInfo, thePoint));
+      if (value != kFloatMissing)
+        column->values[row] = static_cast<float>(theMultiplier * value + theOffset);
+    }
+
+    return column;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample all levels of a parameter along the route
+ *
+ * The grid is assembled from the columns at the sample points. If a
+ * cache is given, columns found in it are reused and only the missing
+ * ones are sampled. The cache key identifies the data, parameter and
+ * time, the position of the point is appended to it.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr sample_vertical_grid(NFmiFastQueryInfo& theInfo,
+                                     const SamplingPlan& thePlan,
+                                     unsigned long theParameter,
+                                     std::optional<unsigned long> theZParameter,
+                                     const NFmiMetTime& theTime,
+                                     double theMultiplier,
+                                     double theOffset,
+                                     ColumnCache* theCache,
+                                     const std::string& theCacheKey,
+                                     bool theDirection)
+{
+  try
+  {
+    if (!theInfo.Time(theTime))
+      return {};
+
+    auto grid = std::make_shared<VerticalGrid>();
+    grid->width = thePlan.points.size();
+    grid->height = theInfo.SizeLevels();
+    grid->values.resize(grid->width * grid->height);
+    grid->coordinates.resize(grid->width * grid->height);
+
+    for (std::size_t col = 0; col < grid->width; col++)
+    {
+      const auto& point = thePlan.points[col];
+
+      auto column = cached_column(theInfo,
+                                  point,
+                                  theParameter,
+                                  theZParameter,
+                                  theMultiplier,
+                                  theOffset,
+                                  theCache,
+                                  theCacheKey,
+                                  theDirection);
+      if (!column)
+        return {};
+
+      for (std::size_t row = 0; row < grid->height; row++)
+      {
+        const auto pos = row * grid->width + col;
+        grid->values[pos] = column->values[row];
+        grid->coordinates[pos] = T::Coordinate(point.distance, column->heights[row]);
+      }
+    }
+
+    return grid;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Valid times of the sample points of a trajectory
+ *
+ * The time at each sample point is interpolated linearly from the times
+ * at the ends of its segment by the distance along the route.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<Fmi::DateTime> trajectory_times(const SamplingPlan& thePlan,
+                                            const Waypoints& theWaypoints,
+                                            const std::vector<Fmi::DateTime>& theTimes)
+{
+  try
+  {
+    if (theTimes.size() != theWaypoints.size() || theWaypoints.size() < 2)
+      throw Fmi::Exception(BCP, "Each waypoint of a trajectory must have a time");
+
+    std::vector<double> distances{0};
+    for (std::size_t i = 1; i < theWaypoints.size(); i++)
+      distances.push_back(distances.back() + geodistance(theWaypoints[i - 1].longitude,
+                                                         theWaypoints[i - 1].latitude,
+                                                         theWaypoints[i].longitude,
+                                                         theWaypoints[i].latitude));
+
+    std::vector<Fmi::DateTime> ret;
+    ret.reserve(thePlan.points.size());
+
+    std::size_t segment = 0;
+    for (const auto& point : thePlan.points)
+    {
+      while (segment + 2 < distances.size() && point.distance > distances[segment + 1])
+        ++segment;
+
+      const double length = distances[segment + 1] - distances[segment];
+      const double fraction =
+          (length > 0 ? std::clamp((point.distance - distances[segment]) / length, 0.0, 1.0)
+                      : 0.0);
+      const auto duration = (theTimes[segment + 1] - theTimes[segment]).total_seconds();
+      ret.push_back(theTimes[segment] +
+                    Fmi::Seconds(std::lround(fraction * static_cast<double>(duration))));
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Sample all levels of a parameter along a trajectory
+ *
+ * Only the data times bracketing the time of each column are read, and
+ * the columns at them are blended linearly in time. The heights are
+ * blended too, so that the vertical coordinate follows the data. The
+ * columns at the data times are cached as in ordinary cross-sections.
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr sample_trajectory_grid(NFmiFastQueryInfo& theInfo,
+                                       const SamplingPlan& thePlan,
+                                       unsigned long theParameter,
+                                       std::optional<unsigned long> theZParameter,
+                                       const std::vector<Fmi::DateTime>& theDataTimes,
+                                       const std::vector<Fmi::DateTime>& theColumnTimes,
+                                       double theMultiplier,
+                                       double theOffset,
+                                       ColumnCache* theCache,
+                                       const std::string& theCacheKey,
+                                       bool theDirection)
+{
+  try
+  {
+    if (theColumnTimes.size() != thePlan.points.size())
+      throw Fmi::Exception(BCP, "Each sample point of a trajectory must have a time");
+
+    if (theDataTimes.empty())
+      return {};
+
+    auto grid = std::make_shared<VerticalGrid>();
+    grid->width = thePlan.points.size();
+    grid->height = theInfo.SizeLevels();
+    grid->values.resize(grid->width * grid->height);
+    grid->coordinates.resize(grid->width * grid->height);
+
+    // Column at a data time
+
+    auto fetch = [&](const SamplePoint& thePoint, const Fmi::DateTime& theTime)
+    {
+      return cached_column(theInfo,
+                           thePoint,
+                           theParameter,
+                           theZParameter,
+                           theMultiplier,
+                           theOffset,
+                           theCache,
+                           theCacheKey + ';' + Fmi::to_iso_string(theTime),
+                           theDirection,
+                           theTime);
+    };
+
+    for (std::size_t col = 0; col < grid->width; col++)
+    {
+      const auto& point = thePlan.points[col];
+      const auto& t = theColumnTimes[col];
+
+      // The first data time not before the column
+
+      auto next = std::lower_bound(theDataTimes.begin(), theDataTimes.end(), t);
+
+      ColumnPtr column;
+      if (next != theDataTimes.end() && *next == t)
+        column = fetch(point, t);
+      else if (next == theDataTimes.begin() || next == theDataTimes.end())
+      {
+        // Outside the data, only the heights of the nearest time are used
+
+        auto nearest = fetch(point, next == theDataTimes.end() ? theDataTimes.back() : *next);
+        if (nearest)
+        {
+          auto outside = std::make_shared<Column>(*nearest);
+          std::fill(outside->values.begin(), outside->values.end(), ParamValueMissing);
+          column = outside;
+        }
+      }
+      else
+      {
+        const auto& t1 = *std::prev(next);
+        const auto& t2 = *next;
+        auto first = fetch(point, t1);
+        auto second = fetch(point, t2);
+        if (first && second)
+        {
+          const auto weight = static_cast<float>((t - t1).total_seconds()) /
+                              static_cast<float>((t2 - t1).total_seconds());
+          column = blend_columns(*first, *second, weight, theDirection);
+        }
+      }
+
+      if (!column)
+        return {};
+
+      for (std::size_t row = 0; row < grid->height; row++)
+      {
+        const auto pos = row * grid->width + col;
+        grid->values[pos] = column->values[row];
+        grid->coordinates[pos] = T::Coordinate(point.distance, column->heights[row]);
+      }
+    }
+
+    return grid;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,132 @@
+// ======================================================================
+/*!
+ * \brief Sampling of querydata along the cross-section route
+ *
+ * A sampling plan lists the points along the route together with the
+ * grid points and weights from which the values at the points are
+ * interpolated. Sampling the data with a plan yields a vertical grid
+ * which is contoured the same way as grid engine data.
+ *
+ * The plans depend only on the route and the grid, and are hence
+ * shared by all layers, timesteps and requests with the same route.
+ *
+ * When the route runs along a grid row or column the plan consists of
+ * the native grid points on the route, and the values are extracted
+ * without any interpolation.
+ *
+ * Directions in degrees are interpolated along the circle, so that for
+ * example 350 and 10 degrees average to 0 degrees instead of 180.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Geodesy.h"
+#include "LruCache.h"
+#include "VerticalGrid.h"
+#include <macgyver/DateTime.h>
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class NFmiFastQueryInfo;
+class NFmiMetTime;
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+struct SamplePoint
+{
+  double longitude = 0;
+  double latitude = 0;
+  double distance = 0;                   // kilometers from the start of the route
+  std::array<unsigned long, 4> indices;  // location indices of the surrounding grid points
+  std::array<float, 4> weights{};        // zero for unused grid points
+  bool inside = false;                   // false if the point is outside the grid
+};
+
+struct SamplingPlan
+{
+  std::vector<SamplePoint> points;
+  bool aligned = false;  // the points are native grid points
+};
+
+using SamplingPlanPtr = std::shared_ptr<const SamplingPlan>;
+
+// Values and vertical coordinates of all levels at one sample point
+struct Column
+{
+  std::vector<float> values;
+  std::vector<float> heights;
+};
+
+using ColumnPtr = std::shared_ptr<const Column>;
+using ColumnCache = LruCache<ColumnPtr>;
+
+// Plan for bilinear interpolation at equidistant points along each segment of the
+// route, optionally moved to the nearest multiple of the resolution
+SamplingPlanPtr sampling_plan(const NFmiFastQueryInfo& theInfo,
+                              const Waypoints& theWaypoints,
+                              std::size_t theSteps,
+                              double theResolution = 0);
+
+// Plan for a route along a grid row or column, or an empty pointer for other routes
+SamplingPlanPtr aligned_sampling_plan(const NFmiFastQueryInfo& theInfo,
+                                      double theLon1,
+                                      double theLat1,
+                                      double theLon2,
+                                      double theLat2);
+
+// Sample all levels of a parameter at a point for the current time
+ColumnPtr sample_column(NFmiFastQueryInfo& theInfo,
+                        const SamplePoint& thePoint,
+                        unsigned long theParameter,
+                        std::optional<unsigned long> theZParameter,
+                        double theMultiplier,
+                        double theOffset,
+                        bool theDirection = false);
+
+// Sample all levels of a parameter. The vertical coordinate is the level
+// value or the z-parameter. Returns an empty pointer if the data is not available.
+// Columns are reused from the cache if one is given.
+VerticalGridPtr sample_vertical_grid(NFmiFastQueryInfo& theInfo,
+                                     const SamplingPlan& thePlan,
+                                     unsigned long theParameter,
+                                     std::optional<unsigned long> theZParameter,
+                                     const NFmiMetTime& theTime,
+                                     double theMultiplier,
+                                     double theOffset,
+                                     ColumnCache* theCache = nullptr,
+                                     const std::string& theCacheKey = "",
+                                     bool theDirection = false);
+
+// Valid times of the sample points of a trajectory, interpolated from the
+// times at the waypoints by the distance along the route
+std::vector<Fmi::DateTime> trajectory_times(const SamplingPlan& thePlan,
+                                            const Waypoints& theWaypoints,
+                                            const std::vector<Fmi::DateTime>& theTimes);
+
+// Sample all levels of a parameter along a trajectory. Each column is
+// interpolated in time from the columns at the bracketing data times, and
+// columns outside the data times are missing. The data time is appended to
+// the cache key.
+VerticalGridPtr sample_trajectory_grid(NFmiFastQueryInfo& theInfo,
+                                       const SamplingPlan& thePlan,
+                                       unsigned long theParameter,
+                                       std::optional<unsigned long> theZParameter,
+                                       const std::vector<Fmi::DateTime>& theDataTimes,
+                                       const std::vector<Fmi::DateTime>& theColumnTimes,
+                                       double theMultiplier,
+                                       double theOffset,
+                                       ColumnCache* theCache = nullptr,
+                                       const std::string& theCacheKey = "",
+                                       bool theDirection = false);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,101 @@
+#include "Snapping.h"
+#include "Query.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cmath>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Round a coordinate to the nearest multiple of the resolution
+ *
+ * The result is rounded once more to remove the binary representation
+ * error of the multiplication so that the cache key is stable.
+ */
+// ----------------------------------------------------------------------
+
+double snap_coordinate(double theValue, double theResolution)
+{
+  if (theResolution <= 0)
+    return theValue;
+
+  const double value = std::round(theValue / theResolution) * theResolution;
+  return std::round(value * 1e9) / 1e9;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Snap the number of steps to an allowed value
+ *
+ * Rounding upwards never lowers the resolution the client asked for.
+ */
+// ----------------------------------------------------------------------
+
+std::size_t snap_steps(std::size_t theSteps, const std::vector<std::size_t>& theAllowed)
+{
+  if (theAllowed.empty())
+    return theSteps;
+
+  auto it = std::lower_bound(theAllowed.begin(), theAllowed.end(), theSteps);
+  if (it == theAllowed.end())
+    return theAllowed.back();
+  return *it;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Snap the route of the query
+ */
+// ----------------------------------------------------------------------
+
+bool snap_route(Query& theQuery, const SnapPolicy& thePolicy)
+{
+  try
+  {
+    const Query original = theQuery;
+
+    bool changed = false;
+    for (auto& point : theQuery.waypoints)
+    {
+      const auto lon = snap_coordinate(point.longitude, thePolicy.resolution);
+      const auto lat = snap_coordinate(point.latitude, thePolicy.resolution);
+      changed |= (lon != point.longitude || lat != point.latitude);
+      point.longitude = lon;
+      point.latitude = lat;
+    }
+
+    // Distinct waypoints may not collapse into one, the original waypoints are
+    // then kept but the steps are still snapped
+
+    for (std::size_t i = 1; i < theQuery.waypoints.size(); i++)
+    {
+      const auto& p1 = theQuery.waypoints[i - 1];
+      const auto& p2 = theQuery.waypoints[i];
+      const auto& o1 = original.waypoints[i - 1];
+      const auto& o2 = original.waypoints[i];
+      if (p1.longitude == p2.longitude && p1.latitude == p2.latitude &&
+          (o1.longitude != o2.longitude || o1.latitude != o2.latitude))
+      {
+        theQuery.waypoints = original.waypoints;
+        changed = false;
+        break;
+      }
+    }
+
+    theQuery.steps = snap_steps(theQuery.steps, thePolicy.steps);
+    return (changed || theQuery.steps != original.steps);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,43 @@
+// ======================================================================
+/*!
+ * \brief Canonicalization of the route for better cache hit ratios
+ *
+ * Interactive map clients pick the endpoints by clicking, so nearly
+ * identical routes would otherwise all be distinct in the caches. If
+ * a snapping policy is configured for the customer, the waypoints are
+ * rounded to a grid and the number of steps to an allowed value before
+ * the cache keys are computed.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+struct Query;
+
+struct SnapPolicy
+{
+  double resolution = 0;           // grid spacing in degrees, zero for no snapping
+  std::vector<std::size_t> steps;  // allowed step counts in ascending order, empty for any
+};
+
+// Round a coordinate to the nearest multiple of the resolution
+double snap_coordinate(double theValue, double theResolution);
+
+// The smallest allowed step count not below the requested one, or the largest one
+std::size_t snap_steps(std::size_t theSteps, const std::vector<std::size_t>& theAllowed);
+
+// Snap the route of the query, returns true if it was modified
+bool snap_route(Query& theQuery, const SnapPolicy& thePolicy);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -1,9 +1,20 @@
 #include "State.h"
+#include "Deadline.h"
 #include "Plugin.h"
 #include <ctpp2/CDT.hpp>
+#include <gis/Box.h>
+#include <gis/OGR.h>
 #include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <macgyver/TimeFormatter.h>
 #include <stdexcept>
 
+namespace
+{
+// Shared arcs are quantized to the same precision as SVG paths
+const double topology_resolution = 0.1;
+}  // namespace
+
 namespace SmartMet
 {
 namespace Plugin
@@ -21,6 +32,181 @@ State::State(const Plugin& thePlugin)
 {
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generation of the data used by the request
+ *
+ * Querydata is identified by the data being rendered.
+ */
+// ----------------------------------------------------------------------
+
+const DataGeneration& State::generation()
+{
+  try
+  {
+    if (!itsGeneration)
+    {
+      if (itsQuery.source && *itsQuery.source == "grid")
+        itsGeneration = itsPlugin.getDataGeneration(itsQuery);
+      else
+        itsGeneration = itsPlugin.getDataGeneration(producer());
+    }
+    return *itsGeneration;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generation of the latest data, which may differ from the data used
+ */
+// ----------------------------------------------------------------------
+
+DataGeneration State::latestGeneration() const
+{
+  try
+  {
+    return itsPlugin.getDataGeneration(itsQuery);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Threads shared by all requests
+ */
+// ----------------------------------------------------------------------
+
+ThreadPool& State::getThreadPool() const
+{
+  return itsPlugin.getThreadPool();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The persistent cache, or nullptr if disabled
+ */
+// ----------------------------------------------------------------------
+
+DiskCache* State::getDiskCache() const
+{
+  return itsPlugin.getDiskCache();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test whether the deadline of the request has passed
+ */
+// ----------------------------------------------------------------------
+
+bool State::expired() const
+{
+  return (itsQuery.deadline && std::chrono::steady_clock::now() >= *itsQuery.deadline);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Abandon the request if its deadline has passed
+ */
+// ----------------------------------------------------------------------
+
+void State::checkDeadline() const
+{
+  if (expired())
+    throw DeadlineExceeded("Request deadline exceeded");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Plan for sampling querydata along the route
+ *
+ * The plan is established once per request, and is shared with other
+ * requests by the plugin.
+ */
+// ----------------------------------------------------------------------
+
+SamplingPlanPtr State::samplingPlan(bool theRequired)
+{
+  try
+  {
+    if (!itsSamplingPlan || (theRequired && !*itsSamplingPlan))
+      itsSamplingPlan = itsPlugin.getSamplingPlan(itsQuery, producer(), theRequired);
+    return *itsSamplingPlan;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Set the valid time
+ *
+ * Contours and grids cached for the previous time are discarded.
+ */
+// ----------------------------------------------------------------------
+
+void State::time(const Fmi::LocalDateTime& theTime)
+{
+  itsLocalTime = theTime;
+  itsContours.clear();
+  itsVerticalGrids.clear();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cached vertical grid for the current timestep, if any
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr State::verticalGrid(const std::string& theKey) const
+{
+  auto it = itsVerticalGrids.find(theKey);
+  if (it == itsVerticalGrids.end())
+    return {};
+  return it->second;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Cache a vertical grid for the current timestep
+ */
+// ----------------------------------------------------------------------
+
+void State::verticalGrid(const std::string& theKey, VerticalGridPtr theGrid)
+{
+  itsVerticalGrids[theKey] = std::move(theGrid);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The key for the current time in the generated CDT
+ */
+// ----------------------------------------------------------------------
+
+std::string State::timeKey() const
+{
+  try
+  {
+    if (itsQuery.source && *itsQuery.source == "grid")
+      return Fmi::to_iso_string(itsLocalTime.utc_time());
+
+    std::unique_ptr<Fmi::TimeFormatter> timeformatter(Fmi::TimeFormatter::create("iso"));
+    return timeformatter->format(itsLocalTime);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Get the configuration object
@@ -78,6 +264,150 @@ void State::addAttributes(CTPP::CDT& /* theGlobals */,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add a contour to the generated CDT
+ *
+ * In topology mode the geometry is registered for shared arc extraction,
+ * and the arc references are filled in by generateTopology once all
+ * layers have been generated.
+ */
+// ----------------------------------------------------------------------
+
+void State::addContour(CTPP::CDT& theGlobals,
+                       const std::string& theTimeKey,
+                       const std::string& theType,
+                       const std::string& theParameter,
+                       CTPP::CDT& theHash,
+                       const OGRGeometryPtr& theGeom)
+{
+  try
+  {
+    if (!itsQuery.topology)
+    {
+      if (theGeom != nullptr && theGeom->IsEmpty() == 0)
+        theHash["path"] = Fmi::OGR::exportToSvg(*theGeom, Fmi::Box::identity(), 1);
+      else
+        theHash["path"] = "";
+      theGlobals["layers"][theTimeKey][theType][theParameter].PushBack(theHash);
+      return;
+    }
+
+    if (!itsTopology)
+      itsTopology.emplace(topology_resolution);
+
+    addRecord(theGlobals, theTimeKey, theType, theParameter, theHash);
+    itsTopologyObjects.back().object = itsTopology->add(theGeom.get());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add a record without a geometry to the generated CDT
+ */
+// ----------------------------------------------------------------------
+
+void State::addRecord(CTPP::CDT& theGlobals,
+                      const std::string& theTimeKey,
+                      const std::string& theType,
+                      const std::string& theParameter,
+                      CTPP::CDT& theHash)
+{
+  try
+  {
+    theGlobals["layers"][theTimeKey][theType][theParameter].PushBack(theHash);
+
+    if (!itsQuery.topology)
+      return;
+
+    TopologyObject object;
+    object.timekey = theTimeKey;
+    object.type = theType;
+    object.parameter = theParameter;
+    object.index = itsRecordCounts[theTimeKey + '/' + theType + '/' + theParameter]++;
+    itsTopologyObjects.push_back(object);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract the shared arcs and build the TopoJSON objects
+ *
+ * Each timestep, layer type and parameter becomes a GeometryCollection
+ * object named "time/type/parameter". Contours refer to the single
+ * arcs array of the topology, records without a geometry such as wind
+ * symbols become null geometries. The layer details are properties of
+ * the geometries.
+ */
+// ----------------------------------------------------------------------
+
+void State::generateTopology(CTPP::CDT& theGlobals)
+{
+  try
+  {
+    if (!itsQuery.topology)
+      return;
+
+    theGlobals["scale"] = topology_resolution;
+
+    CTPP::CDT arcs(CTPP::CDT::ARRAY_VAL);
+    if (itsTopology)
+    {
+      itsTopology->build();
+      for (std::size_t i = 0; i < itsTopology->arcCount(); i++)
+        arcs.PushBack(itsTopology->arc(i));
+    }
+    theGlobals["arcs"] = arcs;
+
+    // Objects in the order of their first records
+
+    CTPP::CDT objects(CTPP::CDT::ARRAY_VAL);
+    std::map<std::string, unsigned int> positions;
+
+    for (const auto& object : itsTopologyObjects)
+    {
+      const auto name = object.timekey + '/' + object.type + '/' + object.parameter;
+      auto pos = positions.find(name);
+      if (pos == positions.end())
+      {
+        CTPP::CDT collection(CTPP::CDT::HASH_VAL);
+        collection["name"] = name;
+        collection["geometries"] = CTPP::CDT(CTPP::CDT::ARRAY_VAL);
+        objects.PushBack(collection);
+        pos = positions.emplace(name, positions.size()).first;
+      }
+
+      CTPP::CDT geometry =
+          theGlobals["layers"][object.timekey][object.type][object.parameter][object.index];
+      if (object.object)
+      {
+        geometry["type"] = itsTopology->type(*object.object);
+        geometry["arcs"] = itsTopology->arcs(*object.object);
+      }
+      objects[pos->second]["geometries"].PushBack(geometry);
+    }
+
+    theGlobals["objects"] = objects;
+    theGlobals["layers"] = CTPP::CDT(CTPP::CDT::HASH_VAL);
+
+    itsTopology.reset();
+    itsRecordCounts.clear();
+    itsTopologyObjects.clear();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Get the data to be used
@@ -91,7 +421,10 @@ SmartMet::Engine::Querydata::Q State::producer()
     if (itsQuery.producer.empty())
       throw Fmi::Exception(BCP, "The producer has not been set");
 
-    itsQ = itsPlugin.getQEngine().get(itsQuery.producer);
+    // The same data is used for all layers and timesteps
+
+    if (!itsQ)
+      itsQ = itsPlugin.getQEngine().get(itsQuery.producer);
     return itsQ;
   }
   catch (...)
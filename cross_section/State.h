@@ -18,12 +18,19 @@
 #pragma once
 
 #include "Attributes.h"
+#include "DataGeneration.h"
 #include "Plugin.h"
 #include "Query.h"
+#include "Sampling.h"
+#include "Topology.h"
+#include "VerticalGrid.h"
 #include <engines/contour/Engine.h>
 #include <engines/querydata/Q.h>
 #include <map>
 #include <ogr_geometry.h>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace CTPP
 {
@@ -37,8 +44,18 @@ namespace Plugin
 namespace CrossSection
 {
 class Config;
+class ContourGroup;
+class DiskCache;
+class ThreadPool;
 class Plugin;
 
+// Contours generated for a contour group for the current timestep
+struct Contours
+{
+  std::optional<std::vector<OGRGeometryPtr>> isobands;
+  std::optional<std::vector<OGRGeometryPtr>> isolines;
+};
+
 class State
 {
  public:
@@ -55,11 +72,39 @@ class State
 
   void addAttributes(CTPP::CDT& theGlobals, CTPP::CDT& theLocals, const Attributes& theAttributes);
 
+  // Add a contour either as a SVG path or as a reference to shared arcs
+  void addContour(CTPP::CDT& theGlobals,
+                  const std::string& theTimeKey,
+                  const std::string& theType,
+                  const std::string& theParameter,
+                  CTPP::CDT& theHash,
+                  const OGRGeometryPtr& theGeom);
+
+  // Add a record without a geometry, for example wind symbols
+  void addRecord(CTPP::CDT& theGlobals,
+                 const std::string& theTimeKey,
+                 const std::string& theType,
+                 const std::string& theParameter,
+                 CTPP::CDT& theHash);
+
+  // Extract the shared arcs of all added contours and build the TopoJSON objects
+  void generateTopology(CTPP::CDT& theGlobals);
+
   // Data
 
   void query(const Query& theQuery) { itsQuery = theQuery; }
   const Query& query() const { return itsQuery; }
+
+  // Generation of the data used by the request
+  const DataGeneration& generation();
+  void generation(const DataGeneration& theGeneration) { itsGeneration = theGeneration; }
+  DataGeneration latestGeneration() const;
+
+  // Abandon the request if its deadline has passed
+  void checkDeadline() const;
+  bool expired() const;
   SmartMet::Engine::Querydata::Q producer();
+  void producer(const SmartMet::Engine::Querydata::Q& theQ) { itsQ = theQ; }
 
   // Contourer
   const SmartMet::Engine::Contour::Engine& getContourEngine() const
@@ -67,9 +112,27 @@ class State
     return itsPlugin.getContourEngine();
   }
   const SmartMet::Engine::Grid::Engine& getGridEngine() const { return itsPlugin.getGridEngine(); }
+  DiskCache* getDiskCache() const;
+  ThreadPool& getThreadPool() const;
+
+  // Plan for sampling querydata along the route, or an empty pointer if
+  // the contour engine is to sample the data. A plan is made for all
+  // gridded data if required.
+  SamplingPlanPtr samplingPlan(bool theRequired = false);
+  ColumnCache* getColumnCache() const { return itsPlugin.getColumnCache(); }
+
   // Valid time
-  void time(const Fmi::LocalDateTime& theTime) { itsLocalTime = theTime; }
+  void time(const Fmi::LocalDateTime& theTime);
   const Fmi::LocalDateTime& time() const { return itsLocalTime; }
+  std::string timeKey() const;
+
+  // Contours shared by the layers for the current timestep
+  Contours& contours(const ContourGroup* theGroup) { return itsContours[theGroup]; }
+
+  // Vertical grids sampled for the current timestep
+  VerticalGridPtr verticalGrid(const std::string& theKey) const;
+  void verticalGrid(const std::string& theKey, VerticalGridPtr theGrid);
+
   const OGREnvelope& envelope() const { return itsEnvelope; }
   void updateEnvelope(const OGRGeometryPtr& theGeom);
 
@@ -79,9 +142,27 @@ class State
 
   // current state:
   SmartMet::Engine::Querydata::Q itsQ;
+  std::optional<DataGeneration> itsGeneration;
+  std::optional<SamplingPlanPtr> itsSamplingPlan;
   Fmi::LocalDateTime itsLocalTime;
+  std::map<const ContourGroup*, Contours> itsContours;
+  std::map<std::string, VerticalGridPtr> itsVerticalGrids;
 
   OGREnvelope itsEnvelope;
+
+  // TopoJSON output: the arcs are shared by all timesteps, and the records
+  // of the layers are collected into the objects in the order they were added
+  struct TopologyObject
+  {
+    std::string timekey;
+    std::string type;
+    std::string parameter;
+    unsigned int index;
+    std::optional<std::size_t> object;  // none for records without a geometry
+  };
+  std::optional<Topology> itsTopology;
+  std::map<std::string, unsigned int> itsRecordCounts;
+  std::vector<TopologyObject> itsTopologyObjects;
 };
 
 }  // namespace CrossSection
@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor starts the threads
+ */
+// ----------------------------------------------------------------------
+
+ThreadPool::ThreadPool(std::size_t theThreads)
+{
+  try
+  {
+    const auto n = std::max<std::size_t>(theThreads, 1);
+    for (std::size_t i = 0; i < n; i++)
+      itsThreads.emplace_back([this] { work(); });
+  }
+  catch (...)
+  {
+    stop();
+    throw Fmi::Exception::Trace(BCP, "Failed to start the thread pool");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Destructor stops the threads
+ */
+// ----------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+  try
+  {
+    stop();
+  }
+  catch (...)
+  {
+    Fmi::Exception::Trace(BCP, "Failed to stop the thread pool").printError();
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue a job
+ */
+// ----------------------------------------------------------------------
+
+void ThreadPool::submit(std::function<void()> theJob)
+{
+  try
+  {
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+      if (itsStopping)
+        return;
+      itsQueue.push_back(std::move(theJob));
+    }
+    itsCondition.notify_one();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Stop the threads. Jobs being run are finished first.
+ */
+// ----------------------------------------------------------------------
+
+void ThreadPool::stop()
+{
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsStopping = true;
+    itsQueue.clear();
+    threads.swap(itsThreads);
+  }
+  itsCondition.notify_all();
+
+  for (auto& thread : threads)
+    if (thread.joinable())
+      thread.join();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Run queued jobs
+ */
+// ----------------------------------------------------------------------
+
+void ThreadPool::work()
+{
+  std::unique_lock<std::mutex> lock(itsMutex);
+  while (true)
+  {
+    itsCondition.wait(lock, [this] { return itsStopping || !itsQueue.empty(); });
+    if (itsStopping)
+      return;
+
+    auto job = std::move(itsQueue.front());
+    itsQueue.pop_front();
+
+    lock.unlock();
+    try
+    {
+      job();
+    }
+    catch (...)
+    {
+      Fmi::Exception::Trace(BCP, "Thread pool job failed").printError();
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,58 @@
+// ======================================================================
+/*!
+ * \brief Shared pool of worker threads
+ *
+ * Batch routes and ensemble members are processed in parallel by a
+ * fixed set of threads shared by all requests instead of threads
+ * started for each request, which bounds the total number of threads
+ * regardless of the load.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class ThreadPool
+{
+ public:
+  explicit ThreadPool(std::size_t theThreads);
+
+  ~ThreadPool();
+  ThreadPool() = delete;
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+  ThreadPool(ThreadPool&& other) = delete;
+  ThreadPool& operator=(ThreadPool&& other) = delete;
+
+  // Run the job in some thread of the pool, returns immediately
+  void submit(std::function<void()> theJob);
+
+  // Stop the threads, queued jobs which have not started are dropped
+  void stop();
+
+ private:
+  void work();
+
+  std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  bool itsStopping = false;
+  std::deque<std::function<void()>> itsQueue;
+  std::vector<std::thread> itsThreads;
+};
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
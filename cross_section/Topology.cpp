@@ -0,0 +1,572 @@
+#include "Topology.h"
+#include <macgyver/Exception.h>
+#include <ogr_geometry.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+const std::size_t no_line = static_cast<std::size_t>(-1);
+
+struct PointHash
+{
+  std::size_t operator()(const Topology::Point& thePoint) const
+  {
+    return std::hash<std::int64_t>()(thePoint.first) * 31 +
+           std::hash<std::int64_t>()(thePoint.second);
+  }
+};
+
+// For each point the neighbours seen on the first visit. If a later visit
+// arrives from different neighbours, the point is a junction.
+
+struct Visit
+{
+  Topology::Point prev;
+  Topology::Point next;
+  bool junction = false;
+};
+
+using Visits = std::unordered_map<Topology::Point, Visit, PointHash>;
+
+void visit(Visits& theVisits,
+           const Topology::Point& thePoint,
+           const Topology::Point& thePrev,
+           const Topology::Point& theNext)
+{
+  const auto& lo = std::min(thePrev, theNext);
+  const auto& hi = std::max(thePrev, theNext);
+  auto result = theVisits.emplace(thePoint, Visit{lo, hi, false});
+  if (!result.second)
+  {
+    auto& v = result.first->second;
+    if (v.prev != lo || v.next != hi)
+      v.junction = true;
+  }
+}
+
+bool is_junction(const Visits& theVisits, const Topology::Point& thePoint)
+{
+  auto it = theVisits.find(thePoint);
+  return (it != theVisits.end() && it->second.junction);
+}
+
+using ArcIndex = std::map<Topology::Points, int>;
+
+// Index of an arc, possibly ~index if the arc already exists in reverse
+
+int arc_index(Topology::Points& theArc, ArcIndex& theIndex, std::vector<Topology::Points>& theArcs)
+{
+  auto it = theIndex.find(theArc);
+  if (it != theIndex.end())
+    return it->second;
+
+  Topology::Points reversed(theArc.rbegin(), theArc.rend());
+  it = theIndex.find(reversed);
+  if (it != theIndex.end())
+    return ~it->second;
+
+  const auto n = static_cast<int>(theArcs.size());
+  theIndex.emplace(theArc, n);
+  theArcs.push_back(std::move(theArc));
+  return n;
+}
+
+void append_refs(std::string& theOutput, const std::vector<int>& theRefs)
+{
+  theOutput += '[';
+  for (std::size_t i = 0; i < theRefs.size(); i++)
+  {
+    if (i > 0)
+      theOutput += ',';
+    theOutput += std::to_string(theRefs[i]);
+  }
+  theOutput += ']';
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append a line of quantized points
+ */
+// ----------------------------------------------------------------------
+
+void add_line(OGRMultiLineString& theLines, const Topology::Points& thePoints, double theResolution)
+{
+  OGRLineString line;
+  for (const auto& p : thePoints)
+    line.addPoint(p.first * theResolution, p.second * theResolution);
+  theLines.addGeometry(&line);
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+Topology::Topology(double theResolution) : itsResolution(theResolution)
+{
+  if (itsResolution <= 0)
+    throw Fmi::Exception(BCP, "Topology resolution must be positive");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Register a geometry
+ */
+// ----------------------------------------------------------------------
+
+std::size_t Topology::add(const OGRGeometry* theGeom)
+{
+  try
+  {
+    if (itsBuilt)
+      throw Fmi::Exception(BCP, "Cannot add geometries to an already built topology");
+
+    Object object;
+    if (theGeom != nullptr && theGeom->IsEmpty() == 0)
+      addGeometry(theGeom, object);
+
+    itsObjects.push_back(object);
+    return itsObjects.size() - 1;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Collect the rings and lines of a geometry
+ */
+// ----------------------------------------------------------------------
+
+void Topology::addGeometry(const OGRGeometry* theGeom, Object& theObject)
+{
+  switch (wkbFlatten(theGeom->getGeometryType()))
+  {
+    case wkbPolygon:
+    {
+      const auto* poly = theGeom->toPolygon();
+      theObject.polygonal = true;
+
+      auto exterior = addLine(poly->getExteriorRing(), true);
+      if (exterior == no_line)
+        return;
+
+      std::vector<std::size_t> rings{exterior};
+      for (int i = 0, n = poly->getNumInteriorRings(); i < n; i++)
+      {
+        auto hole = addLine(poly->getInteriorRing(i), true);
+        if (hole != no_line)
+          rings.push_back(hole);
+      }
+      theObject.parts.push_back(rings);
+      return;
+    }
+    case wkbLineString:
+    case wkbLinearRing:
+    {
+      auto line = addLine(theGeom->toLineString(), false);
+      if (line == no_line)
+        return;
+      if (theObject.parts.empty())
+        theObject.parts.emplace_back();
+      theObject.parts.front().push_back(line);
+      return;
+    }
+    case wkbMultiPolygon:
+    case wkbMultiLineString:
+    case wkbGeometryCollection:
+    {
+      const auto* coll = theGeom->toGeometryCollection();
+      for (int i = 0, n = coll->getNumGeometries(); i < n; i++)
+        addGeometry(coll->getGeometryRef(i), theObject);
+      return;
+    }
+    default:
+      // Points etc cannot be represented with arcs
+      return;
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Quantize a ring or a line
+ *
+ * Duplicate consecutive points and the closing point of rings are
+ * removed. Returns no_line for degenerate rings and lines.
+ */
+// ----------------------------------------------------------------------
+
+std::size_t Topology::addLine(const OGRLineString* theLine, bool theRing)
+{
+  if (theLine == nullptr)
+    return no_line;
+
+  Line line;
+  line.ring = theRing;
+  line.points.reserve(theLine->getNumPoints());
+
+  for (int i = 0, n = theLine->getNumPoints(); i < n; i++)
+  {
+    Point p(std::llround(theLine->getX(i) / itsResolution),
+            std::llround(theLine->getY(i) / itsResolution));
+    if (line.points.empty() || line.points.back() != p)
+      line.points.push_back(p);
+  }
+
+  if (theRing && line.points.size() > 1 && line.points.front() == line.points.back())
+    line.points.pop_back();
+
+  if (line.points.size() < (theRing ? 3UL : 2UL))
+    return no_line;
+
+  itsLines.push_back(std::move(line));
+  return itsLines.size() - 1;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Split the rings and lines into shared arcs
+ */
+// ----------------------------------------------------------------------
+
+void Topology::build()
+{
+  try
+  {
+    if (itsBuilt)
+      return;
+
+    // Find the junctions. Line endpoints are always junctions.
+
+    Visits visits;
+    for (const auto& line : itsLines)
+    {
+      const auto& pts = line.points;
+      const auto n = pts.size();
+      if (line.ring)
+      {
+        for (std::size_t i = 0; i < n; i++)
+          visit(visits, pts[i], pts[(i + n - 1) % n], pts[(i + 1) % n]);
+      }
+      else
+      {
+        visits[pts.front()].junction = true;
+        visits[pts.back()].junction = true;
+        for (std::size_t i = 1; i + 1 < n; i++)
+          visit(visits, pts[i], pts[i - 1], pts[i + 1]);
+      }
+    }
+
+    // Cut the lines at the junctions and deduplicate the arcs
+
+    ArcIndex index;
+    std::vector<std::vector<int>> line_arcs(itsLines.size());
+
+    for (std::size_t k = 0; k < itsLines.size(); k++)
+    {
+      const auto& pts = itsLines[k].points;
+      const auto n = pts.size();
+      auto& refs = line_arcs[k];
+
+      if (!itsLines[k].ring)
+      {
+        Points arc{pts.front()};
+        for (std::size_t i = 1; i < n; i++)
+        {
+          arc.push_back(pts[i]);
+          if (i + 1 == n || is_junction(visits, pts[i]))
+          {
+            refs.push_back(arc_index(arc, index, itsArcs));
+            arc = Points{pts[i]};
+          }
+        }
+        continue;
+      }
+
+      std::size_t start = n;
+      for (std::size_t i = 0; i < n && start == n; i++)
+        if (is_junction(visits, pts[i]))
+          start = i;
+
+      if (start == n)
+      {
+        // A closed ring without junctions. Start from the minimum point so that
+        // the same ring is recognized no matter where it was started from.
+        Points arc(pts);
+        std::rotate(arc.begin(), std::min_element(arc.begin(), arc.end()), arc.end());
+        arc.push_back(arc.front());
+        refs.push_back(arc_index(arc, index, itsArcs));
+        continue;
+      }
+
+      Points arc{pts[start]};
+      for (std::size_t j = 1; j <= n; j++)
+      {
+        const auto& p = pts[(start + j) % n];
+        arc.push_back(p);
+        if (j == n || is_junction(visits, p))
+        {
+          refs.push_back(arc_index(arc, index, itsArcs));
+          arc = Points{p};
+        }
+      }
+    }
+
+    // And finally map the objects to arcs
+
+    for (auto& object : itsObjects)
+    {
+      object.arcs.clear();
+      for (const auto& part : object.parts)
+      {
+        std::vector<std::vector<int>> arcs;
+        arcs.reserve(part.size());
+        for (auto line : part)
+          arcs.push_back(line_arcs[line]);
+        object.arcs.push_back(arcs);
+      }
+    }
+
+    itsBuilt = true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Delta encoded arc
+ */
+// ----------------------------------------------------------------------
+
+std::string Topology::arc(std::size_t theArc) const
+{
+  try
+  {
+    const auto& pts = itsArcs.at(theArc);
+
+    std::string out = "[";
+    Point prev(0, 0);
+    for (std::size_t i = 0; i < pts.size(); i++)
+    {
+      if (i > 0)
+        out += ',';
+      out += '[';
+      out += std::to_string(pts[i].first - prev.first);
+      out += ',';
+      out += std::to_string(pts[i].second - prev.second);
+      out += ']';
+      prev = pts[i];
+    }
+    out += ']';
+    return out;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Quantized points of an arc
+ */
+// ----------------------------------------------------------------------
+
+const Topology::Points& Topology::arcPoints(std::size_t theArc) const
+{
+  return itsArcs.at(theArc);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief TopoJSON type of an object
+ */
+// ----------------------------------------------------------------------
+
+std::string Topology::type(std::size_t theObject) const
+{
+  return (itsObjects.at(theObject).polygonal ? "MultiPolygon" : "MultiLineString");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief TopoJSON arc references of an object
+ */
+// ----------------------------------------------------------------------
+
+std::string Topology::arcs(std::size_t theObject) const
+{
+  try
+  {
+    if (!itsBuilt)
+      throw Fmi::Exception(BCP, "Topology has not been built");
+
+    const auto& object = itsObjects.at(theObject);
+
+    std::string out = "[";
+    for (std::size_t i = 0; i < object.arcs.size(); i++)
+    {
+      if (i > 0)
+        out += ',';
+
+      if (object.polygonal)
+      {
+        out += '[';
+        for (std::size_t j = 0; j < object.arcs[i].size(); j++)
+        {
+          if (j > 0)
+            out += ',';
+          append_refs(out, object.arcs[i][j]);
+        }
+        out += ']';
+      }
+      else
+      {
+        for (std::size_t j = 0; j < object.arcs[i].size(); j++)
+        {
+          if (j > 0)
+            out += ',';
+          append_refs(out, object.arcs[i][j]);
+        }
+      }
+    }
+    out += ']';
+    return out;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Arc references of the rings or lines of an object
+ */
+// ----------------------------------------------------------------------
+
+const std::vector<std::vector<std::vector<int>>>& Topology::references(std::size_t theObject) const
+{
+  if (!itsBuilt)
+    throw Fmi::Exception(BCP, "Topology has not been built");
+  return itsObjects.at(theObject).arcs;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Extract the lines shared by pairs of isobands
+ *
+ * Each pair is the isoband below and above an isovalue, and the
+ * result is the isoline of the value.
+ */
+// ----------------------------------------------------------------------
+
+std::vector<OGRGeometryPtr> isoband_edges(
+    const std::vector<OGRGeometryPtr>& theIsobands,
+    const std::vector<std::pair<std::size_t, std::size_t>>& theEdges,
+    double theResolution)
+{
+  try
+  {
+    std::vector<OGRGeometryPtr> ret;
+
+    Topology topology(theResolution);
+    for (const auto& geom : theIsobands)
+      topology.add(geom.get());
+    topology.build();
+
+    for (const auto& edge : theEdges)
+    {
+      // Arcs of the isoband below the value
+      std::set<int> below;
+      for (const auto& rings : topology.references(edge.first))
+        for (const auto& ring : rings)
+          for (auto ref : ring)
+            below.insert(ref < 0 ? ~ref : ref);
+
+      // Walk the rings of the isoband above the value and join the shared arcs into
+      // lines. The lines follow the direction of the rings, which need not be the
+      // direction of isolines contoured directly from the data.
+
+      auto* lines = new OGRMultiLineString;  // NOLINT(cppcoreguidelines-owning-memory)
+      OGRGeometryPtr geom(lines);
+
+      for (const auto& rings : topology.references(edge.second))
+      {
+        for (const auto& ring : rings)
+        {
+          std::vector<Topology::Points> parts;
+          Topology::Points current;
+          bool starts_ring = false;
+
+          for (std::size_t i = 0; i < ring.size(); i++)
+          {
+            const auto ref = ring[i];
+            const auto arc = (ref < 0 ? ~ref : ref);
+            if (below.find(arc) == below.end())
+            {
+              if (!current.empty())
+                parts.push_back(current);
+              current.clear();
+              continue;
+            }
+
+            Topology::Points pts = topology.arcPoints(arc);
+            if (ref < 0)
+              std::reverse(pts.begin(), pts.end());
+
+            if (current.empty())
+            {
+              starts_ring = starts_ring || (i == 0);
+              current = pts;
+            }
+            else
+              current.insert(current.end(), pts.begin() + 1, pts.end());
+          }
+          if (!current.empty())
+            parts.push_back(current);
+
+          // Join the last and first parts if the line wraps around the start of the ring
+          if (parts.size() > 1 && starts_ring && parts.back().back() == parts.front().front())
+          {
+            parts.back().insert(parts.back().end(), parts.front().begin() + 1, parts.front().end());
+            parts.erase(parts.begin());
+          }
+
+          for (const auto& part : parts)
+            add_line(*lines, part, theResolution);
+        }
+      }
+
+      ret.push_back(geom);
+    }
+
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
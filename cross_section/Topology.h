@@ -0,0 +1,96 @@
+// ======================================================================
+/*!
+ * \brief TopoJSON style shared arc extraction
+ *
+ * Adjacent isobands share most of their boundaries, and isolines of
+ * the same field usually run along the same edges. Instead of
+ * serializing each edge separately for every geometry, we split all
+ * rings and lines at their junctions into arcs, store each distinct
+ * arc once and refer to it by index from the geometries. As in
+ * TopoJSON, a negative index ~i means arc i traversed in reverse.
+ *
+ * Coordinates are quantized to the given resolution and the arcs
+ * are delta encoded.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <gis/Types.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class OGRGeometry;
+class OGRLineString;
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class Topology
+{
+ public:
+  explicit Topology(double theResolution);
+
+  // Register a geometry, returns the object number
+  std::size_t add(const OGRGeometry* theGeom);
+
+  // Extract the shared arcs once all geometries have been added
+  void build();
+
+  double resolution() const { return itsResolution; }
+
+  // Number of distinct arcs and an arc in delta encoded JSON form
+  std::size_t arcCount() const { return itsArcs.size(); }
+  std::string arc(std::size_t theArc) const;
+  const std::vector<std::pair<std::int64_t, std::int64_t>>& arcPoints(std::size_t theArc) const;
+
+  // TopoJSON type and arc references of a registered object
+  std::string type(std::size_t theObject) const;
+  std::string arcs(std::size_t theObject) const;
+
+  // Arc references of the rings/lines of an object
+  const std::vector<std::vector<std::vector<int>>>& references(std::size_t theObject) const;
+
+  using Point = std::pair<std::int64_t, std::int64_t>;
+  using Points = std::vector<Point>;
+
+ private:
+  struct Line
+  {
+    Points points;
+    bool ring = false;
+  };
+
+  struct Object
+  {
+    bool polygonal = false;
+    // polygons -> rings (or a single group of lines) -> line numbers
+    std::vector<std::vector<std::size_t>> parts;
+    // the same structure with arc references after build()
+    std::vector<std::vector<std::vector<int>>> arcs;
+  };
+
+  void addGeometry(const OGRGeometry* theGeom, Object& theObject);
+  std::size_t addLine(const OGRLineString* theLine, bool theRing);
+
+  double itsResolution;
+  std::vector<Line> itsLines;
+  std::vector<Object> itsObjects;
+  std::vector<Points> itsArcs;
+  bool itsBuilt = false;
+};
+
+// Lines shared by the isobands below and above each isovalue, that is, the isolines
+std::vector<OGRGeometryPtr> isoband_edges(
+    const std::vector<OGRGeometryPtr>& theIsobands,
+    const std::vector<std::pair<std::size_t, std::size_t>>& theEdges,
+    double theResolution);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
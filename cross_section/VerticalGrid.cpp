@@ -0,0 +1,118 @@
+#include "VerticalGrid.h"
+#include <macgyver/Exception.h>
+#include <cstdint>
+#include <cstring>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+namespace
+{
+template <typename Value>
+void append(std::string& theOutput, const Value& theValue)
+{
+  theOutput.append(reinterpret_cast<const char*>(&theValue), sizeof(theValue));
+}
+
+template <typename Value>
+bool extract(const std::string& theInput, std::size_t& thePos, Value& theValue)
+{
+  if (theInput.size() - thePos < sizeof(theValue))
+    return false;
+  std::memcpy(&theValue, theInput.data() + thePos, sizeof(theValue));
+  thePos += sizeof(theValue);
+  return true;
+}
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Serialize a vertical grid
+ */
+// ----------------------------------------------------------------------
+
+std::string serialize_vertical_grid(const VerticalGrid& theGrid)
+{
+  try
+  {
+    std::string ret;
+    ret.reserve(2 * sizeof(std::uint32_t) + theGrid.values.size() * sizeof(float) +
+                theGrid.coordinates.size() * 2 * sizeof(double));
+
+    append(ret, static_cast<std::uint32_t>(theGrid.width));
+    append(ret, static_cast<std::uint32_t>(theGrid.height));
+    append(ret, static_cast<std::uint64_t>(theGrid.values.size()));
+    for (auto value : theGrid.values)
+      append(ret, value);
+    append(ret, static_cast<std::uint64_t>(theGrid.coordinates.size()));
+    for (const auto& coordinate : theGrid.coordinates)
+    {
+      append(ret, coordinate.x());
+      append(ret, coordinate.y());
+    }
+    return ret;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Deserialize a vertical grid, returns an empty pointer for invalid data
+ */
+// ----------------------------------------------------------------------
+
+VerticalGridPtr deserialize_vertical_grid(const std::string& theData)
+{
+  try
+  {
+    auto grid = std::make_shared<VerticalGrid>();
+
+    std::size_t pos = 0;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    std::uint64_t nvalues = 0;
+    if (!extract(theData, pos, width) || !extract(theData, pos, height) ||
+        !extract(theData, pos, nvalues) || nvalues > (theData.size() - pos) / sizeof(float))
+      return {};
+
+    grid->width = width;
+    grid->height = height;
+    grid->values.resize(nvalues);
+    for (auto& value : grid->values)
+      extract(theData, pos, value);
+
+    std::uint64_t ncoordinates = 0;
+    if (!extract(theData, pos, ncoordinates) ||
+        ncoordinates > (theData.size() - pos) / (2 * sizeof(double)))
+      return {};
+
+    grid->coordinates.reserve(ncoordinates);
+    for (std::uint64_t i = 0; i < ncoordinates; i++)
+    {
+      double x = 0;
+      double y = 0;
+      extract(theData, pos, x);
+      extract(theData, pos, y);
+      grid->coordinates.emplace_back(x, y);
+    }
+
+    if (pos != theData.size() || grid->values.size() != std::size_t(width) * height)
+      return {};
+
+    return grid;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,40 @@
+// ======================================================================
+/*!
+ * \brief Values of a parameter sampled along the cross-section
+ *
+ * The grid has one column per sample point along the route and one
+ * row per vertical level. The coordinates are the distance along the
+ * route and the vertical coordinate of each value.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <engines/grid/Engine.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+struct VerticalGrid
+{
+  uint width = 0;
+  uint height = 0;
+  std::vector<float> values;
+  std::vector<T::Coordinate> coordinates;
+};
+
+using VerticalGridPtr = std::shared_ptr<const VerticalGrid>;
+
+// Binary form for persistent caches
+std::string serialize_vertical_grid(const VerticalGrid& theGrid);
+VerticalGridPtr deserialize_vertical_grid(const std::string& theData);
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -0,0 +1,193 @@
+#include "WindComponentLayer.h"
+#include "Config.h"
+#include "Deadline.h"
+#include "State.h"
+#include <boost/timer/timer.hpp>
+#include <ctpp2/CDT.hpp>
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+WindComponentLayer::WindComponentLayer()
+    : u("WindUMS"), v("WindVMS"), component("along"), interpolation("linear")
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Initialize from JSON
+ */
+// ----------------------------------------------------------------------
+
+void WindComponentLayer::init(const Json::Value& theJson, const Config& theConfig)
+{
+  try
+  {
+    if (!theJson.isObject())
+      throw Fmi::Exception(BCP, "Wind component layer JSON is not a JSON object");
+
+    // Iterate through all the members
+
+    const auto members = theJson.getMemberNames();
+    for (const auto& member : members)
+    {
+      const Json::Value& json = theJson[member];
+
+      if (Layer::init(member, json, theConfig))
+        ;
+      else if (member == "u")
+        u = json.asString();
+      else if (member == "v")
+        v = json.asString();
+      else if (member == "component")
+        component = json.asString();
+      else if (member == "name")
+        name = json.asString();
+      else if (member == "zparameter")
+        zparameter = json.asString();
+      else if (member == "interpolation")
+        interpolation = json.asString();
+      else if (member == "multiplier")
+        multiplier = json.asDouble();
+      else if (member == "offset")
+        offset = json.asDouble();
+      else if (member == "isobands")
+      {
+        if (!json.isArray())
+          throw Fmi::Exception(BCP, "isobands setting must be an array");
+        for (const auto& isoband_json : json)
+        {
+          Isoband isoband;
+          isoband.init(isoband_json, theConfig);
+          isobands.push_back(isoband);
+        }
+      }
+      else if (member == "isolines")
+      {
+        if (!json.isArray())
+          throw Fmi::Exception(BCP, "isolines setting must be an array");
+        for (const auto& isoline_json : json)
+        {
+          Isoline isoline;
+          isoline.init(isoline_json, theConfig);
+          isolines.push_back(isoline);
+        }
+      }
+      else
+        throw Fmi::Exception(BCP,
+                             "Wind component layer does not have a setting named '" + member + "'");
+    }
+
+    // The components are derived parameters of U and V so that the inputs are
+    // fetched only once even if both components are drawn
+
+    std::string expression;
+    if (component == "along")
+      expression = "={" + u + "}*sin(azimuth)+{" + v + "}*cos(azimuth)";
+    else if (component == "across")
+      expression = "={" + u + "}*cos(azimuth)-{" + v + "}*sin(azimuth)";
+    else
+      throw Fmi::Exception(BCP, "Wind component must be 'along' or 'across'")
+          .addParameter("component", component);
+
+    if (!name)
+      name = (component == "along" ? "WindAlongRoute" : "WindAcrossRoute");
+
+    contours = std::make_shared<ContourGroup>(
+        expression, zparameter, interpolation, multiplier, offset);
+    contours->addIsobands(isobands);
+    contours->addIsolines(isolines);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Generate the layer details into the template hash
+ */
+// ----------------------------------------------------------------------
+
+void WindComponentLayer::generate(CTPP::CDT& theGlobals, State& theState)
+{
+  try
+  {
+    std::unique_ptr<boost::timer::auto_cpu_timer> timer;
+    if (theState.query().timer)
+    {
+      std::string report = "WindComponentLayer::generate finished in %t sec CPU, %w sec real\n";
+      timer = std::make_unique<boost::timer::auto_cpu_timer>(2, report);
+    }
+
+    if (!contours)
+      throw Fmi::Exception(BCP, "Wind component layer is not initialized");
+
+    std::string timekey = theState.timeKey();
+
+    if (!isobands.empty())
+    {
+      const auto& geoms = contours->isobands(theState);
+      for (const auto& isoband : isobands)
+      {
+        auto index = contours->isobandIndex(isoband);
+        if (index >= geoms.size())
+          continue;
+
+        const OGRGeometryPtr& geom = geoms[index];
+        theState.updateEnvelope(geom);
+
+        CTPP::CDT hash(CTPP::CDT::HASH_VAL);
+        if (isoband.lolimit)
+          hash["lolimit"] = *isoband.lolimit;
+        if (isoband.hilimit)
+          hash["hilimit"] = *isoband.hilimit;
+        theState.addAttributes(theGlobals, hash, isoband.attributes);
+        theState.addContour(theGlobals, timekey, "isobands", *name, hash, geom);
+      }
+    }
+
+    if (!isolines.empty())
+    {
+      const auto& geoms = contours->isolines(theState);
+      for (const auto& isoline : isolines)
+      {
+        auto index = contours->isolineIndex(isoline);
+        if (index >= geoms.size())
+          continue;
+
+        const OGRGeometryPtr& geom = geoms[index];
+        theState.updateEnvelope(geom);
+
+        CTPP::CDT hash(CTPP::CDT::HASH_VAL);
+        if (isoline.value != 0)
+          hash["value"] = isoline.value;
+        theState.addAttributes(theGlobals, hash, isoline.attributes);
+        theState.addContour(theGlobals, timekey, "isolines", *name, hash, geom);
+      }
+    }
+  }
+  catch (const DeadlineExceeded&)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
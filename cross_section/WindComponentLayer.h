@@ -0,0 +1,62 @@
+// ======================================================================
+/*!
+ * \brief Wind component layer
+ *
+ * Contours the component of the wind along or across the route. The
+ * U and V components are fetched once per timestep, and rotated at
+ * each column by the direction of the route. The along component is
+ * positive in the direction of the route, the across component to the
+ * right of it. The U and V components must be relative to north.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "ContourGroup.h"
+#include "Isoband.h"
+#include "Isoline.h"
+#include "Layer.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Plugin
+{
+namespace CrossSection
+{
+class Config;
+class State;
+
+class WindComponentLayer : public Layer
+{
+ public:
+  WindComponentLayer();
+
+  void init(const Json::Value& theJson, const Config& theConfig) override;
+
+  void generate(CTPP::CDT& theGlobals, State& theState) override;
+
+  std::string u;
+  std::string v;
+  std::string component;            // along|across
+  std::optional<std::string> name;  // parameter name in the output
+  std::optional<std::string> zparameter;
+  std::vector<Isoband> isobands;
+  std::vector<Isoline> isolines;
+  std::string interpolation;
+
+  std::optional<double> multiplier;
+  std::optional<double> offset;
+
+  // Possibly shared with other layers contouring the same component
+  std::shared_ptr<ContourGroup> contours;
+
+ private:
+};  // class WindComponentLayer
+
+}  // namespace CrossSection
+}  // namespace Plugin
+}  // namespace SmartMet
@@ -59,6 +59,7 @@ Obsoletes: smartmet-brainstorm-csection < 16.11.1
 Obsoletes: smartmet-brainstorm-csection-debuginfo < 16.11.1
 #TestRequires: smartmet-utils-devel >= 26.7.14
 #TestRequires: smartmet-library-spine-plugin-test >= 26.7.16
+#TestRequires: smartmet-library-regression
 #TestRequires: smartmet-library-newbase-devel >= 26.7.14
 #TestRequires: smartmet-engine-contour >= 26.6.24
 #TestRequires: smartmet-engine-geonames >= 26.6.26
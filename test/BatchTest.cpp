@@ -0,0 +1,124 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for batch request utilities
+ */
+// ======================================================================
+
+#include "Batch.h"
+#include <regression/tframe.h>
+#include <atomic>
+#include <stdexcept>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+void route()
+{
+  auto waypoints = parse_route("24.9,60.2;25.7,62.2;27.7,64.2");
+  if (waypoints.size() != 3)
+    TEST_FAILED("Expected 3 waypoints, got " + std::to_string(waypoints.size()));
+  if (waypoints[1].longitude != 25.7 || waypoints[1].latitude != 62.2)
+    TEST_FAILED("The second waypoint was parsed incorrectly");
+
+  for (const char* bad : {"24.9,60.2", "24.9,60.2;25.7", "24.9,60.2;25.7,95"})
+  {
+    bool failed = false;
+    try
+    {
+      parse_route(bad);
+    }
+    catch (...)
+    {
+      failed = true;
+    }
+    if (!failed)
+      TEST_FAILED(std::string("Invalid route accepted: ") + bad);
+  }
+  TEST_PASSED();
+}
+
+void combine()
+{
+  auto result = combine_outputs({"{\"a\":1}", "{\"b\":2}"});
+  if (result != "{\"routes\":[{\"a\":1},{\"b\":2}]}")
+    TEST_FAILED("Unexpected combined output: " + result);
+  TEST_PASSED();
+}
+
+void parallel()
+{
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> counts(100);
+  run_parallel(pool, counts.size(), 4, [&](std::size_t theIndex) { ++counts[theIndex]; });
+
+  for (std::size_t i = 0; i < counts.size(); i++)
+    if (counts[i] != 1)
+      TEST_FAILED("Task " + std::to_string(i) + " was run " + std::to_string(counts[i]) +
+                  " times");
+  TEST_PASSED();
+}
+
+void error()
+{
+  ThreadPool pool(2);
+  std::string message;
+  try
+  {
+    run_parallel(pool,
+                 10,
+                 3,
+                 [](std::size_t theIndex)
+                 {
+                   if (theIndex == 5)
+                     throw std::runtime_error("task failed");
+                 });
+  }
+  catch (const std::runtime_error& e)
+  {
+    message = e.what();
+  }
+  if (message != "task failed")
+    TEST_FAILED("The error of the task should be rethrown unchanged, got '" + message + "'");
+  TEST_PASSED();
+}
+
+void nested()
+{
+  // Ensembles within batch routes use the same pool, which must not deadlock
+  // even when all its threads are busy
+
+  ThreadPool pool(1);
+  std::atomic<int> count{0};
+  run_parallel(pool,
+               4,
+               4,
+               [&](std::size_t /* theIndex */)
+               { run_parallel(pool, 4, 4, [&](std::size_t /* theIndex */) { ++count; }); });
+
+  if (count != 16)
+    TEST_FAILED("Expected 16 tasks, got " + std::to_string(count));
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(route);
+    TEST(combine);
+    TEST(parallel);
+    TEST(error);
+    TEST(nested);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nBatchTest\n=========\n";
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,223 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class Coalescer
+ */
+// ======================================================================
+
+#include "Coalescer.h"
+#include <regression/tframe.h>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+const std::chrono::milliseconds timeout(5000);
+
+// Failures of the leader are either shared or its own
+
+const auto shared_failure = [](const std::exception_ptr&) { return false; };
+const auto own_failure = [](const std::exception_ptr&) { return true; };
+
+void shared()
+{
+  Coalescer<std::string> coalescer;
+  std::promise<void> go;
+  auto gate = go.get_future().share();
+  std::atomic<int> calls{0};
+  std::string leader_result;
+  std::string follower_result;
+
+  std::thread leader(
+      [&]()
+      {
+        leader_result = coalescer.run(
+            "key",
+            [&]()
+            {
+              ++calls;
+              gate.wait();
+              return std::string("leader");
+            },
+            timeout,
+            shared_failure);
+      });
+
+  while (coalescer.size() == 0)
+    std::this_thread::yield();
+
+  std::thread follower(
+      [&]()
+      {
+        follower_result = coalescer.run(
+            "key",
+            [&]()
+            {
+              ++calls;
+              return std::string("follower");
+            },
+            timeout,
+            shared_failure);
+      });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  go.set_value();
+  leader.join();
+  follower.join();
+
+  if (calls != 1)
+    TEST_FAILED("Expected one computation, got " + std::to_string(calls));
+  if (leader_result != "leader" || follower_result != "leader")
+    TEST_FAILED("Expected both requests to get the leader result, got " + leader_result + " and " +
+                follower_result);
+  if (coalescer.size() != 0)
+    TEST_FAILED("The key should be forgotten after the computation");
+  TEST_PASSED();
+}
+
+template <typename Predicate>
+std::string follow_failure(Predicate&& thePredicate, int& theCalls)
+{
+  Coalescer<std::string> coalescer;
+  std::promise<void> go;
+  auto gate = go.get_future().share();
+  std::string follower_result;
+  theCalls = 0;
+
+  std::thread leader(
+      [&]()
+      {
+        try
+        {
+          coalescer.run(
+              "key",
+              [&]() -> std::string
+              {
+                ++theCalls;
+                gate.wait();
+                throw std::runtime_error("leader failed");
+              },
+              timeout,
+              thePredicate);
+        }
+        catch (...)
+        {
+        }
+      });
+
+  while (coalescer.size() == 0)
+    std::this_thread::yield();
+
+  std::thread follower(
+      [&]()
+      {
+        try
+        {
+          follower_result = coalescer.run(
+              "key",
+              [&]()
+              {
+                ++theCalls;
+                return std::string("follower");
+              },
+              timeout,
+              thePredicate);
+        }
+        catch (const std::runtime_error& e)
+        {
+          follower_result = e.what();
+        }
+      });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  go.set_value();
+  leader.join();
+  follower.join();
+  return follower_result;
+}
+
+void data_error()
+{
+  int calls = 0;
+  auto result = follow_failure(shared_failure, calls);
+  if (result != "leader failed")
+    TEST_FAILED("The follower should get the error of the leader, got " + result);
+  if (calls != 1)
+    TEST_FAILED("Expected one computation, got " + std::to_string(calls));
+  TEST_PASSED();
+}
+
+void leader_failure()
+{
+  int calls = 0;
+  auto result = follow_failure(own_failure, calls);
+  if (result != "follower")
+    TEST_FAILED("The follower should rerun the computation, got " + result);
+  if (calls != 2)
+    TEST_FAILED("Expected two computations, got " + std::to_string(calls));
+  TEST_PASSED();
+}
+
+void wait_timeout()
+{
+  Coalescer<std::string> coalescer;
+  std::promise<void> go;
+  auto gate = go.get_future().share();
+  bool timed_out = false;
+
+  std::thread leader(
+      [&]()
+      {
+        coalescer.run(
+            "key",
+            [&]()
+            {
+              gate.wait();
+              return std::string("leader");
+            },
+            timeout);
+      });
+
+  while (coalescer.size() == 0)
+    std::this_thread::yield();
+
+  try
+  {
+    coalescer.run(
+        "key", []() { return std::string("follower"); }, std::chrono::milliseconds(50));
+  }
+  catch (const CoalesceTimeout&)
+  {
+    timed_out = true;
+  }
+
+  go.set_value();
+  leader.join();
+
+  if (!timed_out)
+    TEST_FAILED("The follower should time out waiting for the leader");
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(shared);
+    TEST(data_error);
+    TEST(leader_failure);
+    TEST(wait_timeout);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nCoalescerTest\n=============\n";
+  Tests::tests t;
+  return t.run();
+}
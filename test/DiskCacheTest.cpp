@@ -0,0 +1,178 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class DiskCache
+ */
+// ======================================================================
+
+#include "DiskCache.h"
+#include "KeyHash.h"
+#include <regression/tframe.h>
+#include <fstream>
+#include <thread>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+// A fresh cache directory for each test
+
+std::filesystem::path directory(const std::string& theName)
+{
+  auto dir = std::filesystem::temp_directory_path() / ("DiskCacheTest-" + theName);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+void touch(const std::filesystem::path& thePath)
+{
+  std::ofstream out(thePath);
+  out << "x";
+}
+
+void roundtrip()
+{
+  auto dir = directory("roundtrip");
+  std::string data("binary\0data", 11);
+
+  {
+    DiskCache cache(dir, 1000000);
+    cache.insert("key", "generation", data);
+
+    auto entry = cache.find("key", "generation");
+    if (!entry)
+      TEST_FAILED("Inserted entry not found");
+    if (entry->data != data)
+      TEST_FAILED("Data changed in the round trip");
+    if (entry->created == 0)
+      TEST_FAILED("Creation time not stored");
+  }
+
+  // A restarted server finds the entry
+
+  DiskCache cache(dir, 1000000);
+  auto entry = cache.find("key", "generation");
+  if (!entry || entry->data != data)
+    TEST_FAILED("Entry not found after a restart");
+
+  std::filesystem::remove_all(dir);
+  TEST_PASSED();
+}
+
+void generation()
+{
+  auto dir = directory("generation");
+  DiskCache cache(dir, 1000000);
+  cache.insert("key", "old", "data");
+
+  if (cache.find("key", "new"))
+    TEST_FAILED("Entry of another generation should not be found");
+
+  // The entry of the new data replaces the old one
+
+  cache.insert("key", "new", "new data");
+  auto entry = cache.find("key", "new");
+  if (!entry || entry->data != "new data")
+    TEST_FAILED("Entry of the new generation should be found");
+  if (cache.size() != std::filesystem::file_size(dir / (key_hash("key") + ".bin")))
+    TEST_FAILED("The replaced entry should not be counted in the size");
+
+  // A request still using the old data must not remove the new entry
+
+  if (cache.find("key", "old"))
+    TEST_FAILED("Entry of another generation should not be found");
+  if (!cache.find("key", "new"))
+    TEST_FAILED("Entry of the new generation should not have been removed");
+
+  std::filesystem::remove_all(dir);
+  TEST_PASSED();
+}
+
+void corrupted()
+{
+  auto dir = directory("corrupted");
+  DiskCache cache(dir, 1000000);
+  cache.insert("key", "generation", "data");
+
+  const auto path = dir / (key_hash("key") + ".bin");
+  touch(path);
+
+  if (cache.find("key", "generation"))
+    TEST_FAILED("A corrupted entry should not be found");
+  if (std::filesystem::exists(path))
+    TEST_FAILED("A corrupted entry should have been removed");
+  if (cache.size() != 0)
+    TEST_FAILED("Cache should be empty, size is " + std::to_string(cache.size()));
+
+  std::filesystem::remove_all(dir);
+  TEST_PASSED();
+}
+
+void foreign_files()
+{
+  auto dir = directory("foreign");
+  const auto tmpfile = dir / (key_hash("key") + ".bin.7.tmp");
+  const auto other = dir / "notes.tmp";
+  const auto lookalike = dir / "cache.bin";
+
+  touch(tmpfile);
+  touch(other);
+  touch(lookalike);
+
+  DiskCache cache(dir, 1000000);
+
+  if (std::filesystem::exists(tmpfile))
+    TEST_FAILED("Leftover temporary file should have been removed");
+  if (!std::filesystem::exists(other) || !std::filesystem::exists(lookalike))
+    TEST_FAILED("Files not made by the cache should be left alone");
+  if (cache.size() != 0)
+    TEST_FAILED("Foreign files should not be counted, size is " + std::to_string(cache.size()));
+
+  std::filesystem::remove_all(dir);
+  TEST_PASSED();
+}
+
+void eviction()
+{
+  auto dir = directory("eviction");
+  const std::string data(100, 'x');
+  DiskCache cache(dir, 1000);
+
+  for (int i = 0; i < 20; i++)
+  {
+    cache.insert("key" + std::to_string(i), "generation", data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  if (cache.size() > 1000)
+    TEST_FAILED("Cache exceeds its limit, size is " + std::to_string(cache.size()));
+  if (cache.find("key0", "generation"))
+    TEST_FAILED("The least recently used entry should have been evicted");
+  if (!cache.find("key19", "generation"))
+    TEST_FAILED("The latest entry should still be cached");
+
+  std::filesystem::remove_all(dir);
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(roundtrip);
+    TEST(generation);
+    TEST(corrupted);
+    TEST(foreign_files);
+    TEST(eviction);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nDiskCacheTest\n=============\n";
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,224 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for ensemble statistics
+ */
+// ======================================================================
+
+#include "Ensemble.h"
+#include <macgyver/Exception.h>
+#include <regression/tframe.h>
+#include <cmath>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+// A single column grid with the given values at heights 0, 100, 200...
+
+VerticalGridPtr member(const std::vector<float>& theValues, double theHeightOffset = 0)
+{
+  auto grid = std::make_shared<VerticalGrid>();
+  grid->width = 1;
+  grid->height = static_cast<uint>(theValues.size());
+  grid->values = theValues;
+  for (std::size_t i = 0; i < theValues.size(); i++)
+    grid->coordinates.emplace_back(10.0, 100.0 * static_cast<double>(i) + theHeightOffset);
+  return grid;
+}
+
+Ensemble settings(const std::string& theStatistic)
+{
+  Ensemble ensemble;
+  ensemble.statistic = theStatistic;
+  ensemble.members = {1, 2, 3, 4};
+  return ensemble;
+}
+
+std::vector<VerticalGridPtr> members()
+{
+  return {member({1, 10}), member({2, 20}), member({3, 30}), member({6, 40})};
+}
+
+bool close(float theValue, double theExpected)
+{
+  return std::abs(theValue - theExpected) < 1e-4;
+}
+
+std::string values(const VerticalGridPtr& theGrid)
+{
+  std::string ret;
+  for (auto value : theGrid->values)
+    ret += (ret.empty() ? "" : ",") + std::to_string(value);
+  return ret;
+}
+
+void moments()
+{
+  auto grid = ensemble_statistic(members(), settings("mean"));
+  if (!grid || !close(grid->values[0], 3) || !close(grid->values[1], 25))
+    TEST_FAILED("Mean should be 3,25, not " + values(grid));
+
+  grid = ensemble_statistic(members(), settings("spread"));
+  if (!close(grid->values[0], std::sqrt(3.5)) || !close(grid->values[1], std::sqrt(125.0)))
+    TEST_FAILED("Spread should be 1.8708,11.1803, not " + values(grid));
+
+  TEST_PASSED();
+}
+
+void extremes()
+{
+  auto grid = ensemble_statistic(members(), settings("min"));
+  if (!close(grid->values[0], 1) || !close(grid->values[1], 10))
+    TEST_FAILED("Minimum should be 1,10, not " + values(grid));
+
+  grid = ensemble_statistic(members(), settings("max"));
+  if (!close(grid->values[0], 6) || !close(grid->values[1], 40))
+    TEST_FAILED("Maximum should be 6,40, not " + values(grid));
+
+  TEST_PASSED();
+}
+
+void percentiles()
+{
+  auto grid = ensemble_statistic(members(), settings("median"));
+  if (!close(grid->values[0], 2.5) || !close(grid->values[1], 25))
+    TEST_FAILED("Median should be 2.5,25, not " + values(grid));
+
+  auto ensemble = settings("percentile");
+  ensemble.percentile = 100;
+  grid = ensemble_statistic(members(), ensemble);
+  if (!close(grid->values[0], 6) || !close(grid->values[1], 40))
+    TEST_FAILED("100th percentile should be the maximum, not " + values(grid));
+
+  ensemble.percentile = 0;
+  grid = ensemble_statistic(members(), ensemble);
+  if (!close(grid->values[0], 1) || !close(grid->values[1], 10))
+    TEST_FAILED("0th percentile should be the minimum, not " + values(grid));
+
+  ensemble.percentile = 25;
+  grid = ensemble_statistic(members(), ensemble);
+  if (!close(grid->values[0], 1.75) || !close(grid->values[1], 17.5))
+    TEST_FAILED("25th percentile should be 1.75,17.5, not " + values(grid));
+
+  TEST_PASSED();
+}
+
+void probability()
+{
+  auto ensemble = settings("probability");
+  ensemble.threshold = 2.5;
+  auto grid = ensemble_statistic(members(), ensemble);
+  if (!close(grid->values[0], 50) || !close(grid->values[1], 100))
+    TEST_FAILED("Probability above 2.5 should be 50,100, not " + values(grid));
+
+  ensemble.below = true;
+  ensemble.threshold = 20;
+  grid = ensemble_statistic(members(), ensemble);
+  if (!close(grid->values[0], 100) || !close(grid->values[1], 25))
+    TEST_FAILED("Probability below 20 should be 100,25, not " + values(grid));
+
+  TEST_PASSED();
+}
+
+void missing_values()
+{
+  std::vector<VerticalGridPtr> grids = {member({1, ParamValueMissing}),
+                                        member({ParamValueMissing, ParamValueMissing}),
+                                        member({5, ParamValueMissing})};
+
+  auto grid = ensemble_statistic(grids, settings("mean"));
+  if (!close(grid->values[0], 3))
+    TEST_FAILED("Missing values should be ignored in the mean, got " + values(grid));
+  if (grid->values[1] != ParamValueMissing)
+    TEST_FAILED("A point missing from all members should stay missing, got " + values(grid));
+
+  grid = ensemble_statistic(grids, settings("median"));
+  if (!close(grid->values[0], 3) || grid->values[1] != ParamValueMissing)
+    TEST_FAILED("Missing values should be ignored in the median, got " + values(grid));
+
+  TEST_PASSED();
+}
+
+void coordinates()
+{
+  std::vector<VerticalGridPtr> grids = {member({1, 2}, 0), member({1, 2}, 10), nullptr};
+  auto grid = ensemble_statistic(grids, settings("mean"));
+
+  if (!grid || grid->width != 1 || grid->height != 2)
+    TEST_FAILED("Empty members should be skipped");
+  if (!close(grid->coordinates[1].x(), 10) || !close(grid->coordinates[1].y(), 105))
+    TEST_FAILED("Heights should be averaged over the members");
+
+  if (ensemble_statistic({nullptr}, settings("mean")))
+    TEST_FAILED("No members should produce no grid");
+
+  try
+  {
+    ensemble_statistic({member({1, 2}), member({1, 2, 3})}, settings("mean"));
+    TEST_FAILED("Members with different grids should be rejected");
+  }
+  catch (const Fmi::Exception&)
+  {
+  }
+
+  TEST_PASSED();
+}
+
+void init()
+{
+  Json::Value json;
+  json["statistic"] = "percentile";
+  json["percentile"] = 90;
+  json["members"] = 3;
+
+  Ensemble ensemble;
+  ensemble.init(json);
+  if (ensemble.members != std::vector<int>{1, 2, 3})
+    TEST_FAILED("A member count should select members 1...N");
+
+  Ensemble other;
+  other.init(json);
+  if (!(ensemble == other) || ensemble.key() != other.key())
+    TEST_FAILED("Identical settings should be equal and have the same key");
+
+  other.percentile = 10;
+  if (ensemble == other || ensemble.key() == other.key())
+    TEST_FAILED("A different percentile should change the key");
+
+  try
+  {
+    json["statistic"] = "mode";
+    Ensemble bad;
+    bad.init(json);
+    TEST_FAILED("Unknown statistics should be rejected");
+  }
+  catch (const Fmi::Exception&)
+  {
+  }
+
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(moments);
+    TEST(extremes);
+    TEST(percentiles);
+    TEST(probability);
+    TEST(missing_values);
+    TEST(coordinates);
+    TEST(init);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nEnsembleTest\n============\n";
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,252 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class Expression
+ */
+// ======================================================================
+
+#include "Expression.h"
+#include <grid-files/common/GeneralDefinitions.h>
+#include <macgyver/Exception.h>
+#include <regression/tframe.h>
+#include <cmath>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+// Evaluate at a single point
+
+float eval(const std::string& theText,
+           const std::vector<float>& theInputs,
+           float theZ = 0,
+           float theAzimuth = 0)
+{
+  Expression expression(theText);
+  std::vector<std::vector<float>> inputs;
+  for (auto value : theInputs)
+    inputs.push_back({value});
+  std::vector<const std::vector<float>*> pointers;
+  for (const auto& input : inputs)
+    pointers.push_back(&input);
+  return expression.evaluate(pointers, {theZ}, {theAzimuth}).front();
+}
+
+bool close(float theValue, double theExpected)
+{
+  return std::abs(theValue - theExpected) < 1e-4 * std::max(1.0, std::abs(theExpected));
+}
+
+bool fails(const std::string& theText)
+{
+  try
+  {
+    Expression expression(theText);
+    return false;
+  }
+  catch (const Fmi::Exception&)
+  {
+    return true;
+  }
+}
+
+void parameters()
+{
+  Expression expression("=sqrt(WindUMS^2 + WindVMS^2) + WindUMS - {T-K}");
+  const auto& names = expression.parameters();
+  if (names.size() != 3 || names[0] != "WindUMS" || names[1] != "WindVMS" || names[2] != "T-K")
+    TEST_FAILED("Parameters should be listed once in the order of appearance");
+  if (expression.usesAzimuth())
+    TEST_FAILED("The expression does not use the azimuth");
+
+  if (!Expression::isExpression("=T") || Expression::isExpression("Temperature") ||
+      Expression::isExpression(""))
+    TEST_FAILED("Only settings starting with '=' are expressions");
+
+  TEST_PASSED();
+}
+
+void precedence()
+{
+  float value = eval("=1 + a * 3", {2});
+  if (!close(value, 7))
+    TEST_FAILED("1+2*3 should be 7, not " + std::to_string(value));
+
+  value = eval("=(1 + a) * 3", {2});
+  if (!close(value, 9))
+    TEST_FAILED("(1+2)*3 should be 9, not " + std::to_string(value));
+
+  value = eval("=a - 1 - 1", {5});
+  if (!close(value, 3))
+    TEST_FAILED("Subtraction should be left associative, got " + std::to_string(value));
+
+  value = eval("=a / 2 / 2", {8});
+  if (!close(value, 2))
+    TEST_FAILED("Division should be left associative, got " + std::to_string(value));
+
+  value = eval("=a ^ 3 ^ 2", {2});
+  if (!close(value, 512))
+    TEST_FAILED("Powers should be right associative, got " + std::to_string(value));
+
+  value = eval("=-a ^ 2", {3});
+  if (!close(value, -9))
+    TEST_FAILED("-3^2 should be -9, not " + std::to_string(value));
+
+  value = eval("=a ^ -1", {4});
+  if (!close(value, 0.25))
+    TEST_FAILED("4^-1 should be 0.25, not " + std::to_string(value));
+
+  TEST_PASSED();
+}
+
+void functions()
+{
+  if (!close(eval("=sqrt(a^2 + b^2)", {3, 4}), 5))
+    TEST_FAILED("Wind speed from the components failed");
+  if (!close(eval("=abs(a)", {-2}), 2))
+    TEST_FAILED("abs failed");
+  if (!close(eval("=log(exp(a))", {1.5}), 1.5))
+    TEST_FAILED("log or exp failed");
+  if (!close(eval("=log10(a)", {1000}), 3))
+    TEST_FAILED("log10 failed");
+  if (!close(eval("=sin(a) + cos(a)", {90}), 1))
+    TEST_FAILED("sin and cos should take degrees");
+  if (!close(eval("=tan(a)", {45}), 1))
+    TEST_FAILED("tan should take degrees");
+  if (!close(eval("=atan(a)", {1}), 45))
+    TEST_FAILED("atan should return degrees");
+  if (!close(eval("=atan2(a, b)", {1, -1}), 135))
+    TEST_FAILED("atan2 should return degrees");
+  if (!close(eval("=pow(a, 2)", {3}), 9))
+    TEST_FAILED("pow failed");
+  if (!close(eval("=min(a, b) + max(a, b) * 10", {1, 2}), 21))
+    TEST_FAILED("min or max failed");
+  if (!close(eval("=a * 1.5e1 + .5", {2}), 30.5))
+    TEST_FAILED("Number formats failed");
+
+  TEST_PASSED();
+}
+
+void coordinates()
+{
+  float value = eval("=a + z / 1000", {10}, 2500);
+  if (!close(value, 12.5))
+    TEST_FAILED("z should be the vertical coordinate, got " + std::to_string(value));
+
+  Expression expression("=u * sin(azimuth) + v * cos(azimuth)");
+  if (!expression.usesAzimuth())
+    TEST_FAILED("The expression uses the azimuth");
+
+  value = eval("=u * sin(azimuth) + v * cos(azimuth)", {3, 4}, 0, 90);
+  if (!close(value, 3))
+    TEST_FAILED("Along route component should be 3 towards east, got " + std::to_string(value));
+
+  // Evaluation without azimuths fails only if they are needed
+
+  std::vector<float> u{3};
+  std::vector<float> v{4};
+  try
+  {
+    expression.evaluate({&u, &v}, {0});
+    TEST_FAILED("Missing azimuths should be an error");
+  }
+  catch (const Fmi::Exception&)
+  {
+  }
+
+  Expression speed("=sqrt(u^2 + v^2)");
+  if (!close(speed.evaluate({&u, &v}, {0}).front(), 5))
+    TEST_FAILED("Azimuths should not be needed when not used");
+
+  TEST_PASSED();
+}
+
+void missing_values()
+{
+  Expression expression("=a / b");
+  std::vector<float> a{1, ParamValueMissing, 1, 4};
+  std::vector<float> b{2, 2, 0, ParamValueMissing};
+  std::vector<float> z{0, 0, 0, 0};
+
+  auto result = expression.evaluate({&a, &b}, z);
+  if (result.size() != 4 || !close(result[0], 0.5))
+    TEST_FAILED("1/2 should be 0.5");
+  if (result[1] != ParamValueMissing || result[3] != ParamValueMissing)
+    TEST_FAILED("Missing inputs should give missing results");
+  if (result[2] != ParamValueMissing)
+    TEST_FAILED("Non-finite results should be missing");
+
+  // A missing value must not leak through a function that hides it
+
+  Expression hidden("=min(a, 0) * 0 + 1");
+  result = hidden.evaluate({&a}, z);
+  if (result[1] != ParamValueMissing || !close(result[0], 1))
+    TEST_FAILED("Missing inputs should be missing regardless of the operations");
+
+  TEST_PASSED();
+}
+
+void errors()
+{
+  if (!fails("=1 + 2"))
+    TEST_FAILED("Expressions without parameters should be rejected");
+  if (!fails("=a +"))
+    TEST_FAILED("Truncated expressions should be rejected");
+  if (!fails("=(a + 1"))
+    TEST_FAILED("Unbalanced parentheses should be rejected");
+  if (!fails("=a + 1)"))
+    TEST_FAILED("Trailing characters should be rejected");
+  if (!fails("=foo(a)"))
+    TEST_FAILED("Unknown functions should be rejected");
+  if (!fails("=atan2(a)"))
+    TEST_FAILED("Wrong argument counts should be rejected");
+  if (!fails("={} + a"))
+    TEST_FAILED("Empty braces should be rejected");
+  if (!fails("=a $ b"))
+    TEST_FAILED("Invalid characters should be rejected");
+
+  Expression expression("=a + b");
+  std::vector<float> a{1, 2};
+  std::vector<float> b{1};
+  try
+  {
+    expression.evaluate({&a, &b}, {0, 0});
+    TEST_FAILED("Inputs of different sizes should be rejected");
+  }
+  catch (const Fmi::Exception&)
+  {
+  }
+
+  try
+  {
+    expression.evaluate({&a}, {0, 0});
+    TEST_FAILED("A wrong number of inputs should be rejected");
+  }
+  catch (const Fmi::Exception&)
+  {
+  }
+
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(parameters);
+    TEST(precedence);
+    TEST(functions);
+    TEST(coordinates);
+    TEST(missing_values);
+    TEST(errors);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nExpressionTest\n==============\n";
+  Tests::tests t;
+  return t.run();
+}
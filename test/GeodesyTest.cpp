@@ -0,0 +1,153 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for geodetic route utilities
+ */
+// ======================================================================
+
+#include "Geodesy.h"
+#include <regression/tframe.h>
+#include <cmath>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+bool near(double theValue, double theExpected, double theTolerance)
+{
+  return std::abs(theValue - theExpected) <= theTolerance;
+}
+
+void distance()
+{
+  // One degree along the equator and along a meridian
+
+  auto d1 = geodistance(0, 0, 1, 0);
+  if (!near(d1, 111.2, 0.1))
+    TEST_FAILED("Expected 111.2 km along the equator, got " + std::to_string(d1));
+  auto d2 = geodistance(25, 60, 25, 61);
+  if (!near(d2, 111.2, 0.1))
+    TEST_FAILED("Expected 111.2 km along a meridian, got " + std::to_string(d2));
+  if (geodistance(25, 60, 25, 60) != 0)
+    TEST_FAILED("Distance to the point itself should be zero");
+  TEST_PASSED();
+}
+
+void automatic_steps()
+{
+  // 100 km with 10 km grid spacing and double oversampling
+
+  if (auto_steps(100, 10, 2, 1000) != 20)
+    TEST_FAILED("Expected 20 steps, got " + std::to_string(auto_steps(100, 10, 2, 1000)));
+
+  // Partial steps are rounded upwards
+
+  if (auto_steps(101, 10, 1, 1000) != 11)
+    TEST_FAILED("Expected 11 steps, got " + std::to_string(auto_steps(101, 10, 1, 1000)));
+
+  // The maximum and the minimum of two steps
+
+  if (auto_steps(10000, 1, 2, 500) != 500)
+    TEST_FAILED("Expected 500 steps, got " + std::to_string(auto_steps(10000, 1, 2, 500)));
+  if (auto_steps(1, 10, 1, 1000) != 2)
+    TEST_FAILED("Expected 2 steps, got " + std::to_string(auto_steps(1, 10, 1, 1000)));
+
+  bool failed = false;
+  try
+  {
+    auto_steps(100, 0, 1, 1000);
+  }
+  catch (...)
+  {
+    failed = true;
+  }
+  if (!failed)
+    TEST_FAILED("Zero grid spacing should be rejected");
+  TEST_PASSED();
+}
+
+void polyline()
+{
+  // Segments of 1 and 2 degrees along the equator
+
+  const Waypoints route{{0, 0}, {1, 0}, {3, 0}};
+  auto length = route_length(route);
+  if (!near(length, 3 * 111.2, 0.3))
+    TEST_FAILED("Expected a route of 333.6 km, got " + std::to_string(length));
+
+  auto steps = segment_steps(route, 30);
+  if (steps.size() != 2 || steps[0] != 10 || steps[1] != 20)
+    TEST_FAILED("Steps should be divided in proportion to the segment lengths");
+
+  // A single segment gets all the steps, an empty segment none
+
+  auto single = segment_steps({{0, 0}, {3, 0}}, 7);
+  if (single.size() != 1 || single[0] != 7)
+    TEST_FAILED("A single segment should get all the steps");
+
+  auto repeated = segment_steps({{0, 0}, {0, 0}, {3, 0}}, 30);
+  if (repeated.size() != 2 || repeated[0] != 0 || repeated[1] != 30)
+    TEST_FAILED("An empty segment should get no steps");
+
+  // Each nonempty segment gets at least one step
+
+  auto short_segment = segment_steps({{0, 0}, {0.01, 0}, {3, 0}}, 10);
+  if (short_segment.size() != 2 || short_segment[0] != 1)
+    TEST_FAILED("A short segment should get at least one step");
+  TEST_PASSED();
+}
+
+void azimuths()
+{
+  // East along the equator, then north along a meridian
+
+  const Waypoints route{{0, 0}, {1, 0}, {1, 1}};
+  auto az = route_azimuths(route, {0, 50, 111.19, 160, 222.39});
+  if (az.size() != 5)
+    TEST_FAILED("Expected one azimuth per distance");
+  if (!near(az[0], 90, 0.01) || !near(az[1], 90, 0.01) || !near(az[2], 90, 0.01))
+    TEST_FAILED("The first segment should point east, got " + std::to_string(az[1]));
+  if (!near(az[3], 0, 0.01) && !near(az[3], 360, 0.01))
+    TEST_FAILED("The second segment should point north, got " + std::to_string(az[3]));
+  if (!near(az[4], 0, 0.01) && !near(az[4], 360, 0.01))
+    TEST_FAILED("The end of the route should point north, got " + std::to_string(az[4]));
+
+  // Westwards, decreasing distances and empty segments
+
+  auto west = route_azimuths({{1, 0}, {1, 0}, {0, 0}}, {100, 10});
+  if (!near(west[0], 270, 0.01) || !near(west[1], 270, 0.01))
+    TEST_FAILED("An empty segment should be skipped, got " + std::to_string(west[1]));
+
+  bool failed = false;
+  try
+  {
+    route_azimuths({{0, 0}}, {0});
+  }
+  catch (...)
+  {
+    failed = true;
+  }
+  if (!failed)
+    TEST_FAILED("A single point route has no direction");
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(distance);
+    TEST(automatic_steps);
+    TEST(polyline);
+    TEST(azimuths);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nGeodesyTest\n===========\n";
+  Tests::tests t;
+  return t.run();
+}
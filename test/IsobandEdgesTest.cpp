@@ -0,0 +1,173 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for isolines extracted from isoband edges
+ *
+ * The derived isolines must coincide with the isolines contoured
+ * directly from the same data.
+ */
+// ======================================================================
+
+#include "Topology.h"
+#include <grid-files/common/GraphFunctions.h>
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <cmath>
+#include <functional>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+const uint width = 21;
+const uint height = 15;
+
+// Contour a synthetic field the same way as ContourGroup does
+
+struct Field
+{
+  std::vector<float> values;
+  std::vector<T::Coordinate> coordinates;
+
+  explicit Field(const std::function<float(double, double)>& theFunction)
+  {
+    for (uint j = 0; j < height; j++)
+      for (uint i = 0; i < width; i++)
+      {
+        values.push_back(theFunction(i, j));
+        coordinates.emplace_back(i, j);
+      }
+  }
+};
+
+std::vector<OGRGeometryPtr> to_geometries(const T::ByteData_vec& theContours)
+{
+  std::vector<OGRGeometryPtr> geoms;
+  for (const auto& wkb : theContours)
+  {
+    const auto* cwkb = reinterpret_cast<const unsigned char*>(wkb.data());
+    OGRGeometry* geom = nullptr;
+    OGRGeometryFactory::createFromWkb(cwkb, nullptr, &geom, wkb.size());
+    geoms.push_back(OGRGeometryPtr(geom));
+  }
+  return geoms;
+}
+
+std::vector<OGRGeometryPtr> isobands(const Field& theField, const std::vector<float>& theLimits)
+{
+  auto values = theField.values;
+  auto coordinates = theField.coordinates;
+  std::vector<float> lo{-1000000000};
+  std::vector<float> hi;
+  for (auto limit : theLimits)
+  {
+    hi.push_back(limit);
+    lo.push_back(limit);
+  }
+  hi.push_back(1000000000);
+
+  T::ByteData_vec contours;
+  getIsobands(values,
+              &coordinates,
+              width,
+              height,
+              lo,
+              hi,
+              T::AreaInterpolationMethod::Linear,
+              0,
+              1,
+              contours);
+  return to_geometries(contours);
+}
+
+std::vector<OGRGeometryPtr> isolines(const Field& theField, std::vector<float> theValues)
+{
+  auto values = theField.values;
+  auto coordinates = theField.coordinates;
+  T::ByteData_vec contours;
+  getIsolines(values,
+              &coordinates,
+              width,
+              height,
+              theValues,
+              T::AreaInterpolationMethod::Linear,
+              0,
+              1,
+              contours);
+  return to_geometries(contours);
+}
+
+// Compare the derived and directly contoured isolines of all the limits
+
+std::string compare(const Field& theField, const std::vector<float>& theLimits)
+{
+  std::vector<std::pair<std::size_t, std::size_t>> edges;
+  for (std::size_t i = 0; i < theLimits.size(); i++)
+    edges.emplace_back(i, i + 1);
+
+  const auto derived = isoband_edges(isobands(theField, theLimits), edges, 1e-4);
+  const auto direct = isolines(theField, theLimits);
+
+  if (derived.size() != direct.size())
+    return "Expected " + std::to_string(direct.size()) + " isolines, got " +
+           std::to_string(derived.size());
+
+  for (std::size_t i = 0; i < derived.size(); i++)
+  {
+    const auto* d = dynamic_cast<const OGRMultiLineString*>(derived[i].get());
+    const auto* c = dynamic_cast<const OGRMultiCurve*>(direct[i].get());
+    if (d == nullptr || c == nullptr)
+      return "Isoline " + std::to_string(theLimits[i]) + " is not a multilinestring";
+
+    if (std::abs(d->get_Length() - c->get_Length()) > 1e-3)
+      return "Isoline " + std::to_string(theLimits[i]) + " length " +
+             std::to_string(d->get_Length()) + " differs from " + std::to_string(c->get_Length());
+
+    // Every derived vertex must be on the directly contoured line
+
+    for (const auto* line : *d)
+      for (const auto& point : *line)
+        if (point.Distance(direct[i].get()) > 1e-3)
+          return "Isoline " + std::to_string(theLimits[i]) + " deviates from the contoured line";
+  }
+  return "";
+}
+
+void ramp()
+{
+  Field field([](double x, double y) { return static_cast<float>(x + 0.5 * y); });
+  auto err = compare(field, {3.3F, 7.1F, 12.9F});
+  if (!err.empty())
+    TEST_FAILED(err);
+  TEST_PASSED();
+}
+
+void bump()
+{
+  // Closed isolines around a maximum inside the grid
+  Field field(
+      [](double x, double y)
+      { return static_cast<float>(100 - (x - 10) * (x - 10) - 2 * (y - 7) * (y - 7)); });
+  auto err = compare(field, {20.5F, 60.5F, 90.5F});
+  if (!err.empty())
+    TEST_FAILED(err);
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(ramp);
+    TEST(bump);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nIsobandEdgesTest\n================\n";
+  Tests::tests t;
+  return t.run();
+}
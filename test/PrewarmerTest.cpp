@@ -0,0 +1,164 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class Prewarmer
+ */
+// ======================================================================
+
+#include "Prewarmer.h"
+#include <regression/tframe.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+// Render callback which blocks until released, or for a while if a test fails
+
+class Renderer
+{
+ public:
+  void render(const Prewarmer::Job& /* theJob */)
+  {
+    std::unique_lock<std::mutex> lock(itsMutex);
+    ++itsStarted;
+    itsCondition.notify_all();
+    itsCondition.wait_for(lock, std::chrono::seconds(5), [this] { return itsReleased; });
+    ++itsFinished;
+    itsCondition.notify_all();
+  }
+
+  void waitStarted(int theCount)
+  {
+    std::unique_lock<std::mutex> lock(itsMutex);
+    itsCondition.wait(lock, [&] { return itsStarted >= theCount; });
+  }
+
+  void waitFinished(int theCount)
+  {
+    std::unique_lock<std::mutex> lock(itsMutex);
+    itsCondition.wait(lock, [&] { return itsFinished >= theCount; });
+  }
+
+  void release()
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsReleased = true;
+    itsCondition.notify_all();
+  }
+
+  int started()
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    return itsStarted;
+  }
+
+ private:
+  std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  int itsStarted = 0;
+  int itsFinished = 0;
+  bool itsReleased = false;
+};
+
+const Prewarmer::Job job{{"product", "test"}};
+
+void submitted_in_flight()
+{
+  Renderer renderer;
+  Prewarmer prewarmer(
+      {},
+      2,
+      std::chrono::seconds(1),
+      [](const Prewarmer::Job&) { return std::string(); },
+      [&](const Prewarmer::Job& theJob) { renderer.render(theJob); });
+  prewarmer.start();
+
+  prewarmer.submit(job);
+  renderer.waitStarted(1);
+
+  // The same job is already being rendered by one of the workers
+
+  prewarmer.submit(job);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  renderer.release();
+  renderer.waitFinished(1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  if (renderer.started() != 1)
+    TEST_FAILED("A job being rendered should not be rendered again, renders: " +
+                std::to_string(renderer.started()));
+
+  // Once finished the job can be submitted again
+
+  prewarmer.submit(job);
+  renderer.waitFinished(2);
+  prewarmer.stop();
+  TEST_PASSED();
+}
+
+void new_data_in_flight()
+{
+  Renderer renderer;
+  std::mutex mutex;
+  std::string generation = "gen1";
+
+  Prewarmer prewarmer(
+      {job},
+      2,
+      std::chrono::seconds(1),
+      [&](const Prewarmer::Job&)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        return generation;
+      },
+      [&](const Prewarmer::Job& theJob) { renderer.render(theJob); });
+  prewarmer.start();
+
+  // New data arrives while the old data is being rendered
+
+  renderer.waitStarted(1);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation = "gen2";
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+  if (renderer.started() != 1)
+    TEST_FAILED("A job being rendered should not be rendered in parallel");
+
+  // The new data is rendered after the old once
+
+  renderer.release();
+  renderer.waitStarted(2);
+  renderer.waitFinished(2);
+
+  // but not again for the same data
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+  if (renderer.started() != 2)
+    TEST_FAILED("The job should be rendered once per data, renders: " +
+                std::to_string(renderer.started()));
+
+  prewarmer.stop();
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(submitted_in_flight);
+    TEST(new_data_in_flight);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nPrewarmerTest\n=============\n";
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,146 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class ResponseCache
+ */
+// ======================================================================
+
+#include "ResponseCache.h"
+#include <regression/tframe.h>
+#include <thread>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+const std::chrono::seconds soft_ttl(60);
+const std::chrono::seconds hard_ttl(3600);
+
+void fresh()
+{
+  ResponseCache cache(1000);
+  cache.insert("key", "response", "gen1");
+
+  auto lookup = cache.find("key", "gen1", soft_ttl, hard_ttl);
+  if (!lookup.response || *lookup.response != "response")
+    TEST_FAILED("Cached response not found");
+  if (lookup.stale || lookup.refresh)
+    TEST_FAILED("A new response of the current data should be fresh");
+
+  if (cache.find("other", "gen1", soft_ttl, hard_ttl).response)
+    TEST_FAILED("Found a response which was never cached");
+  TEST_PASSED();
+}
+
+void new_data()
+{
+  ResponseCache cache(1000);
+  cache.insert("key", "response", "gen1");
+
+  // The old response is served while a single caller refreshes it
+
+  auto first = cache.find("key", "gen2", soft_ttl, hard_ttl);
+  if (!first.response || !first.stale || !first.refresh)
+    TEST_FAILED("The response of old data should be served stale and refreshed");
+
+  auto second = cache.find("key", "gen2", soft_ttl, hard_ttl);
+  if (!second.response || !second.stale)
+    TEST_FAILED("The response of old data should still be served stale");
+  if (second.refresh)
+    TEST_FAILED("Only the first caller should refresh the response");
+
+  // The refresh replaces the response
+
+  cache.insert("key", "new response", "gen2");
+  auto third = cache.find("key", "gen2", soft_ttl, hard_ttl);
+  if (!third.response || *third.response != "new response" || third.stale)
+    TEST_FAILED("The refreshed response should be fresh");
+  TEST_PASSED();
+}
+
+void old_data_expiry()
+{
+  ResponseCache cache(1000);
+  cache.insert("key", "response", "gen1");
+
+  // Old data is served only for the soft TTL after new data was first requested
+
+  const std::chrono::seconds short_ttl(1);
+  if (!cache.find("key", "gen2", short_ttl, hard_ttl).response)
+    TEST_FAILED("The response of old data should be served within the soft TTL");
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  if (cache.find("key", "gen2", short_ttl, hard_ttl).response)
+    TEST_FAILED("The response of old data should expire after the soft TTL");
+
+  // Without a soft TTL old data is never served
+
+  cache.insert("key", "response", "gen2");
+  if (cache.find("key", "gen3", std::chrono::seconds(0), hard_ttl).response)
+    TEST_FAILED("The response of old data should not be served with a zero soft TTL");
+  TEST_PASSED();
+}
+
+void soft_expiry()
+{
+  ResponseCache cache(1000);
+  cache.insert("key", "response", "gen1", std::chrono::seconds(120));
+
+  auto lookup = cache.find("key", "gen1", soft_ttl, hard_ttl);
+  if (!lookup.response)
+    TEST_FAILED("A response older than the soft TTL should still be served");
+  if (!lookup.stale || !lookup.refresh)
+    TEST_FAILED("A response older than the soft TTL should be stale and refreshed");
+  TEST_PASSED();
+}
+
+void hard_expiry()
+{
+  ResponseCache cache(1000);
+  cache.insert("key", "response", "gen1", std::chrono::seconds(4000));
+
+  if (cache.find("key", "gen1", soft_ttl, hard_ttl).response)
+    TEST_FAILED("A response older than the hard TTL should not be served");
+  TEST_PASSED();
+}
+
+void eviction()
+{
+  ResponseCache cache(10);
+  cache.insert("key1", "123456", "gen1");
+  cache.insert("key2", "123456", "gen1");
+
+  if (cache.find("key1", "gen1", soft_ttl, hard_ttl).response)
+    TEST_FAILED("The least recently used response should have been evicted");
+  if (!cache.find("key2", "gen1", soft_ttl, hard_ttl).response)
+    TEST_FAILED("The latest response should still be cached");
+  if (cache.size() != 6)
+    TEST_FAILED("Expected size 6, got " + std::to_string(cache.size()));
+
+  cache.insert("key3", "12345678901", "gen1");
+  if (cache.find("key3", "gen1", soft_ttl, hard_ttl).response)
+    TEST_FAILED("A response larger than the cache should not be cached");
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(fresh);
+    TEST(new_data);
+    TEST(old_data_expiry);
+    TEST(soft_expiry);
+    TEST(hard_expiry);
+    TEST(eviction);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nResponseCacheTest\n=================\n";
+  Tests::tests t;
+  return t.run();
+}
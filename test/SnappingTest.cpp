@@ -0,0 +1,112 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for route snapping
+ */
+// ======================================================================
+
+#include "Query.h"
+#include "Snapping.h"
+#include <regression/tframe.h>
+#include <macgyver/StringConversion.h>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+Query make_query(const Waypoints& theWaypoints, std::size_t theSteps)
+{
+  Query query;
+  query.waypoints = theWaypoints;
+  query.steps = theSteps;
+  return query;
+}
+
+void coordinate()
+{
+  if (snap_coordinate(24.937, 0.1) != 24.9)
+    TEST_FAILED("Expected 24.9, got " + Fmi::to_string(snap_coordinate(24.937, 0.1)));
+  if (snap_coordinate(-24.96, 0.1) != -25.0)
+    TEST_FAILED("Expected -25, got " + Fmi::to_string(snap_coordinate(-24.96, 0.1)));
+  if (snap_coordinate(24.937, 0) != 24.937)
+    TEST_FAILED("Zero resolution should not change the coordinate");
+  TEST_PASSED();
+}
+
+void steps()
+{
+  const std::vector<std::size_t> allowed{50, 100, 200};
+  if (snap_steps(10, allowed) != 50)
+    TEST_FAILED("Expected 50 steps, got " + Fmi::to_string(snap_steps(10, allowed)));
+  if (snap_steps(100, allowed) != 100)
+    TEST_FAILED("Expected 100 steps, got " + Fmi::to_string(snap_steps(100, allowed)));
+  if (snap_steps(101, allowed) != 200)
+    TEST_FAILED("Expected 200 steps, got " + Fmi::to_string(snap_steps(101, allowed)));
+  if (snap_steps(500, allowed) != 200)
+    TEST_FAILED("Expected 200 steps, got " + Fmi::to_string(snap_steps(500, allowed)));
+  if (snap_steps(77, {}) != 77)
+    TEST_FAILED("Any step count should be allowed without a list");
+  TEST_PASSED();
+}
+
+void route()
+{
+  SnapPolicy policy;
+  policy.resolution = 0.1;
+  policy.steps = {50, 100};
+
+  auto query = make_query({{24.93, 60.17}, {25.72, 62.24}}, 60);
+  if (!snap_route(query, policy))
+    TEST_FAILED("The route should have been modified");
+  if (query.waypoints[0].longitude != 24.9 || query.waypoints[0].latitude != 60.2 ||
+      query.waypoints[1].longitude != 25.7 || query.waypoints[1].latitude != 62.2)
+    TEST_FAILED("Waypoints were not snapped to the grid");
+  if (query.steps != 100)
+    TEST_FAILED("Expected 100 steps, got " + Fmi::to_string(query.steps));
+
+  // Snapping an already snapped route changes nothing
+
+  if (snap_route(query, policy))
+    TEST_FAILED("A snapped route should not change");
+  TEST_PASSED();
+}
+
+void collapsed_route()
+{
+  SnapPolicy policy;
+  policy.resolution = 1.0;
+  policy.steps = {50, 100};
+
+  // The waypoints would merge, hence they are kept but the steps are still snapped
+
+  const Waypoints waypoints{{24.93, 60.17}, {25.02, 60.21}};
+  auto query = make_query(waypoints, 60);
+  if (!snap_route(query, policy))
+    TEST_FAILED("The steps should have been modified");
+  if (query.waypoints[0].longitude != waypoints[0].longitude ||
+      query.waypoints[1].latitude != waypoints[1].latitude)
+    TEST_FAILED("Waypoints which would merge should be kept as is");
+  if (query.steps != 100)
+    TEST_FAILED("Expected 100 steps, got " + Fmi::to_string(query.steps));
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(coordinate);
+    TEST(steps);
+    TEST(route);
+    TEST(collapsed_route);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nSnappingTest\n============\n";
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,125 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for class Topology
+ */
+// ======================================================================
+
+#include "Topology.h"
+#include <ogr_geometry.h>
+#include <regression/tframe.h>
+#include <memory>
+#include <stdexcept>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+std::unique_ptr<OGRGeometry> geometry(const char* theWkt)
+{
+  OGRGeometry* geom = nullptr;
+  if (OGRGeometryFactory::createFromWkt(theWkt, nullptr, &geom) != OGRERR_NONE)
+    throw std::runtime_error(std::string("Invalid WKT: ") + theWkt);
+  return std::unique_ptr<OGRGeometry>(geom);
+}
+
+void shared_edge()
+{
+  // Adjacent squares share the edge from (1,0) to (1,1)
+
+  auto square1 = geometry("POLYGON ((0 0,1 0,1 1,0 1,0 0))");
+  auto square2 = geometry("POLYGON ((1 0,2 0,2 1,1 1,1 0))");
+
+  Topology topology(1.0);
+  auto obj1 = topology.add(square1.get());
+  auto obj2 = topology.add(square2.get());
+  topology.build();
+
+  if (topology.arcCount() != 3)
+    TEST_FAILED("Expected 3 arcs, got " + std::to_string(topology.arcCount()));
+  if (topology.type(obj1) != "MultiPolygon")
+    TEST_FAILED("Expected a MultiPolygon, got " + topology.type(obj1));
+  if (topology.arcs(obj1) != "[[[0,1]]]")
+    TEST_FAILED("Unexpected arcs of the first square: " + topology.arcs(obj1));
+
+  // The second square traverses the shared arc in reverse
+  if (topology.arcs(obj2) != "[[[2,-1]]]")
+    TEST_FAILED("Unexpected arcs of the second square: " + topology.arcs(obj2));
+  if (topology.arc(0) != "[[1,0],[0,1]]")
+    TEST_FAILED("Unexpected shared arc: " + topology.arc(0));
+  TEST_PASSED();
+}
+
+void closed_ring()
+{
+  // The same ring started from different points, and in reverse order
+
+  auto ring1 = geometry("POLYGON ((5 5,6 5,6 6,5 6,5 5))");
+  auto ring2 = geometry("POLYGON ((6 6,5 6,5 5,6 5,6 6))");
+  auto ring3 = geometry("POLYGON ((5 5,5 6,6 6,6 5,5 5))");
+
+  Topology topology(1.0);
+  auto obj1 = topology.add(ring1.get());
+  auto obj2 = topology.add(ring2.get());
+  auto obj3 = topology.add(ring3.get());
+  topology.build();
+
+  if (topology.arcCount() != 1)
+    TEST_FAILED("Expected a single arc, got " + std::to_string(topology.arcCount()));
+  if (topology.arcs(obj1) != "[[[0]]]" || topology.arcs(obj2) != "[[[0]]]")
+    TEST_FAILED("Identical rings should refer to the same arc");
+  if (topology.arcs(obj3) != "[[[-1]]]")
+    TEST_FAILED("A reversed ring should refer to the arc in reverse, got " +
+                topology.arcs(obj3));
+  TEST_PASSED();
+}
+
+void delta_encoding()
+{
+  auto line = geometry("LINESTRING (0 0,1 0,1 1.5)");
+
+  Topology topology(0.5);
+  auto obj = topology.add(line.get());
+  topology.build();
+
+  if (topology.type(obj) != "MultiLineString")
+    TEST_FAILED("Expected a MultiLineString, got " + topology.type(obj));
+  if (topology.arcs(obj) != "[[0]]")
+    TEST_FAILED("Unexpected arcs of the line: " + topology.arcs(obj));
+  if (topology.arc(0) != "[[0,0],[2,0],[0,3]]")
+    TEST_FAILED("Unexpected delta encoding: " + topology.arc(0));
+  TEST_PASSED();
+}
+
+void empty_geometry()
+{
+  Topology topology(1.0);
+  auto obj = topology.add(nullptr);
+  topology.build();
+
+  if (topology.arcCount() != 0)
+    TEST_FAILED("An empty geometry should have no arcs");
+  if (topology.arcs(obj) != "[]")
+    TEST_FAILED("Unexpected arcs of an empty geometry: " + topology.arcs(obj));
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(shared_edge);
+    TEST(closed_ring);
+    TEST(delta_encoding);
+    TEST(empty_geometry);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nTopologyTest\n============\n";
+  Tests::tests t;
+  return t.run();
+}
@@ -0,0 +1,96 @@
+// ======================================================================
+/*!
+ * \brief Regression tests for trajectory cross-sections
+ */
+// ======================================================================
+
+#include "Sampling.h"
+#include <macgyver/StringConversion.h>
+#include <macgyver/TimeParser.h>
+#include <regression/tframe.h>
+
+using namespace SmartMet::Plugin::CrossSection;
+
+namespace Tests
+{
+// A plan with points at the given distances, the grid is irrelevant here
+
+SamplingPlan make_plan(const std::vector<double>& theDistances)
+{
+  SamplingPlan plan;
+  for (auto distance : theDistances)
+  {
+    SamplePoint point;
+    point.distance = distance;
+    plan.points.push_back(point);
+  }
+  return plan;
+}
+
+void times()
+{
+  // The second segment is twice as long and takes twice as long
+
+  const Waypoints route{{0, 0}, {1, 0}, {3, 0}};
+  const std::vector<Fmi::DateTime> waypoint_times{Fmi::TimeParser::parse_iso("20140728T010000"),
+                                                  Fmi::TimeParser::parse_iso("20140728T020000"),
+                                                  Fmi::TimeParser::parse_iso("20140728T040000")};
+
+  const double d1 = geodistance(0, 0, 1, 0);
+  const double d2 = d1 + geodistance(1, 0, 3, 0);
+  auto plan = make_plan({0, d1 / 2, d1, (d1 + d2) / 2, d2, d2 + 10});
+
+  auto result = trajectory_times(plan, route, waypoint_times);
+
+  const std::vector<std::string> expected{"20140728T010000",
+                                          "20140728T013000",
+                                          "20140728T020000",
+                                          "20140728T030000",
+                                          "20140728T040000",
+                                          "20140728T040000"};
+  if (result.size() != expected.size())
+    TEST_FAILED("Expected a time for each point, got " + std::to_string(result.size()));
+  for (std::size_t i = 0; i < expected.size(); i++)
+    if (Fmi::to_iso_string(result[i]) != expected[i])
+      TEST_FAILED("Point " + std::to_string(i) + ": expected " + expected[i] + ", got " +
+                  Fmi::to_iso_string(result[i]));
+  TEST_PASSED();
+}
+
+void missing_times()
+{
+  const Waypoints route{{0, 0}, {1, 0}, {3, 0}};
+  const std::vector<Fmi::DateTime> waypoint_times{Fmi::TimeParser::parse_iso("20140728T010000"),
+                                                  Fmi::TimeParser::parse_iso("20140728T020000")};
+  bool failed = false;
+  try
+  {
+    trajectory_times(make_plan({0}), route, waypoint_times);
+  }
+  catch (...)
+  {
+    failed = true;
+  }
+  if (!failed)
+    TEST_FAILED("Each waypoint should be required to have a time");
+  TEST_PASSED();
+}
+
+class tests : public tframe::tests
+{
+  const char* error_message_prefix() const override { return "\n\t"; }
+  void test() override
+  {
+    TEST(times);
+    TEST(missing_times);
+  }
+};
+
+}  // namespace Tests
+
+int main()
+{
+  std::cout << "\nTrajectoryTest\n==============\n";
+  Tests::tests t;
+  return t.run();
+}